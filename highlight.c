@@ -0,0 +1,204 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+
+#include "highlight.h"
+
+/* Kinds of word */
+enum { W_NONE, W_CMD, W_ARG, W_REDIR };
+
+/* Everything the lexer knows before a byte. Only byte fields, so states
+   compare with memcmp. */
+typedef struct {
+    unsigned char quote;   /* ' or " when inside one */
+    unsigned char esc;     /* after a backslash */
+    unsigned char comment;
+    unsigned char word;    /* kind of the word being read, W_NONE between words */
+    unsigned char redir;   /* the next word is a redirection target */
+    unsigned char seen;    /* this command's name has been read */
+    unsigned char cond;    /* between [[ and ]] */
+    unsigned char op;      /* the operator byte just read, if it may go on */
+} lex_state_t;
+
+struct highlight {
+    int (*is_command)(void *ud, const char *name);
+    void *ud;
+    size_t len, cap;
+    unsigned char *colors;     /* len */
+    lex_state_t *states;       /* len + 1: before each byte, and at the end */
+};
+
+static const char *sgr[] = {
+    [HL_PLAIN] = "\033[m",
+    [HL_CMD] = "\033[32m",
+    [HL_BADCMD] = "\033[31m",
+    [HL_STRING] = "\033[33m",
+    [HL_REDIR] = "\033[36m",
+    [HL_OP] = "\033[35m",
+    [HL_COMMENT] = "\033[90m",
+};
+
+const char *hl_sgr(int color) { return sgr[color]; }
+
+highlight_t *hl_new(int (*is_command)(void *ud, const char *name), void *ud) {
+    highlight_t *h = calloc(1, sizeof(*h));
+    if (!h) return NULL;
+    h->is_command = is_command;
+    h->ud = ud;
+    h->states = calloc(1, sizeof(*h->states));
+    if (!h->states) { free(h); return NULL; }
+    return h;
+}
+
+void hl_free(highlight_t *h) {
+    if (!h) return;
+    free(h->colors);
+    free(h->states);
+    free(h);
+}
+
+const unsigned char *hl_colors(const highlight_t *h) { return h->colors; }
+
+static int reserve(highlight_t *h, size_t len) {
+    if (len + 1 <= h->cap) return 0;
+    size_t cap = h->cap ? h->cap : 256;
+    while (cap < len + 1) cap *= 2;
+    unsigned char *nc = realloc(h->colors, cap);
+    if (!nc) return -1;
+    h->colors = nc;
+    lex_state_t *ns = realloc(h->states, cap * sizeof(*ns));
+    if (!ns) return -1;
+    h->states = ns;
+    h->cap = cap;
+    return 0;
+}
+
+/* name=value, which does not name the command */
+static int is_assign(const char *w, size_t n) {
+    size_t i = 0;
+    if (!n || !(w[0] == '_' || (w[0] >= 'A' && w[0] <= 'Z') || (w[0] >= 'a' && w[0] <= 'z'))) return 0;
+    while (i < n && (w[i] == '_' || (w[i] >= 'A' && w[i] <= 'Z') || (w[i] >= 'a' && w[i] <= 'z') ||
+                     (w[i] >= '0' && w[i] <= '9'))) i++;
+    return i < n && (w[i] == '=' || (w[i] == '+' && i + 1 < n && w[i+1] == '='));
+}
+
+/* The word buf[ws, we) is complete: colour a command name by whether it
+   runs, and track [[ ]] */
+static void end_word(highlight_t *h, const char *buf, size_t ws, size_t we, lex_state_t *st) {
+    size_t n = we - ws;
+    const char *w = buf + ws;
+    if (st->word == W_CMD && !is_assign(w, n)) {
+        char name[256];
+        size_t k = 0;
+        int known = 1;
+        /* quotes and backslashes are removed; an expansion is unknown */
+        for (size_t i = 0; i < n && known; ++i) {
+            if (w[i] == '$' || w[i] == '`' || k == sizeof(name) - 1) known = 0;
+            else if (w[i] != '\'' && w[i] != '"' && w[i] != '\\') name[k++] = w[i];
+        }
+        name[k] = 0;
+        int color = known && h->is_command && !h->is_command(h->ud, name) ? HL_BADCMD : HL_CMD;
+        for (size_t i = ws; i < we; ++i)
+            if (h->colors[i] == HL_PLAIN) h->colors[i] = color;
+        st->seen = 1;
+        if (n == 2 && w[0] == '[' && w[1] == '[') st->cond = 1;
+    } else if (st->cond && n == 2 && w[0] == ']' && w[1] == ']') {
+        st->cond = 0;
+    }
+    st->word = W_NONE;
+}
+
+/* Lex buf[i] in state st, colouring it; *ws is where the current word
+   started */
+static void lex_byte(highlight_t *h, const char *buf, size_t i, lex_state_t *st, size_t *ws) {
+    char c = buf[i], op = st->op;
+    unsigned char *color = &h->colors[i];
+    st->op = 0;
+    if (st->comment) { *color = HL_COMMENT; return; }
+    if (st->esc) {
+        st->esc = 0;
+        *color = st->quote ? HL_STRING : st->word == W_REDIR ? HL_REDIR : HL_PLAIN;
+        return;
+    }
+    if (st->quote) {
+        if (c == st->quote) st->quote = 0;
+        else if (c == '\\' && st->quote == '"') st->esc = 1;
+        *color = HL_STRING;
+        return;
+    }
+    /* >> >& <& && || */
+    if ((op == '>' && (c == '>' || c == '&')) || (op == '<' && c == '&') ||
+        (op == '&' && c == '&') || (op == '|' && c == '|')) {
+        *color = op == '>' || op == '<' ? HL_REDIR : HL_OP;
+        return;
+    }
+    if (c == ' ' || c == '\t' || c == '\n') {
+        if (st->word) end_word(h, buf, *ws, i, st);
+        *color = HL_PLAIN;
+        return;
+    }
+    if (!st->cond && (c == '<' || c == '>')) {
+        if (st->word) {
+            size_t d = *ws;
+            while (d < i && buf[d] >= '0' && buf[d] <= '9') d++;
+            if (d == i && st->word != W_REDIR) {
+                /* 2>: the digits name the fd */
+                memset(h->colors + *ws, HL_REDIR, i - *ws);
+                st->word = W_NONE;
+            } else {
+                end_word(h, buf, *ws, i, st);
+            }
+        }
+        *color = HL_REDIR;
+        st->redir = 1;
+        st->op = c;
+        return;
+    }
+    if (!st->cond && (c == '|' || c == '&' || c == ';')) {
+        if (st->word) end_word(h, buf, *ws, i, st);
+        *color = HL_OP;
+        st->seen = st->redir = 0;
+        st->op = c;
+        return;
+    }
+    if (c == '#' && !st->word) {
+        st->comment = 1;
+        *color = HL_COMMENT;
+        return;
+    }
+    if (!st->word) {
+        *ws = i;
+        st->word = st->redir ? W_REDIR : st->seen ? W_ARG : W_CMD;
+        st->redir = 0;
+    }
+    if (c == '\'' || c == '"') {
+        st->quote = c;
+        *color = HL_STRING;
+        return;
+    }
+    if (c == '\\') st->esc = 1;
+    *color = st->word == W_REDIR ? HL_REDIR : HL_PLAIN;
+}
+
+void hl_update(highlight_t *h, const char *buf, size_t at, size_t removed, size_t added) {
+    size_t len = h->len - removed + added;
+    /* resume where the word holding the edit began */
+    size_t r = at;
+    while (r > 0 && h->states[r].word) r--;
+    lex_state_t st = h->states[r];
+    if (reserve(h, len) < 0) return;
+    /* the unchanged tail keeps its colours and states, shifted */
+    memmove(h->colors + at + added, h->colors + at + removed, h->len - at - removed);
+    memmove(h->states + at + added, h->states + at + removed,
+            (h->len - at - removed + 1) * sizeof(*h->states));
+    h->len = len;
+    size_t ws = r, i;
+    for (i = r; i < len; ++i) {
+        h->states[i] = st;
+        lex_byte(h, buf, i, &st, &ws);
+        if (i + 1 >= at + added && !st.word && memcmp(&st, &h->states[i + 1], sizeof(st)) == 0) return;
+    }
+    h->states[len] = st;
+    /* an unfinished word is coloured as it stands */
+    if (st.word) end_word(h, buf, ws, len, &st);
+}
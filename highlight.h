@@ -0,0 +1,29 @@
+/* Syntax highlighting for the line editor. Commands are coloured by
+   whether they would run, strings, redirections and operators by kind.
+   The lexer's state before every byte is kept, so after an edit it
+   resumes at the start of the word edited and stops as soon as its state
+   matches the one recorded for the unchanged text that follows. */
+#ifndef HIGHLIGHT_H
+#define HIGHLIGHT_H
+
+#include <stddef.h>
+
+enum { HL_PLAIN, HL_CMD, HL_BADCMD, HL_STRING, HL_REDIR, HL_OP, HL_COMMENT };
+
+typedef struct highlight highlight_t;
+
+/* is_command(ud, name) tells whether a command word would run */
+highlight_t *hl_new(int (*is_command)(void *ud, const char *name), void *ud);
+void hl_free(highlight_t *h);
+
+/* buf now holds, at [at, at+added), what replaced removed bytes of the
+   text seen last */
+void hl_update(highlight_t *h, const char *buf, size_t at, size_t removed, size_t added);
+
+/* One HL_ colour per byte of the text */
+const unsigned char *hl_colors(const highlight_t *h);
+
+/* The escape sequence that starts a colour */
+const char *hl_sgr(int color);
+
+#endif
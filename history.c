@@ -0,0 +1,203 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "history.h"
+
+#define CHUNK_SIZE 65536
+
+/* Entry text lives in large chunks rather than one allocation each */
+typedef struct chunk {
+    struct chunk *next;
+    size_t used, size;
+    char data[];
+} chunk_t;
+
+/* A radix tree edge and the node below it. The label is a slice of the
+   entry that created it; latest is the newest entry through the node.
+   Links are indices into nodes, with 0 (the root) meaning none. */
+typedef struct {
+    uint32_t child, sibling;
+    uint32_t latest;
+    uint32_t src, off, len;
+} node_t;
+
+struct history {
+    char *file;
+    char **entries;
+    size_t n, cap;
+    chunk_t *chunks;
+    node_t *nodes;
+    uint32_t nnodes, node_cap;
+};
+
+static char *store(history_t *h, const char *s, size_t len) {
+    chunk_t *c = h->chunks;
+    if (!c || c->size - c->used < len + 1) {
+        size_t size = len + 1 > CHUNK_SIZE ? len + 1 : CHUNK_SIZE;
+        c = malloc(sizeof(*c) + size);
+        if (!c) return NULL;
+        c->next = h->chunks;
+        c->used = 0;
+        c->size = size;
+        h->chunks = c;
+    }
+    char *p = c->data + c->used;
+    memcpy(p, s, len);
+    p[len] = 0;
+    c->used += len + 1;
+    return p;
+}
+
+static uint32_t new_node(history_t *h, uint32_t src, uint32_t off, uint32_t len) {
+    if (h->nnodes == h->node_cap) {
+        uint32_t cap = h->node_cap ? h->node_cap * 2 : 1024;
+        node_t *nn = realloc(h->nodes, cap * sizeof(*nn));
+        if (!nn) return 0;
+        h->nodes = nn;
+        h->node_cap = cap;
+    }
+    h->nodes[h->nnodes] = (node_t){ 0, 0, src, src, off, len };
+    return h->nnodes++;
+}
+
+static const char *label(const history_t *h, const node_t *n) {
+    return h->entries[n->src] + n->off;
+}
+
+/* The child of node whose label starts with c, or 0 */
+static uint32_t find_child(const history_t *h, uint32_t node, char c) {
+    for (uint32_t k = h->nodes[node].child; k; k = h->nodes[k].sibling)
+        if (label(h, &h->nodes[k])[0] == c) return k;
+    return 0;
+}
+
+/* Thread entry id through the tree, splitting edges where it leaves them */
+static void index_entry(history_t *h, uint32_t id) {
+    const char *s = h->entries[id];
+    uint32_t len = strlen(s), i = 0, cur = 0;
+    h->nodes[0].latest = id;
+    while (i < len) {
+        uint32_t c = find_child(h, cur, s[i]);
+        if (!c) {
+            uint32_t leaf = new_node(h, id, i, len - i);
+            if (!leaf) return;
+            h->nodes[leaf].sibling = h->nodes[cur].child;
+            h->nodes[cur].child = leaf;
+            return;
+        }
+        const char *l = label(h, &h->nodes[c]);
+        uint32_t k = 0, max = h->nodes[c].len;
+        while (k < max && i + k < len && l[k] == s[i + k]) k++;
+        if (k < max) {
+            node_t old = h->nodes[c];
+            uint32_t rest = new_node(h, old.src, old.off + k, old.len - k);
+            if (!rest) return;
+            h->nodes[rest].latest = old.latest;
+            h->nodes[rest].child = old.child;
+            h->nodes[c].len = k;
+            h->nodes[c].child = rest;
+        }
+        h->nodes[c].latest = id;
+        cur = c;
+        i += k;
+    }
+}
+
+static int append(history_t *h, const char *line, size_t len) {
+    if (h->n == UINT32_MAX) return -1;
+    if (h->n == h->cap) {
+        size_t cap = h->cap ? h->cap * 2 : 1024;
+        char **ne = realloc(h->entries, cap * sizeof(*ne));
+        if (!ne) return -1;
+        h->entries = ne;
+        h->cap = cap;
+    }
+    char *s = store(h, line, len);
+    if (!s) return -1;
+    h->entries[h->n] = s;
+    index_entry(h, h->n++);
+    return 0;
+}
+
+static int is_last(const history_t *h, const char *line, size_t len) {
+    if (!h->n) return 0;
+    const char *last = h->entries[h->n - 1];
+    return strncmp(last, line, len) == 0 && !last[len];
+}
+
+history_t *history_new(const char *file) {
+    history_t *h = calloc(1, sizeof(*h));
+    if (!h) return NULL;
+    new_node(h, 0, 0, 0);
+    if (!h->nodes) { free(h); return NULL; }
+    if (!file) return h;
+    h->file = strdup(file);
+    FILE *f = fopen(file, "r");
+    if (!f) return h;
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    while ((n = getline(&line, &cap, f)) > 0) {
+        if (line[n-1] == '\n') n--;
+        if (n && !is_last(h, line, n) && append(h, line, n) < 0) break;
+    }
+    free(line);
+    fclose(f);
+    return h;
+}
+
+void history_free(history_t *h) {
+    if (!h) return;
+    while (h->chunks) {
+        chunk_t *next = h->chunks->next;
+        free(h->chunks);
+        h->chunks = next;
+    }
+    free(h->entries);
+    free(h->nodes);
+    free(h->file);
+    free(h);
+}
+
+void history_add(history_t *h, const char *line) {
+    size_t len = strlen(line);
+    if (!len || is_last(h, line, len) || append(h, line, len) < 0) return;
+    if (!h->file) return;
+    FILE *f = fopen(h->file, "a");
+    if (!f) return;
+    fprintf(f, "%s\n", line);
+    fclose(f);
+}
+
+size_t history_count(const history_t *h) { return h->n; }
+
+const char *history_get(const history_t *h, size_t i) {
+    return i < h->n ? h->entries[i] : NULL;
+}
+
+const char *history_suggest(const history_t *h, const char *s, size_t n) {
+    if (!n || !h->n) return NULL;
+    uint32_t cur = 0;
+    size_t i = 0;
+    while (i < n) {
+        uint32_t c = find_child(h, cur, s[i]);
+        if (!c) return NULL;
+        const char *l = label(h, &h->nodes[c]);
+        uint32_t k = 0, max = h->nodes[c].len;
+        while (k < max && i + k < n && l[k] == s[i + k]) k++;
+        if (i + k < n && k < max) return NULL;
+        cur = c;
+        i += k;
+    }
+    const char *e = h->entries[h->nodes[cur].latest];
+    if (e[n]) return e;
+    /* the newest is s itself: take the newest that goes on */
+    uint32_t best = 0;
+    int found = 0;
+    for (uint32_t k = h->nodes[cur].child; k; k = h->nodes[k].sibling)
+        if (!found || h->nodes[k].latest > best) { best = h->nodes[k].latest; found = 1; }
+    return found ? h->entries[best] : NULL;
+}
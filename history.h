@@ -0,0 +1,26 @@
+/* Command history for the interactive front end, kept in $HISTFILE
+   (~/.myshell_history by default). Entries are indexed by a radix tree
+   whose nodes remember the newest entry below them, so the most recent
+   entry starting with a prefix is found in time proportional to the
+   prefix, however long the history. */
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+
+typedef struct history history_t;
+
+/* Load file (NULL: in-memory only); new entries are appended to it */
+history_t *history_new(const char *file);
+void history_free(history_t *h);
+
+/* Record a line; repeating the newest entry does nothing */
+void history_add(history_t *h, const char *line);
+
+size_t history_count(const history_t *h);
+const char *history_get(const history_t *h, size_t i);
+
+/* The newest entry that starts with, and is longer than, s[0..n) */
+const char *history_suggest(const history_t *h, const char *s, size_t n);
+
+#endif
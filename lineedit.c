@@ -0,0 +1,346 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "lineedit.h"
+#include "highlight.h"
+
+#define MAX_WATCH 16
+
+/* Keys as read() returns them */
+#define CTRL(c) ((c) & 0x1f)
+
+struct lineedit {
+    int in, out;
+    le_hooks_t hooks;
+    struct termios cooked;
+    char *buf;
+    size_t len, cap, pos;      /* bytes; pos is the cursor */
+    const char *prompt;
+    int shown_rows;            /* prompt lines on screen above the cursor's */
+    history_t *hist;
+    size_t recall;             /* entry shown by up/down; count when none */
+    char *saved;               /* the line being typed before up */
+    const char *hint;          /* suggestion extending the line, or NULL */
+    highlight_t *hl;
+};
+
+typedef struct {
+    char *s;
+    size_t len, cap;
+} out_t;
+
+static void out_put(out_t *o, const char *s, size_t n) {
+    if (o->len + n > o->cap) {
+        size_t cap = o->cap ? o->cap * 2 : 1024;
+        while (cap < o->len + n) cap *= 2;
+        char *ns = realloc(o->s, cap);
+        if (!ns) return;
+        o->s = ns;
+        o->cap = cap;
+    }
+    memcpy(o->s + o->len, s, n);
+    o->len += n;
+}
+
+static void out_str(out_t *o, const char *s) { out_put(o, s, strlen(s)); }
+
+lineedit_t *le_new(int in_fd, int out_fd, const le_hooks_t *hooks) {
+    lineedit_t *le = calloc(1, sizeof(*le));
+    if (!le) return NULL;
+    le->in = in_fd;
+    le->out = out_fd;
+    if (hooks) le->hooks = *hooks;
+    return le;
+}
+
+void le_free(lineedit_t *le) {
+    if (!le) return;
+    free(le->buf);
+    free(le->saved);
+    free(le);
+}
+
+void le_set_history(lineedit_t *le, history_t *h) {
+    le->hist = h;
+}
+
+void le_set_highlight(lineedit_t *le, highlight_t *hl) {
+    le->hl = hl;
+    if (hl && le->len) hl_update(hl, le->buf, 0, 0, le->len);
+}
+
+/* The line, in its colours when highlighting */
+static void put_line(lineedit_t *le, out_t *o) {
+    if (!le->hl) { out_put(o, le->buf, le->len); return; }
+    const unsigned char *colors = hl_colors(le->hl);
+    size_t i = 0;
+    while (i < le->len) {
+        size_t j = i + 1;
+        while (j < le->len && colors[j] == colors[i]) j++;
+        out_str(o, hl_sgr(colors[i]));
+        out_put(o, le->buf + i, j - i);
+        i = j;
+    }
+    out_str(o, hl_sgr(HL_PLAIN));
+}
+
+static int raw_on(lineedit_t *le) {
+    if (tcgetattr(le->in, &le->cooked) < 0) return -1;
+    struct termios raw = le->cooked;
+    raw.c_iflag &= ~(ICRNL | IXON | BRKINT | INPCK | ISTRIP);
+    raw.c_lflag &= ~(ECHO | ICANON | ISIG | IEXTEN);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    return tcsetattr(le->in, TCSAFLUSH, &raw);
+}
+
+static void raw_off(lineedit_t *le) {
+    tcsetattr(le->in, TCSAFLUSH, &le->cooked);
+}
+
+static void flush_out(lineedit_t *le, out_t *o) {
+    size_t off = 0;
+    while (off < o->len) {
+        ssize_t n = write(le->out, o->s + off, o->len - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        off += n;
+    }
+    free(o->s);
+}
+
+/* Terminal cells taken by s[0..n): escape sequences take none and UTF-8
+   continuation bytes add nothing */
+static int cells(const char *s, size_t n) {
+    int w = 0;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char c = s[i];
+        if (c == 033 && i + 1 < n && s[i+1] == '[') {
+            for (i += 2; i < n && !(s[i] >= '@' && s[i] <= '~'); ++i) ;
+        } else if (c == 033 && i + 1 < n && s[i+1] == ']') {
+            for (i += 2; i < n && s[i] != '\a'; ++i) ;
+        } else if (c >= 0x20 && (c & 0xc0) != 0x80 && c != 0x7f) {
+            w++;
+        }
+    }
+    return w;
+}
+
+/* Redraw the edited line, and the whole prompt with full; hint shows the
+   history suggestion */
+static void redraw(lineedit_t *le, int full, int hint) {
+    out_t o = { NULL, 0, 0 };
+    char tmp[32];
+    const char *last = strrchr(le->prompt, '\n');
+    last = last ? last + 1 : le->prompt;
+    if (full && le->shown_rows) {
+        snprintf(tmp, sizeof(tmp), "\r\033[%dA", le->shown_rows);
+        out_str(&o, tmp);
+    }
+    if (full) {
+        le->shown_rows = 0;
+        for (const char *p = le->prompt; *p; ++p) le->shown_rows += *p == '\n';
+    }
+    out_str(&o, "\r");
+    out_str(&o, full ? le->prompt : last);
+    put_line(le, &o);
+    le->hint = hint && le->hist && le->pos == le->len ? history_suggest(le->hist, le->buf, le->len) : NULL;
+    int back = cells(le->buf + le->pos, le->len - le->pos);
+    if (le->hint) {
+        out_str(&o, "\033[90m");
+        out_str(&o, le->hint + le->len);
+        out_str(&o, "\033[m");
+        back = cells(le->hint + le->len, strlen(le->hint + le->len));
+    }
+    out_str(&o, "\033[K");
+    if (full) out_str(&o, "\033[J");
+    if (back) {
+        snprintf(tmp, sizeof(tmp), "\033[%dD", back);
+        out_str(&o, tmp);
+    }
+    flush_out(le, &o);
+}
+
+static void insert(lineedit_t *le, const char *s, size_t n) {
+    if (le->len + n + 1 > le->cap) {
+        size_t cap = le->cap ? le->cap * 2 : 256;
+        while (cap < le->len + n + 1) cap *= 2;
+        char *nb = realloc(le->buf, cap);
+        if (!nb) return;
+        le->buf = nb;
+        le->cap = cap;
+    }
+    memmove(le->buf + le->pos + n, le->buf + le->pos, le->len - le->pos);
+    memcpy(le->buf + le->pos, s, n);
+    le->len += n;
+    le->pos += n;
+    if (le->hl) hl_update(le->hl, le->buf, le->pos - n, 0, n);
+}
+
+static void erase(lineedit_t *le, size_t from, size_t to);
+
+static void set_line(lineedit_t *le, const char *s) {
+    erase(le, 0, le->len);
+    insert(le, s, strlen(s));
+}
+
+/* Up (dir -1) or down (1) through the history */
+static void recall(lineedit_t *le, int dir) {
+    size_t n = le->hist ? history_count(le->hist) : 0;
+    if (dir < 0 ? le->recall == 0 : le->recall >= n) return;
+    if (le->recall == n) {
+        free(le->saved);
+        le->saved = strndup(le->buf ? le->buf : "", le->len);
+    }
+    le->recall += dir;
+    set_line(le, le->recall < n ? history_get(le->hist, le->recall) : le->saved ? le->saved : "");
+}
+
+/* At the end of the line: take the suggestion shown */
+static int accept_hint(lineedit_t *le) {
+    if (!le->hint || le->pos != le->len) return 0;
+    set_line(le, le->hint);
+    return 1;
+}
+
+static void erase(lineedit_t *le, size_t from, size_t to) {
+    le->pos = from;
+    if (to <= from) return;
+    memmove(le->buf + from, le->buf + to, le->len - to);
+    le->len -= to - from;
+    if (le->hl) hl_update(le->hl, le->buf, from, to - from, 0);
+}
+
+/* One character left or right of pos, stepping over UTF-8 sequences */
+static size_t prev_char(const lineedit_t *le, size_t pos) {
+    if (pos) pos--;
+    while (pos && (le->buf[pos] & 0xc0) == 0x80) pos--;
+    return pos;
+}
+
+static size_t next_char(const lineedit_t *le, size_t pos) {
+    if (pos < le->len) pos++;
+    while (pos < le->len && (le->buf[pos] & 0xc0) == 0x80) pos++;
+    return pos;
+}
+
+/* Wait for a key, serving the hooks' fds meanwhile. Returns the byte, or
+   -1 at end of input. */
+static int read_key(lineedit_t *le) {
+    for (;;) {
+        struct pollfd fds[MAX_WATCH + 1];
+        fds[0].fd = le->in;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        int n = le->hooks.watch ? le->hooks.watch(le->hooks.ud, fds + 1, MAX_WATCH) : 0;
+        if (poll(fds, n + 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n && le->hooks.ready) {
+            const char *prompt = le->hooks.ready(le->hooks.ud, fds + 1, n);
+            if (prompt) {
+                le->prompt = prompt;
+                redraw(le, 1, 1);
+            }
+        }
+        if (!fds[0].revents) continue;
+        unsigned char c;
+        ssize_t r = read(le->in, &c, 1);
+        if (r < 0 && errno == EINTR) continue;
+        return r == 1 ? c : -1;
+    }
+}
+
+/* After ESC: the rest of an arrow or editing key. Returns a letter naming
+   it: A B C D (arrows), H F (home, end), 3 (delete), or 0. */
+static int read_escape(lineedit_t *le) {
+    int c = read_key(le);
+    if (c != '[' && c != 'O') return 0;
+    c = read_key(le);
+    if (c >= '0' && c <= '9') {
+        int d = read_key(le);
+        if (d != '~') return 0;
+        return c == '1' || c == '7' ? 'H' : c == '4' || c == '8' ? 'F' : c == '3' ? '3' : 0;
+    }
+    return c < 0 ? 0 : c;
+}
+
+char *le_readline(lineedit_t *le, const char *prompt) {
+    erase(le, 0, le->len);
+    le->prompt = prompt;
+    le->shown_rows = 0;
+    le->recall = le->hist ? history_count(le->hist) : 0;
+    if (raw_on(le) < 0) return NULL;
+    redraw(le, 1, 1);
+    char *line = NULL;
+    for (;;) {
+        int c = read_key(le);
+        if (c < 0 || (c == CTRL('D') && le->len == 0)) break;
+        if (c == '\r' || c == '\n') {
+            le->pos = le->len;
+            redraw(le, 0, 0);
+            line = strndup(le->buf ? le->buf : "", le->len);
+            break;
+        }
+        switch (c) {
+        case CTRL('C'):
+            le->pos = le->len;
+            redraw(le, 0, 0);
+            if (write(le->out, "^C", 2) < 0) { /* nothing to do */ }
+            line = strdup("");
+            goto done;
+        case CTRL('A'): le->pos = 0; break;
+        case CTRL('E'): if (!accept_hint(le)) le->pos = le->len; break;
+        case CTRL('B'): le->pos = prev_char(le, le->pos); break;
+        case CTRL('F'): if (!accept_hint(le)) le->pos = next_char(le, le->pos); break;
+        case CTRL('P'): recall(le, -1); break;
+        case CTRL('N'): recall(le, 1); break;
+        case CTRL('K'): erase(le, le->pos, le->len); break;
+        case CTRL('U'): erase(le, 0, le->pos); break;
+        case CTRL('D'): if (le->pos < le->len) erase(le, le->pos, next_char(le, le->pos)); break;
+        case CTRL('W'): {
+            size_t p = le->pos;
+            while (p && le->buf[p-1] == ' ') p--;
+            while (p && le->buf[p-1] != ' ') p--;
+            erase(le, p, le->pos);
+            break;
+        }
+        case CTRL('L'):
+            if (write(le->out, "\033[H\033[2J", 7) < 0) { /* nothing to do */ }
+            redraw(le, 1, 1);
+            continue;
+        case 127:
+        case CTRL('H'):
+            if (le->pos) erase(le, prev_char(le, le->pos), le->pos);
+            break;
+        case 033:
+            switch (read_escape(le)) {
+            case 'A': recall(le, -1); break;
+            case 'B': recall(le, 1); break;
+            case 'C': if (!accept_hint(le)) le->pos = next_char(le, le->pos); break;
+            case 'D': le->pos = prev_char(le, le->pos); break;
+            case 'H': le->pos = 0; break;
+            case 'F': if (!accept_hint(le)) le->pos = le->len; break;
+            case '3': if (le->pos < le->len) erase(le, le->pos, next_char(le, le->pos)); break;
+            }
+            break;
+        default:
+            if (c >= 0x20 || c == '\t') {
+                char ch = (char)c;
+                insert(le, &ch, 1);
+            }
+            break;
+        }
+        redraw(le, 0, 1);
+    }
+done:
+    if (write(le->out, "\r\n", 2) < 0) { /* nothing to do */ }
+    raw_off(le);
+    return line;
+}
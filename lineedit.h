@@ -0,0 +1,36 @@
+/* A small raw-mode line editor for the interactive front end. Besides the
+   terminal it polls fds handed over by the prompt, so the prompt can be
+   patched and redrawn while the user types. */
+#ifndef LINEEDIT_H
+#define LINEEDIT_H
+
+#include <poll.h>
+
+#include "history.h"
+#include "highlight.h"
+
+typedef struct {
+    void *ud;
+    /* extra fds to wait on, at most max; returns how many */
+    int (*watch)(void *ud, struct pollfd *fds, int max);
+    /* after some of them fired: a new prompt to show, or NULL */
+    const char *(*ready)(void *ud, const struct pollfd *fds, int n);
+} le_hooks_t;
+
+typedef struct lineedit lineedit_t;
+
+lineedit_t *le_new(int in_fd, int out_fd, const le_hooks_t *hooks);
+void le_free(lineedit_t *le);
+
+/* Recall entries of h with up and down, and suggest the newest one that
+   extends the line; right arrow or Ctrl-E at the end takes it */
+void le_set_history(lineedit_t *le, history_t *h);
+
+/* Colour the line as it is edited */
+void le_set_highlight(lineedit_t *le, highlight_t *hl);
+
+/* Read one line after showing prompt. Returns a string the caller frees,
+   "" after Ctrl-C, or NULL at end of input. */
+char *le_readline(lineedit_t *le, const char *prompt);
+
+#endif
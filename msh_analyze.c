@@ -0,0 +1,191 @@
+#define _POSIX_C_SOURCE 200809L
+#include "msh_internal.h"
+
+/* Print what execute_pipeline would do for this line without doing it.
+   Returns the number of commands that could not be resolved. */
+static int plan_pipeline(msh_t *sh, cmd_t cmds[], int ncmds, int background, int lineno) {
+    int missing = 0;
+    int forks = pipeline_forks(cmds, ncmds, background);
+    bi_printf(sh, "%s:%d: %s%s, %d fork%s\n", sh->script_name, lineno,
+           ncmds > 1 ? "pipeline" : "command", background ? " (background)" : "",
+           forks, forks == 1 ? "" : "s");
+    for (int i = 0; i < ncmds; ++i) {
+        cmd_t *c = &cmds[i];
+        bi_printf(sh, "  [%d]", i);
+        if (!c->argv[0]) {
+            bi_printf(sh, " (no command)");
+        } else {
+            char path[4096];
+            if (c->assign)
+                bi_printf(sh, " %s: assignment", c->argv[0]);
+            else if (c->builtin)
+                bi_printf(sh, " %s: %sbuiltin", c->argv[0],
+                          c->builtin->flags & BI_SPECIAL ? "special " :
+                          c->builtin->flags & BI_LOADED ? "loaded " : "");
+            else if (path_lookup(sh, c->argv[0], path, sizeof(path)) == 0)
+                bi_printf(sh, " %s: %s", c->argv[0], path);
+            else {
+                bi_printf(sh, " %s: MISSING", c->argv[0]);
+                missing++;
+            }
+            for (int j = 1; c->argv[j]; ++j) bi_printf(sh, " '%s'", c->argv[j]);
+        }
+        if (c->infile) bi_printf(sh, " <%s", c->infile);
+        if (c->outfile) bi_printf(sh, " %s%s", c->append ? ">>" : ">", c->outfile);
+        for (int k = 0; k < c->nredirs; ++k) {
+            static const char *const ops[] = { "<", ">", ">>", ">&" };
+            bi_printf(sh, " %d%s%s", c->redirs[k].fd, ops[c->redirs[k].op], c->redirs[k].target);
+        }
+        bi_write(sh, "\n", 1);
+    }
+    return missing;
+}
+
+/* External commands that are commonly run just to do string or arithmetic
+   work; each use costs a fork+exec. Skipped once they become builtins. */
+static const struct {
+    const char *name;
+    const char *hint;
+} lint_externals[] = {
+    { "expr",     "do the arithmetic once outside the hot path or in the consuming program" },
+    { "basename", "strip the directory in the consuming program or pass names relative to the directory" },
+    { "dirname",  "keep the directory in a variable instead of recomputing it" },
+    { "seq",      "generate the range in the consuming program" },
+    { "echo",     "feed constant input with '< file' instead of a pipe from echo" },
+    { "printf",   "feed constant input with '< file' instead of a pipe from printf" },
+    { "true",     "drop the command; it does nothing but fork" },
+    { "false",    "drop the command; it does nothing but fork" },
+    { NULL, NULL }
+};
+
+static int argc_of(cmd_t *c) {
+    int n = 0;
+    while (c->argv[n]) n++;
+    return n;
+}
+
+static void lint_report(msh_t *sh, int lineno, int saved, int forks, const char *what, const char *hint) {
+    bi_printf(sh, "%s:%d: %s: %s (saves %d of %d fork%s)\n", sh->script_name, lineno, what, hint,
+           saved, forks, forks == 1 ? "" : "s");
+}
+
+/* Flag constructs in one pipeline that fork more than needed.
+   Returns the fork count of the pipeline and adds the avoidable ones to *avoidable. */
+static int lint_pipeline(msh_t *sh, cmd_t cmds[], int ncmds, int background, int lineno, int *avoidable) {
+    int forks = pipeline_forks(cmds, ncmds, background);
+
+    int saved_total = 0;
+    for (int i = 0; i < ncmds; ++i) {
+        cmd_t *c = &cmds[i];
+        const char *name = c->argv[0];
+        if (!name) continue;
+        int argc = argc_of(c);
+        char what[256];
+
+        /* grep pat | wc -l  ->  grep -c pat; wc is a builtin, but after
+           grep it runs in a process of its own */
+        if (strcmp(name, "wc") == 0 && i > 0 && argc == 2 && strcmp(c->argv[1], "-l") == 0 &&
+            cmds[i-1].argv[0] && strcmp(cmds[i-1].argv[0], "grep") == 0) {
+            lint_report(sh, lineno, 1, forks, "grep | wc -l", "use grep -c");
+            saved_total++;
+            continue;
+        }
+        if (c->builtin) continue;
+
+        /* cat file | cmd  ->  cmd < file */
+        if (strcmp(name, "cat") == 0 && i == 0 && ncmds > 1 && argc == 2 && !c->infile) {
+            snprintf(what, sizeof(what), "cat %s | %s", c->argv[1],
+                     cmds[1].argv[0] ? cmds[1].argv[0] : "");
+            lint_report(sh, lineno, 1, forks, what, "redirect the file into the next stage with '<'");
+            saved_total++;
+            continue;
+        }
+        /* cmd | cat  ->  cmd */
+        if (strcmp(name, "cat") == 0 && i > 0 && argc == 1) {
+            lint_report(sh, lineno, 1, forks, "... | cat", "drop the trailing cat");
+            saved_total++;
+            continue;
+        }
+        /* sort | uniq  ->  sort -u */
+        if (strcmp(name, "uniq") == 0 && i > 0 && argc == 1 &&
+            cmds[i-1].argv[0] && strcmp(cmds[i-1].argv[0], "sort") == 0) {
+            lint_report(sh, lineno, 1, forks, "sort | uniq", "use sort -u");
+            saved_total++;
+            continue;
+        }
+        for (int k = 0; lint_externals[k].name; ++k) {
+            if (strcmp(name, lint_externals[k].name) == 0) {
+                lint_report(sh, lineno, 1, forks, name, lint_externals[k].hint);
+                saved_total++;
+                break;
+            }
+        }
+    }
+    *avoidable += saved_total;
+    return forks;
+}
+
+/* Expand each runnable line of script and hand it to fn; returns the sum
+   of fn's results. Lines that fail to expand are counted in *bad. */
+static int for_each_line(msh_t *sh, const msh_script_t *script, int *bad,
+                         int (*fn)(msh_t *, cmd_t *, int, int, int, void *), void *arg) {
+    int total = 0;
+    for (int i = 0; i < script->nlines; ++i) {
+        const msh_line_t *ln = &script->lines[i];
+        if (ln->bad) continue;
+        cmd_t *cmds = calloc(ln->ncmds, sizeof(cmd_t));
+        if (!cmds || expand_cmds(sh, ln, cmds) < 0) {
+            free(cmds);
+            (*bad)++;
+            continue;
+        }
+        total += fn(sh, cmds, ln->ncmds, ln->background, ln->lineno, arg);
+        free_expanded(cmds, ln->ncmds);
+        free(cmds);
+    }
+    return total;
+}
+
+static int plan_fn(msh_t *sh, cmd_t *cmds, int ncmds, int background, int lineno, void *arg) {
+    (void)arg;
+    return plan_pipeline(sh, cmds, ncmds, background, lineno);
+}
+
+static int lint_fn(msh_t *sh, cmd_t *cmds, int ncmds, int background, int lineno, void *arg) {
+    return lint_pipeline(sh, cmds, ncmds, background, lineno, (int *)arg);
+}
+
+/* Analysis output goes wherever the context's standard output goes */
+static void analysis_begin(msh_t *sh, const msh_script_t *script, const char **saved) {
+    *saved = sh->script_name;
+    sh->script_name = script->name;
+    sh->std_out.fd = sh->out_fd;
+    sh->std_out.cb = sh->on_output != NULL;
+    sh->bi_out = &sh->std_out;
+}
+
+static void analysis_end(msh_t *sh, const char *saved) {
+    bi_flush(sh, &sh->std_out);
+    sh->script_name = saved;
+}
+
+int msh_plan(msh_t *sh, const msh_script_t *script) {
+    const char *saved;
+    int bad = script->nerrors;
+    analysis_begin(sh, script, &saved);
+    int missing = for_each_line(sh, script, &bad, plan_fn, NULL);
+    bi_printf(sh, "%s: %d lines, %d syntax errors, %d missing commands\n",
+              script->name, script->nlines, bad, missing);
+    analysis_end(sh, saved);
+    return missing + bad;
+}
+
+int msh_lint_perf(msh_t *sh, const msh_script_t *script) {
+    const char *saved;
+    int bad = script->nerrors, avoidable = 0;
+    analysis_begin(sh, script, &saved);
+    int forks = for_each_line(sh, script, &bad, lint_fn, &avoidable);
+    bi_printf(sh, "%s: %d forks per run, %d avoidable\n", script->name, forks, avoidable);
+    analysis_end(sh, saved);
+    return avoidable;
+}
@@ -0,0 +1,546 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+
+#include "msh_internal.h"
+
+/* Indexed and associative arrays.
+
+   Element strings live back to back, NUL-terminated, in one arena per
+   array; elements refer to them by offset, so adding an element allocates
+   nothing once the arena and tables have grown. Indexed arrays are a
+   vector of offsets; one whose indexes would leave most of that vector
+   empty keeps only the elements set, with their indexes in a sorted
+   vector beside them. Associative arrays are an open-addressing index of
+   32-bit entry numbers over a dense entry vector, which keeps insertion
+   order for ${!a[@]} and ${a[@]}. Overwritten strings are garbage in the
+   arena until it is compacted. */
+
+#define NONE UINT32_MAX
+#define SPARSE_MIN 1024 /* indexes below this never make an array sparse */
+
+typedef struct {
+    uint32_t hash;
+    uint32_t key, val; /* arena offsets; key NONE: deleted */
+} aent_t;
+
+struct msh_array {
+    char *name;
+    int kind;                 /* ARR_INDEXED or ARR_ASSOC */
+    size_t count;             /* elements set */
+
+    char *arena;
+    size_t alen, acap, garbage;
+
+    /* ARR_INDEXED: vals[i] is the offset of element i, or NONE. Sparse
+       arrays have keys: vals[k] is then the element with index keys[k],
+       ascending, and vlen counts the elements. */
+    uint32_t *vals, *keys;
+    size_t vlen, vcap;
+
+    /* ARR_ASSOC: slots hold entry number + 1; 0 empty, NONE a tombstone */
+    uint32_t *slots;
+    size_t scap, sused;
+    aent_t *ents;
+    size_t nents, ecap;
+};
+
+/* Room for an n-byte string plus its NUL; returns its offset */
+static uint32_t arena_alloc(msh_array_t *a, size_t n) {
+    if (a->alen + n + 1 > a->acap) {
+        size_t ncap = a->acap ? a->acap * 2 : 256;
+        while (ncap < a->alen + n + 1) ncap *= 2;
+        if (ncap > (size_t)NONE) return NONE;
+        char *nb = realloc(a->arena, ncap);
+        if (!nb) return NONE;
+        a->arena = nb;
+        a->acap = ncap;
+    }
+    uint32_t off = (uint32_t)a->alen;
+    a->arena[off + n] = 0;
+    a->alen += n + 1;
+    return off;
+}
+
+static uint32_t arena_put(msh_array_t *a, const char *s, size_t n) {
+    uint32_t off = arena_alloc(a, n);
+    if (off != NONE) memcpy(a->arena + off, s, n);
+    return off;
+}
+
+static void arena_drop(msh_array_t *a, uint32_t off) {
+    if (off != NONE) a->garbage += strlen(a->arena + off) + 1;
+}
+
+static void move_string(char *to, size_t *len, const char *from, uint32_t *off) {
+    size_t n = strlen(from + *off) + 1;
+    memcpy(to + *len, from + *off, n);
+    *off = (uint32_t)*len;
+    *len += n;
+}
+
+/* Copy the live strings into a fresh arena once most of it is garbage */
+static void arena_compact(msh_array_t *a) {
+    if (a->garbage < 65536 || a->garbage < a->alen / 2) return;
+    size_t live = a->alen - a->garbage, len = 0;
+    char *nb = malloc(live);
+    if (!nb) return;
+    if (a->kind == ARR_INDEXED) {
+        for (size_t i = 0; i < a->vlen; ++i)
+            if (a->vals[i] != NONE) move_string(nb, &len, a->arena, &a->vals[i]);
+    } else {
+        for (size_t i = 0; i < a->nents; ++i) {
+            if (a->ents[i].key == NONE) continue;
+            move_string(nb, &len, a->arena, &a->ents[i].key);
+            move_string(nb, &len, a->arena, &a->ents[i].val);
+        }
+    }
+    free(a->arena);
+    a->arena = nb;
+    a->alen = a->acap = len;
+    a->garbage = 0;
+}
+
+/* Associative index */
+
+static int assoc_rehash(msh_array_t *a, size_t ncap) {
+    uint32_t *ns = calloc(ncap, sizeof(*ns));
+    if (!ns) return -1;
+    /* drop deleted entries while rebuilding */
+    size_t live = 0;
+    for (size_t i = 0; i < a->nents; ++i) {
+        if (a->ents[i].key == NONE) continue;
+        a->ents[live] = a->ents[i];
+        size_t s = a->ents[live].hash & (ncap - 1);
+        while (ns[s]) s = (s + 1) & (ncap - 1);
+        ns[s] = (uint32_t)live + 1;
+        live++;
+    }
+    free(a->slots);
+    a->slots = ns;
+    a->scap = ncap;
+    a->nents = a->sused = live;
+    return 0;
+}
+
+/* Slot holding key, or the free slot where it would go */
+static size_t assoc_slot(const msh_array_t *a, const char *key, uint32_t h, int *found) {
+    size_t s = h & (a->scap - 1), tomb = SIZE_MAX;
+    for (;;) {
+        uint32_t v = a->slots[s];
+        if (!v) break;
+        if (v == NONE) {
+            if (tomb == SIZE_MAX) tomb = s;
+        } else {
+            const aent_t *e = &a->ents[v - 1];
+            if (e->hash == h && strcmp(a->arena + e->key, key) == 0) { *found = 1; return s; }
+        }
+        s = (s + 1) & (a->scap - 1);
+    }
+    *found = 0;
+    return tomb != SIZE_MAX ? tomb : s;
+}
+
+/* Indexed elements */
+
+/* One past the highest index set */
+static size_t index_end(const msh_array_t *a) {
+    if (!a->keys) return a->vlen;
+    return a->vlen ? (size_t)a->keys[a->vlen - 1] + 1 : 0;
+}
+
+/* Where element i is, or would go, in vals */
+static size_t index_slot(const msh_array_t *a, size_t i, int *found) {
+    if (!a->keys) {
+        *found = i < a->vlen && a->vals[i] != NONE;
+        return i;
+    }
+    size_t lo = 0, hi = a->vlen;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (a->keys[mid] < i) lo = mid + 1;
+        else hi = mid;
+    }
+    *found = lo < a->vlen && a->keys[lo] == i;
+    return lo;
+}
+
+static int vals_reserve(msh_array_t *a, size_t n) {
+    if (n <= a->vcap) return 0;
+    size_t ncap = a->vcap ? a->vcap * 2 : 16;
+    while (ncap < n) ncap *= 2;
+    uint32_t *nv = realloc(a->vals, ncap * sizeof(*nv));
+    if (!nv) return -1;
+    a->vals = nv;
+    if (a->keys) {
+        uint32_t *nk = realloc(a->keys, ncap * sizeof(*nk));
+        if (!nk) return -1;
+        a->keys = nk;
+    }
+    a->vcap = ncap;
+    return 0;
+}
+
+/* Keep only the elements set, with their indexes */
+static int make_sparse(msh_array_t *a) {
+    if (vals_reserve(a, 1) < 0 || !(a->keys = malloc(a->vcap * sizeof(*a->keys)))) return -1;
+    size_t n = 0;
+    for (size_t i = 0; i < a->vlen; ++i) {
+        if (a->vals[i] == NONE) continue;
+        a->keys[n] = (uint32_t)i;
+        a->vals[n++] = a->vals[i];
+    }
+    a->vlen = n;
+    return 0;
+}
+
+/* Indexed subscripts: integers, negative ones counting back from the end */
+static int index_of(const msh_array_t *a, const char *key, size_t *idx) {
+    char *end;
+    errno = 0;
+    long long v = strtoll(key, &end, 10);
+    while (*end == ' ') end++;
+    if (end == key || *end || errno) return -1;
+    if (v < 0) v += (long long)index_end(a);
+    if (v < 0 || v >= (long long)NONE) return -1;
+    *idx = (size_t)v;
+    return 0;
+}
+
+/* The table of arrays */
+
+msh_array_t *array_find(msh_t *sh, const char *name) {
+    for (size_t i = 0; i < sh->narrays; ++i)
+        if (strcmp(sh->arrays[i]->name, name) == 0) return sh->arrays[i];
+    return NULL;
+}
+
+msh_array_t *array_declare(msh_t *sh, const char *name, int kind) {
+    msh_array_t *a = array_find(sh, name);
+    if (a) {
+        if (a->kind == kind) return a;
+        msh_error(sh, "%s: cannot convert %s array", name, a->kind == ARR_ASSOC ? "associative" : "indexed");
+        return NULL;
+    }
+    if (sh->narrays == sh->arraycap) {
+        size_t ncap = sh->arraycap ? sh->arraycap * 2 : 8;
+        msh_array_t **na = realloc(sh->arrays, ncap * sizeof(*na));
+        if (!na) return NULL;
+        sh->arrays = na;
+        sh->arraycap = ncap;
+    }
+    if (!(a = calloc(1, sizeof(*a))) || !(a->name = strdup(name))) { free(a); return NULL; }
+    a->kind = kind;
+    /* an array replaces a variable of the same name, keeping its value */
+    const char *old = msh_getvar(sh, name);
+    if (old) array_set(a, "0", old, 0);
+    msh_unsetvar(sh, name);
+    sh->arrays[sh->narrays++] = a;
+    return a;
+}
+
+static void array_destroy(msh_array_t *a) {
+    free(a->name);
+    free(a->arena);
+    free(a->vals);
+    free(a->keys);
+    free(a->slots);
+    free(a->ents);
+    free(a);
+}
+
+int array_unset(msh_t *sh, const char *name) {
+    for (size_t i = 0; i < sh->narrays; ++i) {
+        if (strcmp(sh->arrays[i]->name, name) != 0) continue;
+        array_destroy(sh->arrays[i]);
+        sh->arrays[i] = sh->arrays[--sh->narrays];
+        return 0;
+    }
+    return -1;
+}
+
+void arrays_free(msh_t *sh) {
+    for (size_t i = 0; i < sh->narrays; ++i) array_destroy(sh->arrays[i]);
+    free(sh->arrays);
+    sh->arrays = NULL;
+    sh->narrays = sh->arraycap = 0;
+}
+
+size_t arrays_mem(msh_t *sh) {
+    size_t n = sh->arraycap * sizeof(*sh->arrays);
+    for (size_t i = 0; i < sh->narrays; ++i) {
+        const msh_array_t *a = sh->arrays[i];
+        n += sizeof(*a) + strlen(a->name) + 1 + a->acap + a->vcap * sizeof(*a->vals) +
+             (a->keys ? a->vcap * sizeof(*a->keys) : 0) + a->scap * sizeof(*a->slots) + a->ecap * sizeof(*a->ents);
+    }
+    return n;
+}
+
+int array_kind(const msh_array_t *a) { return a->kind; }
+const char *array_name(const msh_array_t *a) { return a->name; }
+size_t array_count(const msh_array_t *a) { return a->count; }
+
+/* Elements */
+
+const char *array_get(const msh_array_t *a, const char *key) {
+    if (a->kind == ARR_INDEXED) {
+        size_t i;
+        int found;
+        if (index_of(a, key, &i) < 0) return NULL;
+        i = index_slot(a, i, &found);
+        return found ? a->arena + a->vals[i] : NULL;
+    }
+    if (!a->scap) return NULL;
+    int found;
+    size_t s = assoc_slot(a, key, (uint32_t)str_hash(key), &found);
+    return found ? a->arena + a->ents[a->slots[s] - 1].val : NULL;
+}
+
+/* Set key to val, or append val to it. Returns -1 for a bad subscript or
+   when memory runs out. */
+int array_set(msh_array_t *a, const char *key, const char *val, int append) {
+    size_t i = 0;
+    if (a->kind == ARR_INDEXED && index_of(a, key, &i) < 0) return -1;
+    const char *old = append ? array_get(a, key) : NULL;
+    size_t olen = old ? strlen(old) : 0, vlen = strlen(val);
+    /* build the new value before the old one is dropped */
+    uint32_t off = arena_alloc(a, olen + vlen);
+    if (off == NONE) return -1;
+    if (olen) memcpy(a->arena + off, array_get(a, key), olen);
+    memcpy(a->arena + off + olen, val, vlen);
+
+    if (a->kind == ARR_INDEXED) {
+        /* a[1000000000]=x must not allocate a billion slots */
+        if (!a->keys && i >= a->vlen && i >= SPARSE_MIN && i / 4 > a->count && make_sparse(a) < 0)
+            return -1;
+        int found;
+        size_t k = index_slot(a, i, &found);
+        if (!a->keys) {
+            if (vals_reserve(a, i + 1) < 0) return -1;
+            while (a->vlen <= i) a->vals[a->vlen++] = NONE;
+        } else if (!found) {
+            if (vals_reserve(a, a->vlen + 1) < 0) return -1;
+            memmove(a->vals + k + 1, a->vals + k, (a->vlen - k) * sizeof(*a->vals));
+            memmove(a->keys + k + 1, a->keys + k, (a->vlen - k) * sizeof(*a->keys));
+            a->keys[k] = (uint32_t)i;
+            a->vals[k] = NONE;
+            a->vlen++;
+        }
+        if (a->vals[k] == NONE) a->count++;
+        else arena_drop(a, a->vals[k]);
+        a->vals[k] = off;
+        arena_compact(a);
+        return 0;
+    }
+
+    if ((a->sused + 1) * 4 > a->scap * 3) {
+        /* grow, or only sweep out tombstones if most slots hold them */
+        size_t ncap = a->scap ? a->scap : 16;
+        while ((a->count + 1) * 2 > ncap) ncap *= 2;
+        if (assoc_rehash(a, ncap) < 0) return -1;
+    }
+    uint32_t h = (uint32_t)str_hash(key);
+    int found;
+    size_t s = assoc_slot(a, key, h, &found);
+    if (found) {
+        aent_t *e = &a->ents[a->slots[s] - 1];
+        arena_drop(a, e->val);
+        e->val = off;
+    } else {
+        if (a->nents == a->ecap) {
+            size_t ncap = a->ecap ? a->ecap * 2 : 16;
+            aent_t *ne = realloc(a->ents, ncap * sizeof(*ne));
+            if (!ne) return -1;
+            a->ents = ne;
+            a->ecap = ncap;
+        }
+        uint32_t koff = arena_put(a, key, strlen(key));
+        if (koff == NONE) return -1;
+        if (!a->slots[s]) a->sused++;
+        a->ents[a->nents] = (aent_t){ h, koff, off };
+        a->slots[s] = (uint32_t)++a->nents;
+        a->count++;
+    }
+    arena_compact(a);
+    return 0;
+}
+
+int array_unset_elem(msh_array_t *a, const char *key) {
+    if (a->kind == ARR_INDEXED) {
+        size_t i;
+        int found;
+        if (index_of(a, key, &i) < 0) return -1;
+        i = index_slot(a, i, &found);
+        if (!found) return 0;
+        arena_drop(a, a->vals[i]);
+        a->count--;
+        if (a->keys) {
+            a->vlen--;
+            memmove(a->vals + i, a->vals + i + 1, (a->vlen - i) * sizeof(*a->vals));
+            memmove(a->keys + i, a->keys + i + 1, (a->vlen - i) * sizeof(*a->keys));
+            return 0;
+        }
+        a->vals[i] = NONE;
+        while (a->vlen && a->vals[a->vlen - 1] == NONE) a->vlen--;
+        return 0;
+    }
+    if (!a->scap) return 0;
+    int found;
+    size_t s = assoc_slot(a, key, (uint32_t)str_hash(key), &found);
+    if (!found) return 0;
+    aent_t *e = &a->ents[a->slots[s] - 1];
+    arena_drop(a, e->key);
+    arena_drop(a, e->val);
+    e->key = NONE;
+    a->slots[s] = NONE;
+    a->count--;
+    return 0;
+}
+
+/* Elements in order. *pos starts at 0; returns 0 when there are no more.
+   keybuf receives the subscript of indexed elements. */
+int array_next(const msh_array_t *a, size_t *pos, const char **key, char keybuf[24], const char **val) {
+    if (a->kind == ARR_INDEXED) {
+        while (*pos < a->vlen && a->vals[*pos] == NONE) (*pos)++;
+        if (*pos >= a->vlen) return 0;
+        snprintf(keybuf, 24, "%zu", a->keys ? (size_t)a->keys[*pos] : *pos);
+        *key = keybuf;
+        *val = a->arena + a->vals[(*pos)++];
+        return 1;
+    }
+    while (*pos < a->nents && a->ents[*pos].key == NONE) (*pos)++;
+    if (*pos >= a->nents) return 0;
+    *key = a->arena + a->ents[*pos].key;
+    *val = a->arena + a->ents[(*pos)++].val;
+    return 1;
+}
+
+/* Bytes held by the array, for memory accounting */
+size_t array_bytes(const msh_array_t *a) {
+    return sizeof(*a) + a->acap + a->vcap * sizeof(uint32_t) * (a->keys ? 2 : 1) +
+           a->scap * sizeof(uint32_t) + a->ecap * sizeof(aent_t);
+}
+
+/* Assignment words, as expand_cmds writes them:
+     name='value'  name+='value'  name['sub']='value'
+     name=('v' ['k']='v' ...)  name+=(...)
+   Values and subscripts are single-quoted with ' written as '\''. */
+
+/* Read a quoted string at *p into b; returns -1 if malformed */
+static int unquote(const char **p, strbuf_t *b) {
+    const char *s = *p;
+    b->len = 0;
+    sb_putn(b, "", 0);
+    if (*s != '\'') return -1;
+    for (;;) {
+        const char *q = strchr(++s, '\'');
+        if (!q) return -1;
+        sb_putn(b, s, q - s);
+        s = q + 1;
+        if (strncmp(s, "\\''", 3) != 0) break;
+        sb_putn(b, "'", 1);
+        s += 2;
+    }
+    *p = s;
+    return 0;
+}
+
+void quote_into(strbuf_t *b, const char *s) {
+    sb_putn(b, "'", 1);
+    for (const char *q; (q = strchr(s, '\'')); s = q + 1) {
+        sb_putn(b, s, q - s);
+        sb_putn(b, "'\\''", 4);
+    }
+    sb_putn(b, s, strlen(s));
+    sb_putn(b, "'", 1);
+}
+
+/* Apply one assignment word. kind forces the array type (declare -a/-A);
+   0 keeps the variable's current type or makes a scalar. */
+int assign_word(msh_t *sh, const char *word, int kind) {
+    const char *p = word;
+    while (*p && *p != '[' && *p != '=' && *p != '+') p++;
+    char *name = strndup(word, p - word);
+    strbuf_t sub = { NULL, 0, 0 }, val = { NULL, 0, 0 };
+    int status = 1, has_sub = 0, append = 0;
+    if (!name) goto out;
+    if (*p == '[') {
+        p++;
+        if (unquote(&p, &sub) < 0 || *p++ != ']') goto bad;
+        has_sub = 1;
+    }
+    if (*p == '+') { append = 1; p++; }
+    if (*p++ != '=') goto bad;
+
+    msh_array_t *a = array_find(sh, name);
+    if (*p == '(') {
+        if (has_sub) goto bad;
+        if (!kind) kind = a ? a->kind : ARR_INDEXED;
+        if (a && !append) { array_unset(sh, name); a = NULL; }
+        if (!(a = array_declare(sh, name, kind))) goto out;
+        /* indexed elements without a subscript follow the last index */
+        size_t next = append && a->kind == ARR_INDEXED ? index_end(a) : 0;
+        p++;
+        while (*p == ' ') p++;
+        while (*p && *p != ')') {
+            char keybuf[24];
+            const char *key;
+            if (*p == '[') {
+                p++;
+                if (unquote(&p, &sub) < 0 || *p++ != ']' || *p++ != '=') goto bad;
+                key = sub.s;
+            } else if (a->kind == ARR_ASSOC) {
+                msh_error(sh, "%s: must use a subscript when assigning an associative array", name);
+                goto out;
+            } else {
+                snprintf(keybuf, sizeof(keybuf), "%zu", next);
+                key = keybuf;
+            }
+            if (unquote(&p, &val) < 0) goto bad;
+            if (array_set(a, key, val.s, 0) < 0) {
+                msh_error(sh, "%s[%s]: bad array subscript", name, key);
+                goto out;
+            }
+            if (a->kind == ARR_INDEXED) {
+                size_t i;
+                if (index_of(a, key, &i) == 0) next = i + 1;
+            }
+            while (*p == ' ') p++;
+        }
+        if (*p != ')') goto bad;
+        status = 0;
+        goto out;
+    }
+
+    if (unquote(&p, &val) < 0 || *p) goto bad;
+    if (!a && (has_sub || kind)) a = array_declare(sh, name, kind ? kind : ARR_INDEXED);
+    if (!a && (has_sub || kind)) goto out;
+    if (a) {
+        const char *key = has_sub ? sub.s : "0";
+        if (array_set(a, key, val.s, append) < 0) {
+            msh_error(sh, "%s[%s]: bad array subscript", name, key);
+            goto out;
+        }
+    } else {
+        const char *old = append ? msh_getvar(sh, name) : NULL;
+        if (old) {
+            strbuf_t joined = { NULL, 0, 0 };
+            sb_putn(&joined, old, strlen(old));
+            sb_putn(&joined, val.s, val.len);
+            msh_setvar(sh, name, joined.s);
+            free(joined.s);
+        } else {
+            msh_setvar(sh, name, val.s);
+        }
+    }
+    status = 0;
+    goto out;
+bad:
+    msh_error(sh, "%s: bad assignment", word);
+out:
+    free(name);
+    free(sub.s);
+    free(val.s);
+    return status;
+}
@@ -0,0 +1,625 @@
+#define _XOPEN_SOURCE 700
+#include <dlfcn.h>
+#include <limits.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <sys/stat.h>
+
+#include "msh_internal.h"
+/* handler prototypes, builtin_hash() and builtin_table[], from builtins.def */
+#include "builtins_table.h"
+
+const shell_option_t shell_options[OPT_COUNT] = {
+    [OPT_PROFILE]    = { "profile",    0 },
+    [OPT_XTRACE]     = { "xtrace",     'x' },
+    [OPT_XTRACETIME] = { "xtracetime", 0 },
+    [OPT_ERREXIT]    = { "errexit",    'e' },
+    [OPT_NOUNSET]    = { "nounset",    'u' },
+    [OPT_PIPEFAIL]   = { "pipefail",   0 },
+    [OPT_COMPRESS]   = { "compress",   0 },
+};
+
+static int builtin_cd(msh_t *sh, cmd_t *c) {
+    return cd_command(sh, c->argv);
+}
+
+static int builtin_pwd(msh_t *sh, cmd_t *c) {
+    return pwd_command(sh, c->argv);
+}
+
+static int builtin_dirs(msh_t *sh, cmd_t *c) {
+    return dirs_command(sh, c->argv);
+}
+
+static int builtin_pushd(msh_t *sh, cmd_t *c) {
+    return pushd_command(sh, c->argv);
+}
+
+static int builtin_popd(msh_t *sh, cmd_t *c) {
+    return popd_command(sh, c->argv);
+}
+
+static int builtin_record(msh_t *sh, cmd_t *c) {
+    return record_command(sh, c->argv);
+}
+
+static int builtin_replay(msh_t *sh, cmd_t *c) {
+    return replay_command(sh, c->argv);
+}
+
+static int builtin_seq(msh_t *sh, cmd_t *c) {
+    return seq_command(sh, c->argv);
+}
+
+static int builtin_basename(msh_t *sh, cmd_t *c) {
+    return basename_command(sh, c->argv);
+}
+
+static int builtin_dirname(msh_t *sh, cmd_t *c) {
+    return dirname_command(sh, c->argv);
+}
+
+static int builtin_printf(msh_t *sh, cmd_t *c) {
+    return printf_command(sh, c->argv);
+}
+
+static int builtin_wc(msh_t *sh, cmd_t *c) {
+    return wc_command(sh, c->argv);
+}
+
+static int builtin_head(msh_t *sh, cmd_t *c) {
+    return head_command(sh, c->argv);
+}
+
+static int builtin_tail(msh_t *sh, cmd_t *c) {
+    return tail_command(sh, c->argv);
+}
+
+/* z [-lrtcx] term...: cd to the best match among visited directories */
+static int builtin_z(msh_t *sh, cmd_t *c) {
+    char *dir;
+    int status = z_command(sh, c->argv, &dir);
+    if (dir) {
+        status = change_dir(sh, dir, 0);
+        free(dir);
+    }
+    return status;
+}
+
+static int builtin_set(msh_t *sh, cmd_t *c) {
+    if (!c->argv[1]) {
+        for (int i = 0; i < OPT_COUNT; ++i)
+            bi_printf(sh, "%-12s %s\n", shell_options[i].name, sh->opts[i] ? "on" : "off");
+        return 0;
+    }
+    for (int i = 1; c->argv[i]; ++i) {
+        char *a = c->argv[i];
+        if ((a[0] != '-' && a[0] != '+') || !a[1]) {
+            msh_error(sh, "set: usage: set [-x] [-o|+o option]");
+            return 1;
+        }
+        int on = a[0] == '-';
+        if (strcmp(a + 1, "o") == 0) {
+            char *name = c->argv[++i];
+            if (!name || msh_set_option(sh, name, on) < 0) {
+                msh_error(sh, "set: %s: invalid option name", name ? name : "");
+                return 1;
+            }
+            continue;
+        }
+        for (char *l = a + 1; *l; ++l) {
+            int j = 0;
+            while (j < OPT_COUNT && shell_options[j].letter != *l) j++;
+            if (j == OPT_COUNT) {
+                msh_error(sh, "set: -%c: invalid option", *l);
+                return 1;
+            }
+            sh->opts[j] = on;
+        }
+    }
+    return 0;
+}
+
+static int builtin_echo(msh_t *sh, cmd_t *c) {
+    int i = 1, newline = 1;
+    if (c->argv[1] && strcmp(c->argv[1], "-n") == 0) { newline = 0; i++; }
+    for (int first = 1; c->argv[i]; ++i, first = 0)
+        if ((!first && bi_write(sh, " ", 1) < 0) || bi_write(sh, c->argv[i], strlen(c->argv[i])) < 0) return 1;
+    if (newline && bi_write(sh, "\n", 1) < 0) return 1;
+    return 0;
+}
+
+/* read [-r] name...: read one line and assign its fields to the named
+   variables, the last one taking the rest of the line. Reads a byte at a
+   time so no input past the newline is consumed. */
+static int builtin_read(msh_t *sh, cmd_t *c) {
+    int i = 1;
+    if (c->argv[i] && strcmp(c->argv[i], "-r") == 0) i++;
+    strbuf_t b = { NULL, 0, 0 };
+    sb_putn(&b, "", 0);
+    char ch;
+    int got = 0;
+    while (bi_read(sh, &ch, 1) == 1) {
+        got = 1;
+        if (ch == '\n') break;
+        sb_putn(&b, &ch, 1);
+    }
+    if (!got) { free(b.s); return 1; }
+    char *p = b.s;
+    for (; c->argv[i]; ++i) {
+        while (*p == ' ' || *p == '\t') p++;
+        char *end = p;
+        if (c->argv[i+1]) {
+            while (*end && *end != ' ' && *end != '\t') end++;
+            if (*end) *end++ = 0;
+        } else {
+            end = p + strlen(p);
+            while (end > p && (end[-1] == ' ' || end[-1] == '\t')) *--end = 0;
+        }
+        msh_setvar(sh, c->argv[i], p);
+        p = end;
+    }
+    free(b.s);
+    return 0;
+}
+
+/* A line made only of NAME=value words. expand_cmds has already quoted
+   each one in the form assign_word() reads. */
+static int run_assign(msh_t *sh, cmd_t *c) {
+    int status = 0;
+    for (int i = 0; c->argv[i]; ++i)
+        if (assign_word(sh, c->argv[i], 0)) status = 1;
+    return status;
+}
+
+const builtin_def_t assign_builtin = { "assignment", run_assign, BI_INPROC };
+
+static void print_array(msh_t *sh, const msh_array_t *a) {
+    strbuf_t b = { NULL, 0, 0 };
+    size_t pos = 0;
+    const char *key, *val;
+    char keybuf[24];
+    sb_putn(&b, array_kind(a) == ARR_ASSOC ? "declare -A " : "declare -a ", 11);
+    sb_putn(&b, array_name(a), strlen(array_name(a)));
+    sb_putn(&b, "=(", 2);
+    while (array_next(a, &pos, &key, keybuf, &val)) {
+        sb_putn(&b, "[", 1);
+        quote_into(&b, key);
+        sb_putn(&b, "]=", 2);
+        quote_into(&b, val);
+        sb_putn(&b, " ", 1);
+    }
+    sb_putn(&b, ")\n", 2);
+    if (b.s) bi_write(sh, b.s, b.len);
+    free(b.s);
+}
+
+static int print_var(msh_t *sh, const char *name) {
+    msh_array_t *a = array_find(sh, name);
+    if (a) { print_array(sh, a); return 0; }
+    const char *val = msh_getvar(sh, name);
+    if (!val) return -1;
+    /* every scalar is exported */
+    strbuf_t b = { NULL, 0, 0 };
+    sb_putn(&b, "declare -x ", 11);
+    sb_putn(&b, name, strlen(name));
+    sb_putn(&b, "=", 1);
+    quote_into(&b, val);
+    sb_putn(&b, "\n", 1);
+    if (b.s) bi_write(sh, b.s, b.len);
+    free(b.s);
+    return 0;
+}
+
+static int builtin_declare(msh_t *sh, cmd_t *c) {
+    int kind = 0, print = 0, i = 1;
+    for (; c->argv[i] && c->argv[i][0] == '-' && c->argv[i][1]; ++i) {
+        for (char *f = c->argv[i] + 1; *f; ++f) {
+            if (*f == 'a') kind = ARR_INDEXED;
+            else if (*f == 'A') kind = ARR_ASSOC;
+            else if (*f == 'p') print = 1;
+            else {
+                msh_error(sh, "declare: usage: declare [-aAp] [name[=value] ...]");
+                return 2;
+            }
+        }
+    }
+    if (!c->argv[i]) {
+        for (size_t k = 0; k < sh->narrays; ++k)
+            if (!kind || array_kind(sh->arrays[k]) == kind) print_array(sh, sh->arrays[k]);
+        for (size_t k = 0; !kind && k < sh->nenv; ++k) {
+            char *eq = strchr(sh->env[k], '=');
+            char *name = strndup(sh->env[k], eq - sh->env[k]);
+            if (name) print_var(sh, name);
+            free(name);
+        }
+        return 0;
+    }
+    int status = 0;
+    for (; c->argv[i]; ++i) {
+        const char *arg = c->argv[i];
+        if (print) {
+            if (print_var(sh, arg) < 0) {
+                msh_error(sh, "declare: %s: not found", arg);
+                status = 1;
+            }
+        } else if (strchr(arg, '=')) {
+            if (assign_word(sh, arg, kind)) status = 1;
+        } else if (kind) {
+            msh_array_t *a = array_find(sh, arg);
+            if (a && array_kind(a) != kind) {
+                msh_error(sh, "declare: %s: cannot convert %s array", arg,
+                          array_kind(a) == ARR_ASSOC ? "associative" : "indexed");
+                status = 1;
+            } else if (!a && !array_declare(sh, arg, kind)) {
+                status = 1;
+            }
+        }
+    }
+    return status;
+}
+
+/* unset name... removes variables and arrays; unset 'a[k]' one element */
+static int builtin_unset(msh_t *sh, cmd_t *c) {
+    int i = 1;
+    if (c->argv[i] && strcmp(c->argv[i], "-v") == 0) i++;
+    for (; c->argv[i]; ++i) {
+        char *arg = c->argv[i], *br = strchr(arg, '[');
+        size_t len = strlen(arg);
+        if (br && len > 1 && arg[len-1] == ']') {
+            char *name = strndup(arg, br - arg);
+            char *key = strndup(br + 1, len - (br - arg) - 2);
+            msh_array_t *a = name ? array_find(sh, name) : NULL;
+            if (a) array_unset_elem(a, key);
+            else if (name && key && strtol(key, NULL, 10) == 0 && *key) msh_unsetvar(sh, name);
+            free(name);
+            free(key);
+        } else if (array_unset(sh, arg) < 0) {
+            msh_unsetvar(sh, arg);
+        }
+    }
+    return 0;
+}
+
+static dyn_builtin_t *dyn_find(msh_t *sh, const char *name) {
+    for (size_t i = 0; i < sh->ndyn; ++i)
+        if (strcmp(sh->dyn[i]->def.name, name) == 0) return sh->dyn[i];
+    return NULL;
+}
+
+static void dyn_release(dyn_builtin_t *d) {
+    free((char *)d->def.name);
+    if (d->handle) dlclose(d->handle);
+    free(d);
+}
+
+static int run_dyn(msh_t *sh, cmd_t *c) {
+    const dyn_builtin_t *d = (const dyn_builtin_t *)c->builtin;
+    int argc = 0;
+    while (c->argv[argc]) argc++;
+    /* it may change files the stat cache knows about */
+    stat_cache_clear(sh);
+    return d->fn(sh, argc, c->argv);
+}
+
+/* Add or replace a loaded builtin; takes over handle */
+static int dyn_add(msh_t *sh, const char *name, msh_builtin_fn fn, void *handle) {
+    const builtin_def_t *old = builtin_lookup(sh, name);
+    if (old && !(old->flags & BI_LOADED)) {
+        msh_error(sh, "enable: %s: is a shell builtin", name);
+        if (handle) dlclose(handle);
+        return -1;
+    }
+    dyn_builtin_t *d = calloc(1, sizeof(*d));
+    if (d && !(d->def.name = strdup(name))) { free(d); d = NULL; }
+    if (!d) { if (handle) dlclose(handle); return -1; }
+    d->def.fn = run_dyn;
+    d->def.flags = BI_INPROC | BI_LOADED;
+    d->fn = fn;
+    d->handle = handle;
+    for (size_t i = 0; i < sh->ndyn; ++i) {
+        if (&sh->dyn[i]->def == old) {
+            dyn_release(sh->dyn[i]);
+            sh->dyn[i] = d;
+            return 0;
+        }
+    }
+    if (sh->ndyn == sh->dyncap) {
+        size_t ncap = sh->dyncap ? sh->dyncap * 2 : 8;
+        dyn_builtin_t **nd = realloc(sh->dyn, ncap * sizeof(*nd));
+        if (!nd) { dyn_release(d); return -1; }
+        sh->dyn = nd;
+        sh->dyncap = ncap;
+    }
+    sh->dyn[sh->ndyn++] = d;
+    return 0;
+}
+
+int msh_add_builtin(msh_t *sh, const char *name, msh_builtin_fn fn) {
+    return dyn_add(sh, name, fn, NULL);
+}
+
+void dyn_free(msh_t *sh) {
+    for (size_t i = 0; i < sh->ndyn; ++i) dyn_release(sh->dyn[i]);
+    free(sh->dyn);
+    sh->dyn = NULL;
+    sh->ndyn = sh->dyncap = 0;
+}
+
+/* enable                     list loaded builtins
+   enable -f lib.so name...   load msh_builtin_<name> from lib.so
+   enable -d name...          unload */
+static int builtin_enable(msh_t *sh, cmd_t *c) {
+    if (!c->argv[1]) {
+        for (size_t i = 0; i < sh->ndyn; ++i)
+            bi_printf(sh, "enable %s\n", sh->dyn[i]->def.name);
+        return 0;
+    }
+    int status = 0;
+    if (strcmp(c->argv[1], "-d") == 0) {
+        for (int i = 2; c->argv[i]; ++i) {
+            size_t j = 0;
+            while (j < sh->ndyn && strcmp(sh->dyn[j]->def.name, c->argv[i]) != 0) j++;
+            if (j == sh->ndyn) { msh_error(sh, "enable: %s: not a loaded builtin", c->argv[i]); status = 1; continue; }
+            dyn_release(sh->dyn[j]);
+            sh->dyn[j] = sh->dyn[--sh->ndyn];
+        }
+        return status;
+    }
+    if (strcmp(c->argv[1], "-f") != 0 || !c->argv[2] || !c->argv[3]) {
+        msh_error(sh, "enable: usage: enable [-f file name... | -d name...]");
+        return 2;
+    }
+    /* a relative path with a slash is relative to the context's directory */
+    char path[PATH_MAX];
+    const char *file = c->argv[2];
+    if (sh->cwd && file[0] != '/' && strchr(file, '/')) {
+        snprintf(path, sizeof(path), "%s/%s", sh->cwd, file);
+        file = path;
+    }
+    for (int i = 3; c->argv[i]; ++i) {
+        const builtin_def_t *b = builtin_lookup(sh, c->argv[i]);
+        if (b && !(b->flags & BI_LOADED)) {
+            msh_error(sh, "enable: %s: is a shell builtin", c->argv[i]);
+            status = 1;
+            continue;
+        }
+        /* one reference per builtin, so each can be unloaded on its own */
+        void *handle = dlopen(file, RTLD_NOW | RTLD_LOCAL);
+        if (!handle) { msh_error(sh, "enable: %s", dlerror()); return 1; }
+        char sym[256];
+        snprintf(sym, sizeof(sym), "msh_builtin_%s", c->argv[i]);
+        msh_builtin_fn fn;
+        *(void **)&fn = dlsym(handle, sym);
+        if (!fn) {
+            msh_error(sh, "enable: %s: no %s in %s", c->argv[i], sym, c->argv[2]);
+            dlclose(handle);
+            status = 1;
+            continue;
+        }
+        if (dyn_add(sh, c->argv[i], fn, handle) < 0) status = 1;
+    }
+    return status;
+}
+
+static int builtin_cond(msh_t *sh, cmd_t *c) {
+    return cond_eval(sh, c->argv);
+}
+
+/* source file, or . file: run it in this shell */
+static int builtin_source(msh_t *sh, cmd_t *c) {
+    if (!c->argv[1] || c->argv[2]) {
+        msh_error(sh, "%s: usage: %s file", c->argv[0], c->argv[0]);
+        return 2;
+    }
+    return source_file(sh, c->argv[1]);
+}
+
+/* How type and command -V describe name; 0 if it was found */
+static int describe(msh_t *sh, const char *who, const char *name, int mode, int defpath) {
+    const builtin_def_t *b = defpath ? NULL : builtin_lookup(sh, name);
+    char path[4096], dp[1024];
+    const char *hashed = NULL;
+    int found;
+    if (b) {
+        if (mode == 't') bi_printf(sh, "builtin\n");
+        else if (mode == 'v') bi_printf(sh, "%s\n", name);
+        else if (mode == 'V') bi_printf(sh, "%s is a %sshell builtin\n", name,
+                                        b->flags & BI_SPECIAL ? "special " : "");
+        return 0;
+    }
+    if (defpath && !strchr(name, '/')) {
+        confstr(_CS_PATH, dp, sizeof(dp));
+        found = path_search(sh, dp, name, path, sizeof(path));
+    } else {
+        hashed = path_hashed(sh, name);
+        found = path_lookup(sh, name, path, sizeof(path));
+    }
+    if (found < 0) {
+        if (mode == 'V') msh_error(sh, "%s: %s: not found", who, name);
+        return 1;
+    }
+    if (mode == 't') bi_printf(sh, "file\n");
+    else if (mode == 'V' && hashed) bi_printf(sh, "%s is hashed (%s)\n", name, path);
+    else if (mode == 'V') bi_printf(sh, "%s is %s\n", name, path);
+    else bi_printf(sh, "%s\n", path);
+    return 0;
+}
+
+/* type [-t|-p] name...: builtin or file, answered without forking */
+static int builtin_type(msh_t *sh, cmd_t *c) {
+    int mode = 'V', i = 1, status = 0;
+    for (; c->argv[i] && c->argv[i][0] == '-' && c->argv[i][1]; ++i) {
+        if (strcmp(c->argv[i], "-t") == 0) mode = 't';
+        else if (strcmp(c->argv[i], "-p") == 0) mode = 'p';
+        else {
+            msh_error(sh, "type: usage: type [-t|-p] name ...");
+            return 2;
+        }
+    }
+    for (; c->argv[i]; ++i) {
+        /* -p names only files */
+        if (mode == 'p' && builtin_lookup(sh, c->argv[i])) continue;
+        if (describe(sh, "type", c->argv[i], mode == 'p' ? 'v' : mode, 0)) status = 1;
+    }
+    return status;
+}
+
+/* command -v|-V [-p] name... (command name args is handled by expand_cmds) */
+static int builtin_command(msh_t *sh, cmd_t *c) {
+    int mode = 0, defpath = 0, i = 1, status = 0;
+    for (; c->argv[i] && c->argv[i][0] == '-' && c->argv[i][1]; ++i) {
+        for (char *f = c->argv[i] + 1; *f; ++f) {
+            if (*f == 'v' || *f == 'V') mode = *f;
+            else if (*f == 'p') defpath = 1;
+            else {
+                msh_error(sh, "command: usage: command [-pvV] name [arg ...]");
+                return 2;
+            }
+        }
+    }
+    if (!mode) return 0;
+    for (; c->argv[i]; ++i)
+        if (describe(sh, "command", c->argv[i], mode, defpath)) status = 1;
+    return status;
+}
+
+/* which name...: PATH only, like the external one */
+static int builtin_which(msh_t *sh, cmd_t *c) {
+    int status = 0;
+    for (int i = 1; c->argv[i]; ++i) {
+        char path[4096];
+        if (path_lookup(sh, c->argv[i], path, sizeof(path)) == 0) bi_printf(sh, "%s\n", path);
+        else status = 1;
+    }
+    return status;
+}
+
+/* hash lists remembered commands; hash -r forgets them; hash name adds */
+static int builtin_hashcmd(msh_t *sh, cmd_t *c) {
+    if (!c->argv[1]) {
+        path_hash_print(sh);
+        return 0;
+    }
+    int status = 0;
+    for (int i = 1; c->argv[i]; ++i) {
+        char path[4096];
+        if (strcmp(c->argv[i], "-r") == 0) {
+            path_hash_clear(sh);
+        } else if (path_lookup(sh, c->argv[i], path, sizeof(path)) < 0) {
+            msh_error(sh, "hash: %s: not found", c->argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+static long percent(long part, long total) {
+    return total ? part * 100 / total : 0;
+}
+
+/* debug stats: cache counters of this context */
+static int builtin_debug(msh_t *sh, cmd_t *c) {
+    if (!c->argv[1] || strcmp(c->argv[1], "stats") != 0 || c->argv[2]) {
+        msh_error(sh, "debug: usage: debug stats");
+        return 2;
+    }
+    long sh_ = sh->stats.stat_hits, sm = sh->stats.stat_misses;
+    long rh = sh->stats.re_hits, rm = sh->stats.re_misses;
+    bi_printf(sh, "stat cache:  %ld hits, %ld misses (%ld%% hit rate), %ld flushes\n",
+              sh_, sm, percent(sh_, sh_ + sm), sh->stats.stat_flushes);
+    bi_printf(sh, "regex cache: %ld hits, %ld misses (%ld%% hit rate)\n",
+              rh, rm, percent(rh, rh + rm));
+    long sch = sh->stats.source_hits, scm = sh->stats.source_misses;
+    bi_printf(sh, "source cache: %ld hits, %ld misses (%ld%% hit rate)\n",
+              sch, scm, percent(sch, sch + scm));
+    long ph = sh->stats.path_hits, pm = sh->stats.path_misses;
+    bi_printf(sh, "path hash:   %ld hits, %ld misses (%ld%% hit rate)\n",
+              ph, pm, percent(ph, ph + pm));
+    return 0;
+}
+
+/* meminfo: what this context holds, by subsystem, then the process's
+   heap and resident size for comparison */
+static int builtin_meminfo(msh_t *sh, cmd_t *c) {
+    if (c->argv[1]) {
+        msh_error(sh, "meminfo: usage: meminfo");
+        return 2;
+    }
+    size_t lines, mapped, running = 0;
+    for (int i = 0; i < sh->jobcap; ++i) running += sh->jobs[i].running;
+    struct { const char *name; size_t bytes; } part[] = {
+        { "context", sizeof(*sh) },
+        { "jobs", jobs_mem(sh, &lines) },
+        { "job lines", lines },
+        { "variables", env_mem(sh) },
+        { "arrays", arrays_mem(sh) },
+        { "scripts", source_cache_mem(sh) },
+        { "path hash", path_hash_mem(sh) },
+        { "stat cache", stat_cache_mem(sh) },
+        { "regex cache", cond_mem(sh) },
+        { "profile", prof_mem(sh) },
+        { "dirs", dirs_mem(sh) },
+        { "z", z_mem(sh, &mapped) },
+        { "record", rec_mem(sh) },
+    };
+    size_t total = 0;
+    for (size_t i = 0; i < sizeof(part) / sizeof(part[0]); ++i) {
+        bi_printf(sh, "%-12s %10zu\n", part[i].name, part[i].bytes);
+        total += part[i].bytes;
+    }
+    bi_printf(sh, "%-12s %10zu  (%d job slots, %zu running)\n", "total", total, sh->jobcap, running);
+    if (mapped) bi_printf(sh, "%-12s %10zu\n", "z mapped", mapped);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 mi = mallinfo2();
+    bi_printf(sh, "%-12s %10zu\n", "heap in use", mi.uordblks + mi.hblkhd);
+#endif
+    FILE *f = fopen("/proc/self/statm", "r");
+    unsigned long size, rss;
+    if (f && fscanf(f, "%lu %lu", &size, &rss) == 2)
+        bi_printf(sh, "%-12s %10lu\n", "resident", rss * (unsigned long)sysconf(_SC_PAGESIZE));
+    if (f) fclose(f);
+    return 0;
+}
+
+/* exec cmd args replaces the shell with cmd; exec with only redirections
+   makes them the shell's own: exec 3>log, exec <input, exec 2>&- */
+static int builtin_exec(msh_t *sh, cmd_t *c) {
+    if (c->argv[1]) return exec_replace(sh, c);
+    return redir_shell(sh, c);
+}
+
+static int builtin_exit(msh_t *sh, cmd_t *c) {
+    int status = c->argv[1] ? atoi(c->argv[1]) : 0;
+    shell_exit(sh, status);
+    return status;
+}
+
+static int builtin_jobs(msh_t *sh, cmd_t *c) {
+    (void)c;
+    for (int i = 0; i < sh->jobcap; ++i) {
+        if (sh->jobs[i].running) {
+            bi_printf(sh, "[%d] %d  %s\n", i+1, (int)sh->jobs[i].pid, sh->jobs[i].cmdline);
+        }
+    }
+    return 0;
+}
+
+/* The shell's own builtins are found with one probe of the perfect hash
+   table generated from builtins.def; loaded builtins are searched after. */
+const builtin_def_t *builtin_lookup(msh_t *sh, const char *name) {
+    const builtin_def_t *b = &builtin_table[builtin_hash(name)];
+    if (b->name && strcmp(b->name, name) == 0) return b;
+    dyn_builtin_t *d = dyn_find(sh, name);
+    return d ? &d->def : NULL;
+}
+
+/* Run the builtin that expand_cmds resolved for c, using the current builtin
+   streams; return 1 if builtin executed, 0 otherwise. The builtin's exit
+   status is left in last_status. */
+int dispatch_builtin(msh_t *sh, cmd_t *c) {
+    if (!c->builtin) return 0;
+    sh->last_status = c->builtin->fn(sh, c);
+    return 1;
+}
@@ -0,0 +1,308 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fnmatch.h>
+#include <regex.h>
+#include <sys/stat.h>
+
+#include "msh_internal.h"
+
+/* Compiled =~ patterns. Compiling dominates a match, so a loop testing
+   lines against the same few patterns compiles each once: entries sit in a
+   small hash table and on a recency list, and the least recently used
+   entry is recycled when the cache is full. */
+#define RE_CACHE_SIZE 64
+#define RE_BUCKETS (RE_CACHE_SIZE * 2)
+
+typedef struct {
+    char *pat;      /* NULL: unused */
+    unsigned hash;
+    regex_t re;
+    int prev, next; /* recency list, most recent at head */
+    int hnext;      /* hash chain */
+} re_entry_t;
+
+struct re_cache {
+    re_entry_t ent[RE_CACHE_SIZE];
+    int bucket[RE_BUCKETS];
+    int head, tail, used;
+};
+
+static struct re_cache *re_cache_get(msh_t *sh) {
+    if (sh->re_cache) return sh->re_cache;
+    struct re_cache *rc = calloc(1, sizeof(*rc));
+    if (!rc) return NULL;
+    for (int i = 0; i < RE_BUCKETS; ++i) rc->bucket[i] = -1;
+    rc->head = rc->tail = -1;
+    return sh->re_cache = rc;
+}
+
+static void lru_unlink(struct re_cache *rc, int i) {
+    re_entry_t *e = &rc->ent[i];
+    if (e->prev >= 0) rc->ent[e->prev].next = e->next; else rc->head = e->next;
+    if (e->next >= 0) rc->ent[e->next].prev = e->prev; else rc->tail = e->prev;
+}
+
+static void lru_push(struct re_cache *rc, int i) {
+    re_entry_t *e = &rc->ent[i];
+    e->prev = -1;
+    e->next = rc->head;
+    if (rc->head >= 0) rc->ent[rc->head].prev = i; else rc->tail = i;
+    rc->head = i;
+}
+
+/* Drop the least recently used entry and return its slot */
+static int re_evict(struct re_cache *rc) {
+    int i = rc->tail;
+    re_entry_t *e = &rc->ent[i];
+    int *link = &rc->bucket[e->hash % RE_BUCKETS];
+    while (*link != i) link = &rc->ent[*link].hnext;
+    *link = e->hnext;
+    lru_unlink(rc, i);
+    regfree(&e->re);
+    free(e->pat);
+    e->pat = NULL;
+    return i;
+}
+
+/* The compiled form of pat, or NULL with the error reported */
+static const regex_t *re_lookup(msh_t *sh, const char *pat) {
+    struct re_cache *rc = re_cache_get(sh);
+    if (!rc) { msh_perror(sh, "[["); return NULL; }
+    unsigned h = str_hash(pat);
+    for (int i = rc->bucket[h % RE_BUCKETS]; i >= 0; i = rc->ent[i].hnext) {
+        re_entry_t *e = &rc->ent[i];
+        if (e->hash == h && strcmp(e->pat, pat) == 0) {
+            if (rc->head != i) { lru_unlink(rc, i); lru_push(rc, i); }
+            sh->stats.re_hits++;
+            return &e->re;
+        }
+    }
+    sh->stats.re_misses++;
+    regex_t re;
+    int err = regcomp(&re, pat, REG_EXTENDED | REG_NOSUB);
+    if (err) {
+        char msg[256];
+        regerror(err, &re, msg, sizeof(msg));
+        msh_error(sh, "[[: %s: %s", pat, msg);
+        return NULL;
+    }
+    char *copy = strdup(pat);
+    if (!copy) { regfree(&re); msh_perror(sh, "[["); return NULL; }
+    int i = rc->used < RE_CACHE_SIZE ? rc->used++ : re_evict(rc);
+    re_entry_t *e = &rc->ent[i];
+    e->pat = copy;
+    e->hash = h;
+    e->re = re;
+    e->hnext = rc->bucket[h % RE_BUCKETS];
+    rc->bucket[h % RE_BUCKETS] = i;
+    lru_push(rc, i);
+    return &e->re;
+}
+
+void cond_free(msh_t *sh) {
+    struct re_cache *rc = sh->re_cache;
+    if (!rc) return;
+    for (int i = 0; i < rc->used; ++i) {
+        if (!rc->ent[i].pat) continue;
+        regfree(&rc->ent[i].re);
+        free(rc->ent[i].pat);
+    }
+    free(rc);
+    sh->re_cache = NULL;
+}
+
+/* The compiled patterns' own allocations are not counted */
+size_t cond_mem(msh_t *sh) {
+    struct re_cache *rc = sh->re_cache;
+    if (!rc) return 0;
+    size_t n = sizeof(*rc);
+    for (int i = 0; i < rc->used; ++i)
+        if (rc->ent[i].pat) n += strlen(rc->ent[i].pat) + 1;
+    return n;
+}
+
+/* Evaluation of the words between [[ and ]], or of the arguments of test
+   and [. Each level returns 0 (true), 1 (false) or 2 (error, already
+   reported). */
+typedef struct {
+    msh_t *sh;
+    const char *name; /* [[, test or [ */
+    int test;         /* test syntax: -a -o, = is plain string equality, no =~ */
+    char **w;
+    int i, n;
+    int skip; /* parsing an operand of && or || that is already decided */
+} cond_t;
+
+static int cond_or(cond_t *cp);
+
+static const char *cond_peek(cond_t *cp, int k) {
+    return cp->i + k < cp->n ? cp->w[cp->i + k] : NULL;
+}
+
+static int cond_int(cond_t *cp, const char *s, long long *v) {
+    char *end;
+    errno = 0;
+    *v = strtoll(s, &end, 10);
+    while (*end == ' ' || *end == '\t') end++;
+    if (end == s || *end || errno) {
+        msh_error(cp->sh, "%s: %s: integer expression expected", cp->name, s);
+        return -1;
+    }
+    return 0;
+}
+
+static int is_unary(const char *op) {
+    return op[0] == '-' && op[1] && !op[2] && strchr("bcdefghnprsuwxzLSv", op[1]);
+}
+
+static int cond_unary(cond_t *cp, char op, const char *arg) {
+    struct stat st;
+    switch (op) {
+    case 'n': return !*arg;
+    case 'z': return !!*arg;
+    case 'v': return !msh_getvar(cp->sh, arg);
+    case 'r': return msh_access(cp->sh, arg, R_OK) != 0;
+    case 'w': return msh_access(cp->sh, arg, W_OK) != 0;
+    case 'x': return msh_access(cp->sh, arg, X_OK) != 0;
+    case 'h': case 'L': return msh_stat(cp->sh, arg, &st, 0) != 0 || !S_ISLNK(st.st_mode);
+    }
+    if (msh_stat(cp->sh, arg, &st, 1) != 0) return 1;
+    switch (op) {
+    case 'e': return 0;
+    case 'f': return !S_ISREG(st.st_mode);
+    case 'd': return !S_ISDIR(st.st_mode);
+    case 'b': return !S_ISBLK(st.st_mode);
+    case 'c': return !S_ISCHR(st.st_mode);
+    case 'p': return !S_ISFIFO(st.st_mode);
+    case 'S': return !S_ISSOCK(st.st_mode);
+    case 's': return st.st_size <= 0;
+    case 'g': return !(st.st_mode & S_ISGID);
+    case 'u': return !(st.st_mode & S_ISUID);
+    }
+    return 2;
+}
+
+static const char *const binary_ops[] = {
+    "==", "=", "!=", "=~", "<", ">",
+    "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef", NULL
+};
+
+static int is_binary(cond_t *cp, const char *op) {
+    if (cp->test && strcmp(op, "=~") == 0) return 0;
+    for (int i = 0; binary_ops[i]; ++i)
+        if (strcmp(op, binary_ops[i]) == 0) return 1;
+    return 0;
+}
+
+static int cond_binary(cond_t *cp, const char *l, const char *op, const char *r) {
+    if (cp->test && (strcmp(op, "==") == 0 || strcmp(op, "=") == 0)) return strcmp(l, r) != 0;
+    if (cp->test && strcmp(op, "!=") == 0) return strcmp(l, r) == 0;
+    if (strcmp(op, "==") == 0 || strcmp(op, "=") == 0) return fnmatch(r, l, 0) != 0;
+    if (strcmp(op, "!=") == 0) return fnmatch(r, l, 0) == 0;
+    if (strcmp(op, "<") == 0) return strcmp(l, r) >= 0;
+    if (strcmp(op, ">") == 0) return strcmp(l, r) <= 0;
+    if (strcmp(op, "=~") == 0) {
+        const regex_t *re = re_lookup(cp->sh, r);
+        if (!re) return 2;
+        return regexec(re, l, 0, NULL, 0) != 0;
+    }
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0) {
+        struct stat ls, rs;
+        int lok = msh_stat(cp->sh, l, &ls, 1) == 0, rok = msh_stat(cp->sh, r, &rs, 1) == 0;
+        if (op[1] == 'e')
+            return !(lok && rok && ls.st_dev == rs.st_dev && ls.st_ino == rs.st_ino);
+        /* a file that exists is newer than one that does not */
+        int cmp = lok - rok;
+        if (lok && rok) {
+            cmp = (ls.st_mtim.tv_sec > rs.st_mtim.tv_sec) - (ls.st_mtim.tv_sec < rs.st_mtim.tv_sec);
+            if (!cmp) cmp = (ls.st_mtim.tv_nsec > rs.st_mtim.tv_nsec) - (ls.st_mtim.tv_nsec < rs.st_mtim.tv_nsec);
+        }
+        return op[1] == 'n' ? !(cmp > 0) : !(cmp < 0);
+    }
+    long long a, b;
+    if (cond_int(cp, l, &a) < 0 || cond_int(cp, r, &b) < 0) return 2;
+    if (strcmp(op, "-eq") == 0) return !(a == b);
+    if (strcmp(op, "-ne") == 0) return !(a != b);
+    if (strcmp(op, "-lt") == 0) return !(a < b);
+    if (strcmp(op, "-le") == 0) return !(a <= b);
+    if (strcmp(op, "-gt") == 0) return !(a > b);
+    return !(a >= b);
+}
+
+static int cond_primary(cond_t *cp) {
+    const char *a = cond_peek(cp, 0), *b = cond_peek(cp, 1), *c = cond_peek(cp, 2);
+    if (!a) { msh_error(cp->sh, "%s: expression expected", cp->name); return 2; }
+    if (strcmp(a, "!") == 0 && b) {
+        cp->i++;
+        int r = cond_primary(cp);
+        return r == 2 ? 2 : !r;
+    }
+    if (strcmp(a, "(") == 0) {
+        cp->i++;
+        int r = cond_or(cp);
+        if (r == 2) return 2;
+        if (!cond_peek(cp, 0) || strcmp(cond_peek(cp, 0), ")") != 0) {
+            msh_error(cp->sh, "%s: missing )", cp->name);
+            return 2;
+        }
+        cp->i++;
+        return r;
+    }
+    if (b && c && is_binary(cp, b)) {
+        cp->i += 3;
+        return cp->skip ? 0 : cond_binary(cp, a, b, c);
+    }
+    if (is_unary(a) && b) {
+        cp->i += 2;
+        return cp->skip ? 0 : cond_unary(cp, a[1], b);
+    }
+    cp->i++;
+    return !*a;
+}
+
+/* The right operand is only parsed when the left one decides the result */
+static int cond_rhs(cond_t *cp, int decided, int (*operand)(cond_t *)) {
+    cp->skip += decided;
+    int r = operand(cp);
+    cp->skip -= decided;
+    return r;
+}
+
+static int cond_and(cond_t *cp) {
+    int r = cond_primary(cp);
+    while (r != 2 && cond_peek(cp, 0) && strcmp(cond_peek(cp, 0), cp->test ? "-a" : "&&") == 0) {
+        cp->i++;
+        int r2 = cond_rhs(cp, r != 0, cond_primary);
+        r = r2 == 2 ? 2 : (r || r2);
+    }
+    return r;
+}
+
+static int cond_or(cond_t *cp) {
+    int r = cond_and(cp);
+    while (r != 2 && cond_peek(cp, 0) && strcmp(cond_peek(cp, 0), cp->test ? "-o" : "||") == 0) {
+        cp->i++;
+        int r2 = cond_rhs(cp, r == 0, cond_and);
+        r = r2 == 2 ? 2 : (r && r2);
+    }
+    return r;
+}
+
+/* argv is [[ expr... ]], [ expr... ] or test expr... */
+int cond_eval(msh_t *sh, char **argv) {
+    int n = 0;
+    while (argv[n]) n++;
+    const char *close = strcmp(argv[0], "[[") == 0 ? "]]" : strcmp(argv[0], "[") == 0 ? "]" : NULL;
+    if (close && (n < 2 || strcmp(argv[n-1], close) != 0)) {
+        msh_error(sh, "%s: missing %s", argv[0], close);
+        return 2;
+    }
+    cond_t c = { sh, argv[0], strcmp(argv[0], "[[") != 0, argv + 1, 0, n - 1 - !!close, 0 };
+    if (c.n == 0) return 1;
+    int r = cond_or(&c);
+    if (r != 2 && c.i < c.n) {
+        msh_error(sh, "%s: %s: unexpected argument", argv[0], c.w[c.i]);
+        return 2;
+    }
+    return r;
+}
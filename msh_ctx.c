@@ -0,0 +1,527 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <sys/wait.h>
+
+#include "msh_internal.h"
+
+extern char **environ;
+
+/* Growable buffer append */
+void sb_putn(strbuf_t *b, const char *s, size_t n) {
+    if (b->len + n + 1 > b->cap) {
+        size_t ncap = b->cap ? b->cap * 2 : 64;
+        while (ncap < b->len + n + 1) ncap *= 2;
+        char *ns = realloc(b->s, ncap);
+        if (!ns) return;
+        b->s = ns;
+        b->cap = ncap;
+    }
+    memcpy(b->s + b->len, s, n);
+    b->len += n;
+    b->s[b->len] = 0;
+}
+
+size_t str_hash(const char *s) {
+    size_t h = 1469598103934665603ULL;
+    while (*s) { h ^= (unsigned char)*s++; h *= 1099511628211ULL; }
+    return h;
+}
+
+/* Diagnostics go to the context's error fd, one line each */
+void msh_error(msh_t *sh, const char *fmt, ...) {
+    char tmp[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp) - 1, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if (n > (int)sizeof(tmp) - 2) n = sizeof(tmp) - 2;
+    tmp[n++] = '\n';
+    if (write(sh->err_fd, tmp, n) < 0) { /* nowhere left to report it */ }
+}
+
+void msh_perror(msh_t *sh, const char *what) {
+    msh_error(sh, "%s: %s", what, strerror(errno));
+}
+
+/* path as seen from the context's directory; buf holds the result if a
+   join was needed. NULL if it does not fit. */
+const char *msh_path(msh_t *sh, const char *path, char *buf, size_t size) {
+    if (!sh->cwd || path[0] == '/') return path;
+    if (snprintf(buf, size, "%s/%s", sh->cwd, path) >= (int)size) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    return buf;
+}
+
+/* open() relative to the context's working directory */
+int msh_open(msh_t *sh, const char *path, int flags, mode_t mode) {
+    char buf[4096];
+    if (!(path = msh_path(sh, path, buf, sizeof(buf)))) return -1;
+    return open(path, flags, mode);
+}
+
+/* Variables */
+
+static char **env_find(msh_t *sh, const char *name, size_t nlen) {
+    for (size_t i = 0; i < sh->nenv; ++i)
+        if (strncmp(sh->env[i], name, nlen) == 0 && sh->env[i][nlen] == '=') return &sh->env[i];
+    return NULL;
+}
+
+const char *msh_getvar(msh_t *sh, const char *name) {
+    size_t nlen = strlen(name);
+    char **e = env_find(sh, name, nlen);
+    return e ? *e + nlen + 1 : NULL;
+}
+
+int msh_setvar(msh_t *sh, const char *name, const char *value) {
+    size_t nlen = strlen(name), vlen = strlen(value);
+    char *kv = malloc(nlen + vlen + 2);
+    if (!kv) return -1;
+    memcpy(kv, name, nlen);
+    kv[nlen] = '=';
+    memcpy(kv + nlen + 1, value, vlen + 1);
+    char **e = env_find(sh, name, nlen);
+    if (e) {
+        free(*e);
+        *e = kv;
+        return 0;
+    }
+    if (sh->nenv + 2 > sh->envcap) {
+        size_t ncap = sh->envcap ? sh->envcap * 2 : 64;
+        char **ne = realloc(sh->env, ncap * sizeof(*ne));
+        if (!ne) { free(kv); return -1; }
+        sh->env = ne;
+        sh->envcap = ncap;
+    }
+    sh->env[sh->nenv++] = kv;
+    sh->env[sh->nenv] = NULL;
+    return 0;
+}
+
+int msh_unsetvar(msh_t *sh, const char *name) {
+    char **e = env_find(sh, name, strlen(name));
+    if (!e) return -1;
+    free(*e);
+    *e = sh->env[--sh->nenv];
+    sh->env[sh->nenv] = NULL;
+    return 0;
+}
+
+static void env_clear(msh_t *sh) {
+    for (size_t i = 0; i < sh->nenv; ++i) free(sh->env[i]);
+    free(sh->env);
+    sh->env = NULL;
+    sh->nenv = sh->envcap = 0;
+}
+
+size_t env_mem(msh_t *sh) {
+    size_t n = sh->envcap * sizeof(*sh->env);
+    for (size_t i = 0; i < sh->nenv; ++i) n += strlen(sh->env[i]) + 1;
+    return n;
+}
+
+static void env_load(msh_t *sh, char *const *envp) {
+    for (size_t i = 0; envp && envp[i]; ++i) {
+        const char *eq = strchr(envp[i], '=');
+        if (!eq) continue;
+        char *name = strndup(envp[i], eq - envp[i]);
+        if (name) msh_setvar(sh, name, eq + 1);
+        free(name);
+    }
+    if (!sh->env) msh_setvar(sh, "PATH", "/bin:/usr/bin");
+}
+
+/* Context */
+
+msh_t *msh_new(void) {
+    msh_t *sh = calloc(1, sizeof(*sh));
+    if (!sh) return NULL;
+    sh->in_fd = STDIN_FILENO;
+    sh->out_fd = STDOUT_FILENO;
+    sh->err_fd = STDERR_FILENO;
+    for (int n = 0; n < SHELL_FDS; ++n) sh->fds[n] = -1;
+    sh->script_name = "myshell";
+    sh->xtrace_bad = -1;
+    sh->std_in.fd = -1;
+    sh->std_out.fd = -1;
+    sh->bi_in = &sh->std_in;
+    sh->bi_out = &sh->std_out;
+    env_load(sh, environ);
+    /* a directory of its own, so that cd in one context moves no other */
+    msh_pwd(sh);
+    sh->cwd = sh->pwd;
+    sh->pwd = NULL;
+    return sh;
+}
+
+void msh_use_process_cwd(msh_t *sh) {
+    if (!sh->cwd) return;
+    if (chdir(sh->cwd) == 0) {
+        free(sh->pwd);
+        sh->pwd = sh->cwd;
+        sh->cwd = NULL;
+    }
+}
+
+void msh_free(msh_t *sh) {
+    if (!sh) return;
+    zio_free(sh);
+    rec_stop(sh);
+    xtrace_flush(sh);
+    prof_dump(sh);
+    prof_free(sh);
+    dyn_free(sh);
+    cond_free(sh);
+    stat_cache_free(sh);
+    arrays_free(sh);
+    source_cache_free(sh);
+    path_hash_free(sh);
+    z_free(sh);
+    dirs_free(sh);
+    shell_fds_close(sh);
+    jobs_free(sh);
+    env_clear(sh);
+    free(sh->cwd);
+    free(sh);
+}
+
+int msh_set_option(msh_t *sh, const char *name, int on) {
+    for (int i = 0; i < OPT_COUNT; ++i) {
+        if (strcmp(shell_options[i].name, name) == 0) {
+            sh->opts[i] = on;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void msh_set_interactive(msh_t *sh, int interactive) {
+    sh->interactive = interactive;
+}
+
+int msh_exiting(const msh_t *sh) {
+    return sh->exiting;
+}
+
+int msh_status(const msh_t *sh) {
+    return sh->exiting ? sh->exit_status : sh->last_status;
+}
+
+void msh_flush(msh_t *sh) {
+    xtrace_flush(sh);
+}
+
+/* Leave the shell. A forked child exits for real; the shell itself stops
+   running lines and lets its owner decide what to do. */
+void shell_exit(msh_t *sh, int status) {
+    if (sh->in_child) {
+        fflush(stdout);
+        _exit(status);
+    }
+    sh->exiting = 1;
+    sh->exit_status = status;
+}
+
+/* Jobs */
+
+/* Command lines of jobs are interned: a loop starting the same job many
+   times keeps one copy. A string is freed when the last job slot naming
+   it is reused, never from msh_child_exited, which may run in a signal
+   handler. */
+typedef struct pool_str {
+    struct pool_str *next;
+    unsigned refs, hash;
+    char s[];
+} pool_str_t;
+
+struct str_pool {
+    pool_str_t **buckets;
+    size_t nbuckets, count, bytes;
+};
+
+static const char *pool_intern(msh_t *sh, const char *s) {
+    struct str_pool *p = sh->cmdlines;
+    if (!p && !(p = sh->cmdlines = calloc(1, sizeof(*p)))) return NULL;
+    if (p->count >= p->nbuckets) {
+        size_t nb = p->nbuckets ? p->nbuckets * 2 : 16;
+        pool_str_t **b = calloc(nb, sizeof(*b));
+        if (!b) return NULL;
+        for (size_t i = 0; i < p->nbuckets; ++i)
+            for (pool_str_t *e = p->buckets[i], *next; e; e = next) {
+                next = e->next;
+                e->next = b[e->hash & (nb - 1)];
+                b[e->hash & (nb - 1)] = e;
+            }
+        free(p->buckets);
+        p->buckets = b;
+        p->nbuckets = nb;
+    }
+    unsigned h = (unsigned)str_hash(s);
+    pool_str_t **slot = &p->buckets[h & (p->nbuckets - 1)];
+    for (pool_str_t *e = *slot; e; e = e->next)
+        if (e->hash == h && strcmp(e->s, s) == 0) { e->refs++; return e->s; }
+    size_t len = strlen(s);
+    pool_str_t *e = malloc(sizeof(*e) + len + 1);
+    if (!e) return NULL;
+    memcpy(e->s, s, len + 1);
+    e->refs = 1;
+    e->hash = h;
+    e->next = *slot;
+    *slot = e;
+    p->count++;
+    p->bytes += sizeof(*e) + len + 1;
+    return e->s;
+}
+
+static void pool_release(msh_t *sh, const char *s) {
+    struct str_pool *p = sh->cmdlines;
+    if (!s || !p) return;
+    pool_str_t *e = (pool_str_t *)(s - offsetof(pool_str_t, s));
+    if (--e->refs) return;
+    for (pool_str_t **q = &p->buckets[e->hash & (p->nbuckets - 1)]; *q; q = &(*q)->next) {
+        if (*q != e) continue;
+        *q = e->next;
+        p->count--;
+        p->bytes -= sizeof(*e) + strlen(e->s) + 1;
+        free(e);
+        return;
+    }
+}
+
+void jobs_free(msh_t *sh) {
+    for (int i = 0; i < sh->jobcap; ++i) {
+        free(sh->jobs[i].pids);
+        pool_release(sh, sh->jobs[i].cmdline);
+    }
+    free(sh->jobs);
+    if (sh->cmdlines) free(sh->cmdlines->buckets);
+    free(sh->cmdlines);
+}
+
+/* Bytes held for jobs, and for their command lines in *lines */
+size_t jobs_mem(msh_t *sh, size_t *lines) {
+    size_t n = sh->jobcap * sizeof(job_t);
+    for (int i = 0; i < sh->jobcap; ++i) n += sh->jobs[i].npids * sizeof(pid_t);
+    *lines = sh->cmdlines ? sh->cmdlines->bytes + sh->cmdlines->nbuckets * sizeof(pool_str_t *) : 0;
+    return n;
+}
+
+/* Called with SIGCHLD blocked, so the table may move under no handler */
+void add_job(msh_t *sh, pid_t pids[], int npids, const char *cmdline) {
+    int i = 0;
+    while (i < sh->jobcap && sh->jobs[i].running) i++;
+    if (i == sh->jobcap) {
+        int cap = sh->jobcap ? sh->jobcap * 2 : 8;
+        job_t *nj = realloc(sh->jobs, cap * sizeof(*nj));
+        if (!nj) { msh_error(sh, "cannot record job: out of memory"); return; }
+        memset(nj + sh->jobcap, 0, (cap - sh->jobcap) * sizeof(*nj));
+        sh->jobs = nj;
+        sh->jobcap = cap;
+    }
+    job_t *j = &sh->jobs[i];
+    pid_t *p = realloc(j->pids, npids * sizeof(pid_t));
+    const char *line = pool_intern(sh, cmdline);
+    if (!p || !line) {
+        if (p) j->pids = p;
+        pool_release(sh, line);
+        msh_error(sh, "cannot record job: out of memory");
+        return;
+    }
+    memcpy(p, pids, npids * sizeof(pid_t));
+    j->pids = p;
+    j->npids = j->nalive = npids;
+    j->pid = pids[npids-1];
+    j->status = 0;
+    pool_release(sh, j->cmdline);
+    j->cmdline = line;
+    j->running = 1;
+    sh->njobs++;
+    char tmp[64];
+    int n = snprintf(tmp, sizeof(tmp), "[%d] %d\n", i+1, (int)j->pid);
+    if (write(sh->out_fd, tmp, n) < 0) { /* ignore */ }
+}
+
+/* Called for every reaped child, possibly from a signal handler: formats
+   with snprintf and writes directly instead of using stdio. */
+void msh_child_exited(msh_t *sh, pid_t pid, int status) {
+    for (int i = 0; i < sh->jobcap; ++i) {
+        job_t *j = &sh->jobs[i];
+        if (!j->running) continue;
+        for (int k = 0; k < j->npids; ++k) {
+            if (j->pids[k] != pid) continue;
+            j->pids[k] = 0;
+            if (pid == j->pid) j->status = status;
+            if (--j->nalive > 0) return;
+            j->running = 0;
+            sh->njobs--;
+            char tmp[640];
+            int n = 0;
+            if (WIFEXITED(j->status))
+                n = snprintf(tmp, sizeof(tmp), "\nJob [%d] %d finished (exit %d): ",
+                             i+1, (int)j->pid, WEXITSTATUS(j->status));
+            else if (WIFSIGNALED(j->status))
+                n = snprintf(tmp, sizeof(tmp), "\nJob [%d] %d killed by signal %d: ",
+                             i+1, (int)j->pid, WTERMSIG(j->status));
+            if (n <= 0) return;
+            /* one write when the line fits, so the report is not split */
+            size_t len = j->cmdline ? strlen(j->cmdline) : 0;
+            if (n + len + 1 <= sizeof(tmp)) {
+                memcpy(tmp + n, j->cmdline, len);
+                tmp[n + len] = '\n';
+                if (write(sh->out_fd, tmp, n + len + 1) < 0) { /* ignore */ }
+            } else if (write(sh->out_fd, tmp, n) < 0 || write(sh->out_fd, j->cmdline, len) < 0 ||
+                       write(sh->out_fd, "\n", 1) < 0) {
+                /* ignore */
+            }
+            return;
+        }
+    }
+}
+
+void msh_reap_jobs(msh_t *sh) {
+    zio_reap(sh);
+    for (int i = 0; i < sh->jobcap; ++i) {
+        job_t *j = &sh->jobs[i];
+        for (int k = 0; j->running && k < j->npids; ++k) {
+            int status;
+            if (j->pids[k] && waitpid(j->pids[k], &status, WNOHANG) == j->pids[k])
+                msh_child_exited(sh, j->pids[k], status);
+        }
+    }
+}
+
+/* Running */
+
+/* Run one parsed line: expand, trace, execute, profile, and apply errexit */
+static int run_line(msh_t *sh, const msh_line_t *ln) {
+    if (ln->bad) {
+        sh->last_status = 2;
+        return 2;
+    }
+    sh->lineno = ln->lineno;
+    /* the stat cache lives for one line: whatever ran before, a write
+       through an exec'd fd included, may have changed any file */
+    stat_cache_clear(sh);
+    cmd_t *cmds = calloc(ln->ncmds, sizeof(cmd_t));
+    if (!cmds) { msh_perror(sh, "exec"); return sh->last_status = 1; }
+    if (expand_cmds(sh, ln, cmds) < 0) {
+        /* unbound variable under set -u */
+        free(cmds);
+        sh->last_status = 1;
+        if (!sh->interactive) shell_exit(sh, 1);
+        return 1;
+    }
+
+    prof_sample_t ps;
+    prof_begin(sh, &ps);
+    /* timed: xtracetime was on as the line started, so trace_start is set */
+    int traced = sh->opts[OPT_XTRACE], timed = 0;
+    struct timespec trace_start;
+    if (traced) timed = xtrace_pipeline(sh, cmds, ln->ncmds, ln->background, &trace_start);
+
+    int failed = 0;
+    int status = execute_pipeline(sh, cmds, ln->ncmds, ln->background, ln->text, &failed);
+
+    if (timed && sh->opts[OPT_XTRACE]) xtrace_done(sh, &trace_start);
+    prof_end(sh, &ps, ln->lineno, cmds, ln->ncmds);
+
+    if (status != 0 && sh->opts[OPT_ERREXIT] && !sh->exiting) {
+        msh_error(sh, "%s:%d:%d: %s: exited with status %d", sh->script_name, ln->lineno,
+                  cmds[failed].col, cmds[failed].argv[0] ? cmds[failed].argv[0] : "", status);
+        shell_exit(sh, status);
+    }
+    free_expanded(cmds, ln->ncmds);
+    free(cmds);
+    return status;
+}
+
+int run_script(msh_t *sh, const msh_script_t *script) {
+    const char *saved_name = sh->script_name;
+    sh->script_name = script->name;
+    for (int i = 0; i < script->nlines && !sh->exiting; ++i) {
+        msh_reap_jobs(sh);
+        run_line(sh, &script->lines[i]);
+    }
+    sh->script_name = saved_name;
+    return msh_status(sh);
+}
+
+/* Each run starts afresh: an exit in one script must not stop the next */
+static int exec_run(msh_t *sh, const msh_script_t *script) {
+    int exiting = sh->exiting, exit_status = sh->exit_status;
+    sh->exiting = sh->exit_status = 0;
+    int status = run_script(sh, script);
+    sh->exiting = exiting;
+    sh->exit_status = exit_status;
+    return status;
+}
+
+int msh_exec(msh_t *sh, const msh_script_t *script, const msh_exec_opts_t *opts) {
+    if (!opts) return exec_run(sh, script);
+
+    /* apply the overrides for this run only */
+    int in_fd = sh->in_fd, out_fd = sh->out_fd, err_fd = sh->err_fd;
+    char *cwd = sh->cwd;
+    msh_output_fn on_output = sh->on_output;
+    void *userdata = sh->userdata;
+    char **env = sh->env;
+    size_t nenv = sh->nenv, envcap = sh->envcap;
+
+    /* 0-2 as the run starts are not the run's to close, whether the
+       caller's or the context's: exec in the run replaces them without
+       closing, and what it opened instead goes with it */
+    unsigned owned = sh->fd_owned & 7u;
+    sh->fd_owned &= ~7u;
+    if (opts->in_fd >= 0) sh->in_fd = opts->in_fd;
+    if (opts->out_fd >= 0) sh->out_fd = opts->out_fd;
+    if (opts->err_fd >= 0) sh->err_fd = opts->err_fd;
+    if (opts->cwd) sh->cwd = strdup(opts->cwd);
+    if (opts->on_output) { sh->on_output = opts->on_output; sh->userdata = opts->userdata; }
+    if (opts->envp) {
+        sh->env = NULL;
+        sh->nenv = sh->envcap = 0;
+        env_load(sh, opts->envp);
+    }
+
+    int run_fds[3] = { sh->in_fd, sh->out_fd, sh->err_fd };
+    int status = exec_run(sh, script);
+
+    if (opts->envp) {
+        env_clear(sh);
+        sh->env = env;
+        sh->nenv = nenv;
+        sh->envcap = envcap;
+    }
+    if (opts->cwd) { free(sh->cwd); sh->cwd = cwd; }
+    for (int n = 0; n < 3; ++n)
+        if (shell_fd(sh, n) != run_fds[n]) shell_fd_set(sh, n, -1);
+    sh->in_fd = in_fd; sh->out_fd = out_fd; sh->err_fd = err_fd;
+    sh->fd_owned = (sh->fd_owned & ~7u) | owned;
+    sh->on_output = on_output;
+    sh->userdata = userdata;
+    return status;
+}
+
+int msh_run_line(msh_t *sh, const char *line) {
+    zio_reap(sh);
+    /* exiting stays set afterwards so that the caller can stop reading */
+    sh->exiting = sh->exit_status = 0;
+    rec_line(sh, line);
+    /* number interactive lines consecutively */
+    msh_script_t *sc = parse_text(sh, line, strlen(line), sh->script_name, sh->lineno + 1);
+    if (!sc) sh->last_status = 1;
+    else {
+        sh->lineno++;
+        for (int i = 0; i < sc->nlines && !sh->exiting; ++i) run_line(sh, &sc->lines[i]);
+        msh_script_free(sc);
+    }
+    rec_status(sh, msh_status(sh));
+    return msh_status(sh);
+}
@@ -0,0 +1,353 @@
+#define _XOPEN_SOURCE 700
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "msh_internal.h"
+
+/* The working directory as cd, pushd and popd keep it: logically, with
+   symlinks as the user went through them, like bash's cd -L. PWD and
+   OLDPWD are set on every change, so pwd and the prompt read the
+   directory without getcwd. A context keeps a directory of its own
+   (sh->cwd, which then is the logical directory) that paths are resolved
+   against; only the standalone shell, after msh_use_process_cwd(), moves
+   the process. The directory stack holds the other directories of dirs,
+   top last. */
+
+/* Write path, absolute, into out with . and .. taken away and slashes
+   single; -1 if it does not fit */
+static int canon(const char *path, char *out, size_t size) {
+    size_t len = 0;
+    const char *p = path;
+    while (*p) {
+        while (*p == '/') p++;
+        const char *e = p;
+        while (*e && *e != '/') e++;
+        size_t n = e - p;
+        if (n == 0 || (n == 1 && p[0] == '.')) {
+            /* nothing */
+        } else if (n == 2 && p[0] == '.' && p[1] == '.') {
+            while (len > 0 && out[len - 1] != '/') len--;
+            if (len > 0) len--;
+        } else {
+            if (len + 1 + n + 1 > size) return -1;
+            out[len++] = '/';
+            memcpy(out + len, p, n);
+            len += n;
+        }
+        p = e;
+    }
+    if (len == 0) {
+        if (size < 2) return -1;
+        out[len++] = '/';
+    }
+    out[len] = 0;
+    return 0;
+}
+
+static int same_file(const char *a, const char *b) {
+    struct stat sa, sb;
+    return stat(a, &sa) == 0 && stat(b, &sb) == 0 && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+const char *msh_pwd(msh_t *sh) {
+    if (sh->cwd) return sh->cwd;
+    if (sh->pwd) return sh->pwd;
+    /* first use: trust an inherited PWD that is this directory */
+    const char *env = msh_getvar(sh, "PWD");
+    char buf[PATH_MAX];
+    if (env && env[0] == '/' && canon(env, buf, sizeof(buf)) == 0 && strcmp(buf, env) == 0 &&
+        same_file(env, ".")) {
+        sh->pwd = strdup(env);
+    } else if (getcwd(buf, sizeof(buf))) {
+        sh->pwd = strdup(buf);
+    }
+    return sh->pwd ? sh->pwd : ".";
+}
+
+/* Make dir the working directory, logically unless physical. PWD and
+   OLDPWD follow; interactive shells remember the directory for z. */
+int change_dir(msh_t *sh, const char *dir, int physical) {
+    char joined[PATH_MAX], path[PATH_MAX], what[PATH_MAX + 8], *resolved = NULL;
+    const char *old = msh_pwd(sh);
+    snprintf(what, sizeof(what), "cd: %s", dir);
+    stat_cache_clear(sh);
+    if (dir[0] == '/') snprintf(joined, sizeof(joined), "%s", dir);
+    else if (snprintf(joined, sizeof(joined), "%s/%s", old, dir) >= (int)sizeof(joined)) {
+        msh_error(sh, "cd: %s: File name too long", dir);
+        return 1;
+    }
+    if (physical || canon(joined, path, sizeof(path)) < 0) {
+        if (!(resolved = realpath(joined, NULL))) { msh_perror(sh, what); return 1; }
+        snprintf(path, sizeof(path), "%s", resolved);
+        free(resolved);
+    }
+    struct stat st;
+    if (stat(path, &st) < 0 || !S_ISDIR(st.st_mode)) {
+        /* a/link/.. need not exist logically: go the physical way */
+        if (!physical && (resolved = realpath(joined, NULL))) {
+            snprintf(path, sizeof(path), "%s", resolved);
+            free(resolved);
+        }
+        int err = stat(path, &st) < 0 ? errno : S_ISDIR(st.st_mode) ? 0 : ENOTDIR;
+        if (err) {
+            errno = err;
+            msh_perror(sh, what);
+            return 1;
+        }
+    }
+    if (!sh->cwd && chdir(path) < 0) { msh_perror(sh, what); return 1; }
+    char *now = strdup(path);
+    if (!now) { msh_perror(sh, what); return 1; }
+    msh_setvar(sh, "OLDPWD", old);
+    if (sh->cwd) {
+        free(sh->cwd);
+        sh->cwd = now;
+    } else {
+        free(sh->pwd);
+        sh->pwd = now;
+    }
+    msh_setvar(sh, "PWD", now);
+    if (sh->interactive) z_visit(sh, now);
+    return 0;
+}
+
+/* dir names a directory under a CDPATH entry: write it into buf */
+static int cdpath_find(msh_t *sh, const char *dir, char *buf, size_t size) {
+    const char *cdpath = msh_getvar(sh, "CDPATH");
+    struct stat st;
+    if (!cdpath || dir[0] == '/' || strcmp(dir, ".") == 0 || strcmp(dir, "..") == 0 ||
+        strncmp(dir, "./", 2) == 0 || strncmp(dir, "../", 3) == 0) return -1;
+    for (const char *p = cdpath; ; ) {
+        const char *end = strchr(p, ':');
+        size_t n = end ? (size_t)(end - p) : strlen(p);
+        /* an empty entry is the working directory, and cd stays quiet */
+        if (n) {
+            snprintf(buf, size, "%.*s/%s", (int)n, p, dir);
+            if (msh_stat(sh, buf, &st, 1) == 0 && S_ISDIR(st.st_mode)) return 0;
+        }
+        if (!end) return -1;
+        p = end + 1;
+    }
+}
+
+/* cd [-L|-P] [dir|-] */
+int cd_command(msh_t *sh, char **argv) {
+    int physical = 0, i = 1, print = 0;
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "-L") == 0) physical = 0;
+        else if (strcmp(argv[i], "-P") == 0) physical = 1;
+        else if (strcmp(argv[i], "--") == 0) { i++; break; }
+        else {
+            msh_error(sh, "cd: usage: cd [-L|-P] [dir]");
+            return 2;
+        }
+    }
+    const char *dir = argv[i];
+    char buf[PATH_MAX];
+    if (!dir) {
+        if (!(dir = msh_getvar(sh, "HOME"))) { msh_error(sh, "cd: HOME not set"); return 1; }
+    } else if (strcmp(dir, "-") == 0) {
+        if (!(dir = msh_getvar(sh, "OLDPWD"))) { msh_error(sh, "cd: OLDPWD not set"); return 1; }
+        print = 1;
+    } else if (cdpath_find(sh, dir, buf, sizeof(buf)) == 0) {
+        dir = buf;
+        print = 1;
+    }
+    /* OLDPWD changes under dir */
+    char *target = strdup(dir);
+    if (!target) { msh_perror(sh, "cd"); return 1; }
+    int status = change_dir(sh, target, physical);
+    free(target);
+    if (!status && print) bi_printf(sh, "%s\n", msh_pwd(sh));
+    return status;
+}
+
+/* pwd [-L|-P] */
+int pwd_command(msh_t *sh, char **argv) {
+    int physical = 0;
+    for (int i = 1; argv[i]; ++i) {
+        if (strcmp(argv[i], "-L") == 0) physical = 0;
+        else if (strcmp(argv[i], "-P") == 0) physical = 1;
+        else {
+            msh_error(sh, "pwd: usage: pwd [-L|-P]");
+            return 2;
+        }
+    }
+    const char *pwd = msh_pwd(sh);
+    if (!physical) return bi_printf(sh, "%s\n", pwd) < 0;
+    char *real = realpath(pwd, NULL);
+    if (!real) { msh_perror(sh, "pwd"); return 1; }
+    int status = bi_printf(sh, "%s\n", real) < 0;
+    free(real);
+    return status;
+}
+
+/* The directory stack */
+
+void dirs_free(msh_t *sh) {
+    for (size_t i = 0; i < sh->ndirs; ++i) free(sh->dirs[i]);
+    free(sh->dirs);
+    free(sh->pwd);
+    sh->dirs = NULL;
+    sh->pwd = NULL;
+    sh->ndirs = sh->dircap = 0;
+}
+
+size_t dirs_mem(msh_t *sh) {
+    size_t n = sh->dircap * sizeof(*sh->dirs) + (sh->pwd ? strlen(sh->pwd) + 1 : 0);
+    for (size_t i = 0; i < sh->ndirs; ++i) n += strlen(sh->dirs[i]) + 1;
+    return n;
+}
+
+static int dirs_push(msh_t *sh, const char *dir) {
+    if (sh->ndirs == sh->dircap) {
+        size_t cap = sh->dircap ? sh->dircap * 2 : 8;
+        char **nd = realloc(sh->dirs, cap * sizeof(*nd));
+        if (!nd) return -1;
+        sh->dirs = nd;
+        sh->dircap = cap;
+    }
+    if (!(sh->dirs[sh->ndirs] = strdup(dir))) return -1;
+    sh->ndirs++;
+    return 0;
+}
+
+/* Entry k of dirs (0 is the working directory) */
+static const char *dirs_at(msh_t *sh, size_t k) {
+    return k == 0 ? msh_pwd(sh) : sh->dirs[sh->ndirs - k];
+}
+
+/* +N counts from the left of dirs, -N from the right; -1 if out of range */
+static long dirs_index(msh_t *sh, const char *arg) {
+    char *end;
+    long n = strtol(arg + 1, &end, 10);
+    long count = sh->ndirs + 1;
+    if (end == arg + 1 || *end || n < 0 || n >= count) return -1;
+    return arg[0] == '+' ? n : count - 1 - n;
+}
+
+static void dirs_print(msh_t *sh, int tilde, int lines, int numbered) {
+    const char *home = msh_getvar(sh, "HOME");
+    size_t hl = home && tilde ? strlen(home) : 0;
+    for (size_t k = 0; k <= sh->ndirs; ++k) {
+        const char *d = dirs_at(sh, k);
+        const char *sep = k == sh->ndirs ? "\n" : lines || numbered ? "\n" : " ";
+        if (numbered) bi_printf(sh, "%2zu  ", k);
+        if (hl > 1 && strncmp(d, home, hl) == 0 && (d[hl] == '/' || !d[hl])) bi_printf(sh, "~%s%s", d + hl, sep);
+        else bi_printf(sh, "%s%s", d, sep);
+    }
+}
+
+/* dirs [-clpv] [+N|-N] */
+int dirs_command(msh_t *sh, char **argv) {
+    int tilde = 1, lines = 0, numbered = 0, clear = 0;
+    for (int i = 1; argv[i]; ++i) {
+        const char *a = argv[i];
+        if ((a[0] == '+' || a[0] == '-') && a[1] >= '0' && a[1] <= '9') {
+            long k = dirs_index(sh, a);
+            if (k < 0) { msh_error(sh, "dirs: %s: directory stack index out of range", a); return 1; }
+            bi_printf(sh, "%s\n", dirs_at(sh, k));
+            return 0;
+        }
+        if (a[0] != '-' || !a[1]) { msh_error(sh, "dirs: usage: dirs [-clpv] [+N|-N]"); return 2; }
+        for (const char *f = a + 1; *f; ++f) {
+            if (*f == 'c') clear = 1;
+            else if (*f == 'l') tilde = 0;
+            else if (*f == 'p') lines = 1;
+            else if (*f == 'v') numbered = 1;
+            else { msh_error(sh, "dirs: usage: dirs [-clpv] [+N|-N]"); return 2; }
+        }
+    }
+    if (!clear) {
+        dirs_print(sh, tilde, lines, numbered);
+        return 0;
+    }
+    for (size_t k = 0; k < sh->ndirs; ++k) free(sh->dirs[k]);
+    sh->ndirs = 0;
+    return 0;
+}
+
+/* Make entry k of dirs the working directory by rotating the stack */
+static int dirs_rotate(msh_t *sh, size_t k) {
+    if (k == 0) return 0;
+    size_t count = sh->ndirs + 1;
+    /* as a list with the working directory first: list[j] = dirs_at(j) */
+    char **list = malloc(count * sizeof(*list));
+    if (!list) { msh_perror(sh, "pushd"); return 1; }
+    for (size_t j = 0; j < count; ++j) list[j] = (char *)dirs_at(sh, j);
+    char *pwd = strdup(list[0]);
+    if (!pwd) { free(list); msh_perror(sh, "pushd"); return 1; }
+    list[0] = pwd;
+    int status = change_dir(sh, list[k], 0);
+    if (status == 0) {
+        /* the new order is list[k], list[k+1], ..., list[k-1] */
+        char **nd = malloc(sh->dircap * sizeof(*nd));
+        if (nd) {
+            for (size_t j = 1; j < count; ++j) {
+                char *d = list[(k + j) % count];
+                nd[sh->ndirs - j] = d == pwd ? strdup(pwd) : d;
+            }
+            free(list[k]);
+            free(sh->dirs);
+            sh->dirs = nd;
+        }
+    }
+    free(pwd);
+    free(list);
+    return status;
+}
+
+/* pushd [dir|+N|-N]: with no argument, swap the top two */
+int pushd_command(msh_t *sh, char **argv) {
+    const char *a = argv[1];
+    if (a && strcmp(a, "--") == 0) a = argv[2];
+    if (!a || ((a[0] == '+' || a[0] == '-') && a[1] >= '0' && a[1] <= '9')) {
+        if (!sh->ndirs) { msh_error(sh, "pushd: no other directory"); return 1; }
+        long k = a ? dirs_index(sh, a) : 1;
+        if (k < 0) { msh_error(sh, "pushd: %s: directory stack index out of range", a); return 1; }
+        if (!a) {
+            /* swap: the old working directory replaces the top */
+            char *top = sh->dirs[sh->ndirs - 1];
+            char *pwd = strdup(msh_pwd(sh));
+            if (!pwd) { msh_perror(sh, "pushd"); return 1; }
+            if (change_dir(sh, top, 0) != 0) { free(pwd); return 1; }
+            free(top);
+            sh->dirs[sh->ndirs - 1] = pwd;
+        } else if (dirs_rotate(sh, k) != 0) {
+            return 1;
+        }
+    } else {
+        if (dirs_push(sh, msh_pwd(sh)) < 0) { msh_perror(sh, "pushd"); return 1; }
+        char *argv2[] = { "cd", (char *)a, NULL };
+        if (strcmp(a, "-") == 0 || cd_command(sh, argv2) != 0) {
+            if (strcmp(a, "-") == 0) msh_error(sh, "pushd: -: invalid argument");
+            free(sh->dirs[--sh->ndirs]);
+            return 1;
+        }
+    }
+    dirs_print(sh, 1, 0, 0);
+    return 0;
+}
+
+/* popd [+N|-N]: drop the top, or entry N, going to the new top */
+int popd_command(msh_t *sh, char **argv) {
+    const char *a = argv[1];
+    if (!sh->ndirs) { msh_error(sh, "popd: directory stack empty"); return 1; }
+    long k = a ? dirs_index(sh, a) : 0;
+    if (k < 0 || (a && a[0] != '+' && a[0] != '-')) {
+        msh_error(sh, "popd: %s: directory stack index out of range", a);
+        return 1;
+    }
+    if (k == 0) {
+        if (change_dir(sh, sh->dirs[sh->ndirs - 1], 0) != 0) return 1;
+        free(sh->dirs[--sh->ndirs]);
+    } else {
+        size_t at = sh->ndirs - k;
+        free(sh->dirs[at]);
+        memmove(sh->dirs + at, sh->dirs + at + 1, (sh->ndirs - at - 1) * sizeof(*sh->dirs));
+        sh->ndirs--;
+    }
+    dirs_print(sh, 1, 0, 0);
+    return 0;
+}
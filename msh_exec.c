@@ -0,0 +1,566 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "msh_internal.h"
+
+/* A builtin stage running as a coroutine. Stages switch only when they
+   would block on an in-memory pipe, so no locking is needed. */
+struct costage {
+    ucontext_t ctx;
+    ucontext_t *sched;   /* the segment's scheduler, resumed on yield and return */
+    msh_t *sh;
+    cmd_t *cmd;
+    bstream_t *in, *out;
+    int done, status;
+    char *stack;         /* mapping whose lowest page is a guard */
+};
+
+/* Stage stacks are mapped, so only the pages a stage touches cost memory,
+   and end in a PROT_NONE page, so an overflow faults instead of running
+   into the heap. Recursion (source) stops while COSTACK_RESERVE is left. */
+#define COSTACK_SIZE (4 * 1024 * 1024)
+#define COSTACK_RESERVE (128 * 1024)
+
+static char *costack_new(void) {
+    long page = sysconf(_SC_PAGESIZE);
+    char *p = mmap(NULL, COSTACK_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    if (mprotect(p, page, PROT_NONE) < 0) { munmap(p, COSTACK_SIZE); return NULL; }
+    return p;
+}
+
+/* True when running on a stage stack too close to its end for another
+   level of nesting */
+int co_stack_low(msh_t *sh) {
+    char here;
+    return sh->co_cur && &here - sh->co_cur->stack < COSTACK_RESERVE;
+}
+
+/* Switch back to the scheduler; the stage's streams are restored on resume */
+static void co_yield(msh_t *sh) {
+    if (!sh->co_cur) return;
+    bstream_t *in = sh->bi_in, *out = sh->bi_out;
+    swapcontext(&sh->co_cur->ctx, sh->co_cur->sched);
+    sh->bi_in = in;
+    sh->bi_out = out;
+}
+
+int bi_flush(msh_t *sh, bstream_t *st) {
+    if (st->cb) {
+        if (st->olen) sh->on_output(sh->userdata, st->obuf, st->olen);
+        st->olen = 0;
+        return 0;
+    }
+    size_t off = 0;
+    while (off < st->olen) {
+        ssize_t n = write(st->fd, st->obuf + off, st->olen - off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            st->olen = 0;
+            return -1;
+        }
+        off += n;
+    }
+    st->olen = 0;
+    return 0;
+}
+
+/* Write n bytes to the current builtin output; returns -1 once the reader is gone */
+int bi_write(msh_t *sh, const char *s, size_t n) {
+    bstream_t *st = sh->bi_out;
+    if (!st->mp) {
+        if (st->olen + n > sizeof(st->obuf) && bi_flush(sh, st) < 0) return -1;
+        if (n > sizeof(st->obuf)) {
+            if (st->cb) {
+                sh->on_output(sh->userdata, s, n);
+                return 0;
+            }
+            while (n > 0) {
+                ssize_t w = write(st->fd, s, n);
+                if (w < 0) { if (errno == EINTR) continue; return -1; }
+                s += w; n -= w;
+            }
+            return 0;
+        }
+        memcpy(st->obuf + st->olen, s, n);
+        st->olen += n;
+        return 0;
+    }
+    mempipe_t *mp = st->mp;
+    while (n > 0) {
+        if (mp->broken) return -1;
+        if (mp->len == MEMPIPE_SIZE) { co_yield(sh); continue; }
+        size_t tail = (mp->head + mp->len) % MEMPIPE_SIZE;
+        size_t chunk = tail >= mp->head ? MEMPIPE_SIZE - tail : mp->head - tail;
+        if (chunk > n) chunk = n;
+        memcpy(mp->buf + tail, s, chunk);
+        mp->len += chunk;
+        s += chunk; n -= chunk;
+    }
+    return 0;
+}
+
+int bi_printf(msh_t *sh, const char *fmt, ...) {
+    char tmp[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    if (n < 0) return -1;
+    if ((size_t)n < sizeof(tmp)) return bi_write(sh, tmp, n);
+    char *big = malloc(n + 1);
+    if (!big) return -1;
+    va_start(ap, fmt);
+    vsnprintf(big, n + 1, fmt, ap);
+    va_end(ap);
+    int r = bi_write(sh, big, n);
+    free(big);
+    return r;
+}
+
+/* Read up to n bytes from the current builtin input; 0 at EOF */
+ssize_t bi_read(msh_t *sh, char *buf, size_t n) {
+    bstream_t *st = sh->bi_in;
+    if (!st->mp) {
+        ssize_t r;
+        while ((r = read(st->fd, buf, n)) < 0 && errno == EINTR) ;
+        return r;
+    }
+    mempipe_t *mp = st->mp;
+    while (mp->len == 0) {
+        if (mp->closed) return 0;
+        co_yield(sh);
+    }
+    size_t chunk = MEMPIPE_SIZE - mp->head;
+    if (chunk > mp->len) chunk = mp->len;
+    if (chunk > n) chunk = n;
+    memcpy(buf, mp->buf + mp->head, chunk);
+    mp->head = (mp->head + chunk) % MEMPIPE_SIZE;
+    mp->len -= chunk;
+    return chunk;
+}
+
+/* The builtin streams as seen by loaded builtins */
+ssize_t msh_read(msh_t *sh, void *buf, size_t len) {
+    return bi_read(sh, buf, len);
+}
+
+int msh_write(msh_t *sh, const void *buf, size_t len) {
+    return bi_write(sh, buf, len);
+}
+
+/* Point the context's standard streams at its current fds or callback */
+static void std_streams(msh_t *sh) {
+    sh->std_in.fd = sh->in_fd;
+    sh->std_out.fd = sh->out_fd;
+    sh->std_out.cb = sh->on_output != NULL;
+}
+
+/* The fd a builtin stage sees as n, given its streams; -1 if it has none
+   (an in-memory pipe or the output callback) */
+static int stage_fd(msh_t *sh, int n, const bstream_t *in, const bstream_t *out) {
+    if (n == 0) return in->mp ? -1 : in->fd;
+    if (n == 1) return out->mp || out->cb ? -1 : out->fd;
+    return shell_fd(sh, n);
+}
+
+/* Run builtin c as a stage reading from in and writing to out, applying its
+   own redirections on top. Returns the builtin's exit status. */
+static int run_stage(msh_t *sh, cmd_t *c, bstream_t *in, bstream_t *out) {
+    bstream_t fin = { -1, NULL, 0, {0}, 0 }, fout = { -1, NULL, 0, {0}, 0 };
+    int opened[MAX_REDIRS + 2], nopened = 0, status = 1;
+    int err_fd = sh->err_fd;
+    int own = c->builtin->flags & BI_REDIRS;
+    if (c->infile && !own) {
+        fin.fd = msh_open(sh, c->infile, O_RDONLY, 0);
+        if (fin.fd < 0) { msh_perror(sh, "open infile"); return 1; }
+        opened[nopened++] = fin.fd;
+        in = &fin;
+    }
+    if (c->outfile && !own) {
+        int flags = O_CREAT | O_WRONLY | (c->append ? O_APPEND : O_TRUNC);
+        stat_cache_clear(sh);
+        fout.fd = msh_open(sh, c->outfile, flags, 0644);
+        if (fout.fd < 0) { msh_perror(sh, "open outfile"); goto done; }
+        opened[nopened++] = fout.fd;
+        out = &fout;
+    }
+    /* 0 and 1 become the stage's streams, 2 the shell's error fd while it
+       runs; the builtin never touches the others */
+    for (int k = 0; k < c->nredirs && !own; ++k) {
+        const redir_t *r = &c->redirs[k];
+        int fd, src;
+        if (r->op == REDIR_DUP) {
+            if (redir_dup_src(sh, r, &src) < 0) goto done;
+            fd = src < 0 ? -1 : stage_fd(sh, src, in, out);
+            if (src >= 0 && fd < 0) continue;
+        } else {
+            if ((fd = redir_open(sh, r)) < 0) goto done;
+            opened[nopened++] = fd;
+        }
+        if (r->fd == 0) { fin.fd = fd; fin.mp = NULL; in = &fin; }
+        else if (r->fd == 1) { fout.fd = fd; out = &fout; }
+        else if (r->fd == 2) sh->err_fd = fd;
+    }
+    bstream_t *saved_in = sh->bi_in, *saved_out = sh->bi_out;
+    sh->bi_in = in;
+    sh->bi_out = out;
+    /* keep the host's own stdio output ahead of the builtin's */
+    fflush(stdout);
+    dispatch_builtin(sh, c);
+    if (!out->mp) bi_flush(sh, out);
+    sh->bi_in = saved_in;
+    sh->bi_out = saved_out;
+    status = sh->last_status;
+done:
+    /* exec may have replaced the error fd for good */
+    if (!own) sh->err_fd = err_fd;
+    for (int k = 0; k < nopened; ++k) close(opened[k]);
+    return status;
+}
+
+static void co_entry(unsigned hi, unsigned lo) {
+    costage_t *st = (costage_t *)(((uintptr_t)hi << 16 << 16) | lo);
+    st->status = run_stage(st->sh, st->cmd, st->in, st->out);
+    if (st->out->mp) st->out->mp->closed = 1;
+    if (st->in->mp) st->in->mp->broken = 1;
+    st->done = 1;
+    /* returning resumes the scheduler through uc_link */
+}
+
+/* Run n consecutive builtin stages as coroutines connected by in-memory
+   pipes; the first reads from in and the last writes to out. Each stage's
+   status goes to statuses[]. Returns -1 if setup fails. A segment may
+   start inside a stage of another, e.g. through source, so each has its
+   own scheduler context and yields to the outer one after every round. */
+static int run_builtin_segment(msh_t *sh, cmd_t cmds[], int n, bstream_t *in, bstream_t *out, int statuses[]) {
+    if (n == 1) {
+        statuses[0] = run_stage(sh, &cmds[0], in, out);
+        return 0;
+    }
+    ucontext_t sched;
+    costage_t *st = calloc(n, sizeof(*st));
+    bstream_t *streams = calloc(2 * n, sizeof(*streams));
+    mempipe_t *pipes = calloc(n - 1, sizeof(*pipes));
+    int ok = st && streams && pipes;
+    for (int i = 0; ok && i < n; ++i) {
+        st[i].sh = sh;
+        st[i].cmd = &cmds[i];
+        st[i].in = i == 0 ? in : &streams[2*i];
+        st[i].out = i == n - 1 ? out : &streams[2*i + 1];
+        if (i > 0) st[i].in->mp = &pipes[i-1];
+        if (i < n - 1) st[i].out->mp = &pipes[i];
+        st[i].stack = costack_new();
+        if (!st[i].stack || getcontext(&st[i].ctx) < 0) { ok = 0; break; }
+        long page = sysconf(_SC_PAGESIZE);
+        st[i].ctx.uc_stack.ss_sp = st[i].stack + page;
+        st[i].ctx.uc_stack.ss_size = COSTACK_SIZE - page;
+        st[i].sched = &sched;
+        st[i].ctx.uc_link = &sched;
+        uintptr_t p = (uintptr_t)&st[i];
+        makecontext(&st[i].ctx, (void (*)(void))co_entry, 2, (unsigned)(p >> 16 >> 16), (unsigned)p);
+    }
+    bstream_t *saved_in = sh->bi_in, *saved_out = sh->bi_out;
+    costage_t *saved_cur = sh->co_cur;
+    if (ok) {
+        /* round-robin until every stage has finished */
+        for (int left = n; left > 0; ) {
+            for (int i = 0; i < n; ++i) {
+                if (st[i].done) continue;
+                sh->co_cur = &st[i];
+                swapcontext(&sched, &st[i].ctx);
+                sh->co_cur = saved_cur;
+                if (st[i].done) { statuses[i] = st[i].status; left--; }
+            }
+            /* let the enclosing segment feed or drain our ends */
+            if (left > 0) co_yield(sh);
+        }
+    }
+    sh->bi_in = saved_in;
+    sh->bi_out = saved_out;
+    for (int i = 0; st && i < n; ++i)
+        if (st[i].stack) munmap(st[i].stack, COSTACK_SIZE);
+    free(st); free(streams); free(pipes);
+    if (!ok) { msh_error(sh, "myshell: cannot set up builtin pipeline"); return -1; }
+    return 0;
+}
+
+/* A pipeline runs as units: one external command, or a run of consecutive
+   builtins that share a single process. Returns the end of the unit at i. */
+static int unit_end(cmd_t cmds[], int ncmds, int i) {
+    if (!cmds[i].builtin) return i + 1;
+    int j = i + 1;
+    while (j < ncmds && cmds[j].builtin) j++;
+    return j;
+}
+
+/* True if the whole pipeline can run inside the shell without forking */
+static int pipeline_inproc(cmd_t cmds[], int ncmds, int background) {
+    if (background || !cmds[0].builtin || unit_end(cmds, ncmds, 0) != ncmds) return 0;
+    if (ncmds == 1) return 1;
+    for (int i = 0; i < ncmds; ++i)
+        if (!(cmds[i].builtin->flags & BI_INPROC)) return 0;
+    return 1;
+}
+
+/* Number of processes execute_pipeline forks for this pipeline */
+int pipeline_forks(cmd_t cmds[], int ncmds, int background) {
+    if (pipeline_inproc(cmds, ncmds, background)) return 0;
+    int n = 0;
+    for (int i = 0; i < ncmds; i = unit_end(cmds, ncmds, i)) n++;
+    return n;
+}
+
+/* Convert a waitpid status into a shell exit status */
+static int exit_status(int status) {
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return 1;
+}
+
+/* Status of a run of stages: the last one's, or with pipefail the rightmost
+   failing one's, whose index goes to *failed */
+static int segment_status(msh_t *sh, int statuses[], int n, int *failed) {
+    int result = statuses[n-1];
+    for (int i = 0; sh->opts[OPT_PIPEFAIL] && i < n; ++i)
+        if (statuses[i] != 0) { result = statuses[i]; if (failed) *failed = i; }
+    return result;
+}
+
+/* Child side of execute_pipeline: wire up fds and run unit [i, end) */
+static void exec_child(msh_t *sh, cmd_t cmds[], int i, int end, int in_fd, int out_fd, int close_fd) {
+    sh->in_child = 1;
+    zio_child(sh, &cmds[i], end - i);
+    /* restore default SIGINT so Ctrl-C kills child */
+    signal(SIGINT, SIG_DFL);
+
+    if (sh->cwd && chdir(sh->cwd) < 0) { msh_perror(sh, sh->cwd); _exit(1); }
+    if (sh->err_fd < 0) close(STDERR_FILENO);
+    else if (sh->err_fd != STDERR_FILENO) dup2(sh->err_fd, STDERR_FILENO);
+    if (in_fd < 0) close(STDIN_FILENO);
+    else if (in_fd != STDIN_FILENO) { dup2(in_fd, STDIN_FILENO); close(in_fd); }
+    if (out_fd < 0) close(STDOUT_FILENO);
+    else if (out_fd != STDOUT_FILENO) { dup2(out_fd, STDOUT_FILENO); close(out_fd); }
+    /* Close unused fds in child */
+    if (close_fd != -1) close(close_fd);
+    redir_install_fds(sh);
+    sh->in_fd = STDIN_FILENO;
+    sh->out_fd = STDOUT_FILENO;
+    sh->err_fd = STDERR_FILENO;
+    sh->on_output = NULL;
+
+    if (cmds[i].builtin) {
+        /* builtins apply their own redirections */
+        int statuses[MAX_STAGES];
+        std_streams(sh);
+        if (run_builtin_segment(sh, &cmds[i], end - i, &sh->std_in, &sh->std_out, statuses) < 0) _exit(1);
+        _exit(segment_status(sh, statuses, end - i, NULL));
+    }
+
+    /* Input redir */
+    if (cmds[i].infile) {
+        int fd = open(cmds[i].infile, O_RDONLY);
+        if (fd < 0) { msh_perror(sh, "open infile"); _exit(1); }
+        dup2(fd, STDIN_FILENO);
+        close(fd);
+    }
+    /* Output redir */
+    if (cmds[i].outfile) {
+        int flags = O_CREAT | O_WRONLY | (cmds[i].append ? O_APPEND : O_TRUNC);
+        int fd = open(cmds[i].outfile, flags, 0644);
+        if (fd < 0) { msh_perror(sh, "open outfile"); _exit(1); }
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+    }
+    if (redir_apply(sh, &cmds[i]) < 0) _exit(1);
+
+    /* Exec */
+    if (!cmds[i].argv[0]) _exit(0);
+    char path[4096], defpath[1024];
+    int found;
+    if (cmds[i].defpath) {
+        /* command -p: the system's default PATH */
+        confstr(_CS_PATH, defpath, sizeof(defpath));
+        found = strchr(cmds[i].argv[0], '/') ? path_lookup(sh, cmds[i].argv[0], path, sizeof(path))
+                    : path_search(sh, defpath, cmds[i].argv[0], path, sizeof(path));
+    } else {
+        found = path_lookup(sh, cmds[i].argv[0], path, sizeof(path));
+    }
+    if (found < 0) {
+        msh_error(sh, "%s: command not found", cmds[i].argv[0]);
+        _exit(127);
+    }
+    execve(path, cmds[i].argv, sh->env);
+    msh_perror(sh, cmds[i].argv[0]);
+    _exit(126);
+}
+
+/* exec name args: replace the shell process with name, the command's
+   redirections applied. Returns a status only if that fails. */
+int exec_replace(msh_t *sh, cmd_t *c) {
+    char path[4096];
+    const char *name = c->argv[1];
+    if (path_lookup(sh, name, path, sizeof(path)) < 0) {
+        msh_error(sh, "exec: %s: not found", name);
+        return 127;
+    }
+    xtrace_flush(sh);
+    fflush(stdout);
+    if (sh->cwd && chdir(sh->cwd) < 0) { msh_perror(sh, sh->cwd); return 1; }
+    int std[3] = { sh->in_fd, sh->out_fd, sh->err_fd };
+    for (int n = 0; n < 3; ++n) {
+        if (std[n] < 0) close(n);
+        else if (std[n] != n) dup2(std[n], n);
+    }
+    redir_install_fds(sh);
+    redir_t plain[2];
+    cmd_t files = { .nredirs = 0 };
+    if (c->infile) plain[files.nredirs++] = (redir_t){ 0, REDIR_IN, c->infile };
+    if (c->outfile) plain[files.nredirs++] = (redir_t){ 1, c->append ? REDIR_APPEND : REDIR_OUT, c->outfile };
+    memcpy(files.redirs, plain, files.nredirs * sizeof(plain[0]));
+    if (redir_apply(sh, &files) < 0 || redir_apply(sh, c) < 0) return 1;
+    execve(path, c->argv + 1, sh->env);
+    msh_perror(sh, name);
+    return 126;
+}
+
+/* Execute pipeline of ncmds commands in cmds[]. background flag determines wait behavior.
+   cmdline is supplied for job bookkeeping. Returns the pipeline's exit status (the last
+   stage's, or with pipefail the rightmost failing stage's) and stores the index of that
+   stage in *failed. Runs of builtins share one process and talk through in-memory
+   pipes; a foreground pipeline made only of side-effect-free builtins runs in the
+   shell without forking. */
+int execute_pipeline(msh_t *sh, cmd_t cmds[], int ncmds, int background, const char *cmdline, int *failed) {
+    int pipe_fd[2];
+    int prev_fd = -1; /* read end of previous pipe */
+    pid_t pids[MAX_STAGES];
+    int unit_last[MAX_STAGES]; /* last stage index run by each child */
+    int started = 0;
+    int result = 0;
+    int capture[2] = { -1, -1 }; /* last stage's stdout, for on_output */
+
+    *failed = ncmds - 1;
+
+    /* set -o compress: helpers for .gz and .zst files start first */
+    size_t zmark = sh->nzio;
+    if (zio_prepare(sh, cmds, ncmds) < 0) {
+        zio_finish(sh, zmark, 0);
+        return sh->last_status = 1;
+    }
+
+    if (pipeline_inproc(cmds, ncmds, background)) {
+        int statuses[MAX_STAGES];
+        std_streams(sh);
+        /* inside a stage (source, replay) lines read and write its streams */
+        int r = run_builtin_segment(sh, cmds, ncmds, sh->bi_in, sh->bi_out, statuses);
+        zio_finish(sh, zmark, 0);
+        if (r < 0) return sh->last_status = 1;
+        return sh->last_status = segment_status(sh, statuses, ncmds, failed);
+    }
+
+    /* the children may change any file */
+    stat_cache_clear(sh);
+    /* resolve commands here so the hash outlives the children */
+    for (int i = 0; i < ncmds; ++i) {
+        char path[4096];
+        if (!cmds[i].builtin && cmds[i].argv[0] && !cmds[i].defpath)
+            path_lookup(sh, cmds[i].argv[0], path, sizeof(path));
+    }
+
+    if (sh->on_output && !background && pipe(capture) < 0) {
+        msh_perror(sh, "pipe");
+        zio_finish(sh, zmark, 0);
+        return sh->last_status = 1;
+    }
+
+    /* Keep a SIGCHLD handler from reaping our children before we wait for
+       them (or before a background job is recorded) */
+    sigset_t chld, oldmask;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &oldmask);
+    /* children must not inherit unflushed host output */
+    fflush(stdout);
+
+    for (int i = 0; i < ncmds; ) {
+        int end = unit_end(cmds, ncmds, i);
+        if (end < ncmds) {
+            if (pipe(pipe_fd) < 0) { msh_perror(sh, "pipe"); result = 1; break; }
+        } else {
+            pipe_fd[0] = -1;
+            pipe_fd[1] = capture[1];
+        }
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            msh_perror(sh, "fork");
+            if (pipe_fd[0] != -1) { close(pipe_fd[0]); close(pipe_fd[1]); }
+            result = 1;
+            break;
+        }
+
+        if (pid == 0) {
+            /* Child */
+            sigprocmask(SIG_SETMASK, &oldmask, NULL);
+            if (capture[0] != -1) close(capture[0]);
+            exec_child(sh, cmds, i, end,
+                       prev_fd != -1 ? prev_fd : sh->in_fd,
+                       pipe_fd[1] != -1 ? pipe_fd[1] : sh->out_fd,
+                       pipe_fd[0]);
+        } else {
+            /* Parent */
+            unit_last[started] = end - 1;
+            pids[started++] = pid;
+            if (prev_fd != -1) close(prev_fd);
+            if (pipe_fd[1] != -1) close(pipe_fd[1]);
+            prev_fd = pipe_fd[0];
+        }
+        i = end;
+    }
+    if (prev_fd != -1) close(prev_fd);
+    if (capture[1] != -1 && result != 0) close(capture[1]);
+
+    if (capture[0] != -1) {
+        /* forward the pipeline's output until every writer is gone */
+        char buf[8192];
+        ssize_t n;
+        while ((n = read(capture[0], buf, sizeof(buf))) != 0) {
+            if (n < 0) { if (errno == EINTR) continue; break; }
+            sh->on_output(sh->userdata, buf, n);
+        }
+        close(capture[0]);
+    }
+
+    if (background && result == 0) {
+        /* record the children as a job */
+        add_job(sh, pids, started, cmdline);
+    } else {
+        /* wait for every child so pipefail can see all statuses */
+        for (int i = 0; i < started; ++i) {
+            int status;
+            while (waitpid(pids[i], &status, 0) < 0) {
+                if (errno == EINTR) continue;
+                msh_perror(sh, "waitpid");
+                status = 0;
+                break;
+            }
+            int st = exit_status(status);
+            if (unit_last[i] == ncmds - 1 && !sh->opts[OPT_PIPEFAIL]) result = st;
+            if (sh->opts[OPT_PIPEFAIL] && st != 0) { result = st; *failed = unit_last[i]; }
+        }
+    }
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+    /* the compressed files are complete once their helpers are */
+    zio_finish(sh, zmark, background && result == 0);
+    sh->last_status = result;
+    return result;
+}
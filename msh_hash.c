@@ -0,0 +1,171 @@
+#define _POSIX_C_SOURCE 200809L
+#include <sys/stat.h>
+
+#include "msh_internal.h"
+
+/* PATH search, and the hash of commands it has found. Each name is looked
+   up in PATH once; later lookups cost one access() to confirm the file is
+   still there. The hash belongs to one value of PATH and is emptied when
+   PATH changes. Commands found through a relative PATH entry depend on
+   the working directory and are not remembered. The shell fills it before
+   forking, so children exec from it too. */
+#define PATH_HASH_SIZE 256 /* slots; emptied when half full */
+
+typedef struct {
+    char *name;            /* NULL: empty slot */
+    char *path;
+    size_t hash;
+    long hits;
+} path_entry_t;
+
+struct path_hash {
+    path_entry_t slots[PATH_HASH_SIZE];
+    size_t used;
+    char *pathvar;         /* the PATH the entries were found in */
+};
+
+void path_hash_clear(msh_t *sh) {
+    struct path_hash *h = sh->path_hash;
+    if (!h) return;
+    for (size_t i = 0; i < PATH_HASH_SIZE; ++i) {
+        free(h->slots[i].name);
+        free(h->slots[i].path);
+        h->slots[i].name = h->slots[i].path = NULL;
+    }
+    h->used = 0;
+}
+
+void path_hash_free(msh_t *sh) {
+    path_hash_clear(sh);
+    if (sh->path_hash) free(sh->path_hash->pathvar);
+    free(sh->path_hash);
+    sh->path_hash = NULL;
+}
+
+size_t path_hash_mem(msh_t *sh) {
+    struct path_hash *h = sh->path_hash;
+    if (!h) return 0;
+    size_t n = sizeof(*h) + (h->pathvar ? strlen(h->pathvar) + 1 : 0);
+    for (size_t i = 0; i < PATH_HASH_SIZE; ++i)
+        if (h->slots[i].name) n += strlen(h->slots[i].name) + strlen(h->slots[i].path) + 2;
+    return n;
+}
+
+static const char *path_var(msh_t *sh) {
+    const char *path = msh_getvar(sh, "PATH");
+    return path ? path : "/bin:/usr/bin";
+}
+
+/* The hash for the current PATH, emptied if PATH changed; NULL if memory
+   is short */
+static struct path_hash *path_hash_get(msh_t *sh) {
+    struct path_hash *h = sh->path_hash;
+    if (!h && !(h = sh->path_hash = calloc(1, sizeof(*h)))) return NULL;
+    const char *path = path_var(sh);
+    if (!h->pathvar || strcmp(h->pathvar, path) != 0) {
+        path_hash_clear(sh);
+        free(h->pathvar);
+        if (!(h->pathvar = strdup(path))) return NULL;
+    }
+    return h;
+}
+
+static path_entry_t *path_slot(struct path_hash *h, const char *name, size_t hv) {
+    size_t i = hv & (PATH_HASH_SIZE - 1);
+    while (h->slots[i].name) {
+        if (h->slots[i].hash == hv && strcmp(h->slots[i].name, name) == 0) break;
+        i = (i + 1) & (PATH_HASH_SIZE - 1);
+    }
+    return &h->slots[i];
+}
+
+/* An executable regular file; a relative file is looked for in the
+   context's directory, where the child will exec it */
+static int is_executable(msh_t *sh, const char *file) {
+    struct stat st;
+    char tmp[4096];
+    if (!(file = msh_path(sh, file, tmp, sizeof(tmp)))) return 0;
+    return stat(file, &st) == 0 && S_ISREG(st.st_mode) && access(file, X_OK) == 0;
+}
+
+int path_search(msh_t *sh, const char *path, const char *name, char *buf, size_t size) {
+    while (*path) {
+        const char *end = strchr(path, ':');
+        size_t dlen = end ? (size_t)(end - path) : strlen(path);
+        /* empty PATH element means current directory */
+        if (dlen == 0) snprintf(buf, size, "%s", name);
+        else snprintf(buf, size, "%.*s/%s", (int)dlen, path, name);
+        if (is_executable(sh, buf)) return 0;
+        if (!end) break;
+        path = end + 1;
+    }
+    return -1;
+}
+
+/* Resolve name the way execvp would, using the context's PATH. Writes the
+   path into buf and returns 0, or returns -1 if no executable is found. */
+int path_lookup(msh_t *sh, const char *name, char *buf, size_t size) {
+    if (strchr(name, '/')) {
+        if (!is_executable(sh, name)) return -1;
+        snprintf(buf, size, "%s", name);
+        return 0;
+    }
+    struct path_hash *h = path_hash_get(sh);
+    if (!h) return path_search(sh, path_var(sh), name, buf, size);
+    size_t hv = str_hash(name);
+    path_entry_t *e = path_slot(h, name, hv);
+    if (e->name) {
+        if (access(e->path, X_OK) == 0) {
+            sh->stats.path_hits++;
+            e->hits++;
+            snprintf(buf, size, "%s", e->path);
+            return 0;
+        }
+        /* moved or deleted: forget everything found in this PATH */
+        path_hash_clear(sh);
+        e = path_slot(h, name, hv);
+    }
+    sh->stats.path_misses++;
+    if (path_search(sh, h->pathvar, name, buf, size) < 0) return -1;
+    if (buf[0] != '/') return 0;
+    if (h->used >= PATH_HASH_SIZE / 2) {
+        path_hash_clear(sh);
+        e = path_slot(h, name, hv);
+    }
+    if (!(e->name = strdup(name)) || !(e->path = strdup(buf))) {
+        free(e->name);
+        e->name = NULL;
+        return 0;
+    }
+    e->hash = hv;
+    e->hits = 0;
+    h->used++;
+    return 0;
+}
+
+/* The remembered path of name, or NULL */
+const char *path_hashed(msh_t *sh, const char *name) {
+    struct path_hash *h = sh->path_hash;
+    if (!h || !h->pathvar || strcmp(h->pathvar, path_var(sh)) != 0) return NULL;
+    path_entry_t *e = path_slot(h, name, str_hash(name));
+    return e->name ? e->path : NULL;
+}
+
+int msh_is_command(msh_t *sh, const char *name) {
+    char buf[4096];
+    if (!*name) return 0;
+    if (strcmp(name, "[[") == 0 || builtin_lookup(sh, name)) return 1;
+    return path_lookup(sh, name, buf, sizeof(buf)) == 0;
+}
+
+/* hash lists the remembered commands and their hits */
+void path_hash_print(msh_t *sh) {
+    struct path_hash *h = path_hash_get(sh);
+    if (!h || !h->used) {
+        bi_printf(sh, "hash: hash table empty\n");
+        return;
+    }
+    bi_printf(sh, "hits\tcommand\n");
+    for (size_t i = 0; i < PATH_HASH_SIZE; ++i)
+        if (h->slots[i].name) bi_printf(sh, "%4ld\t%s\n", h->slots[i].hits, h->slots[i].path);
+}
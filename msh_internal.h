@@ -0,0 +1,385 @@
+/* Engine internals shared by the libmyshell sources. Not installed. */
+#ifndef MSH_INTERNAL_H
+#define MSH_INTERNAL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <ucontext.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "myshell.h"
+
+#define MAX_STAGES 256 /* commands in one pipeline */
+
+/* Options toggled with set -o name / set +o name, or set -x / set +x */
+enum {
+    OPT_PROFILE,
+    OPT_XTRACE,
+    OPT_XTRACETIME,
+    OPT_ERREXIT,
+    OPT_NOUNSET,
+    OPT_PIPEFAIL,
+    OPT_COMPRESS,
+    OPT_COUNT
+};
+
+typedef struct {
+    const char *name;
+    char letter;
+} shell_option_t;
+
+extern const shell_option_t shell_options[OPT_COUNT];
+
+/* A background job: every process of the pipeline, reported done once all
+   of them have been reaped */
+typedef struct {
+    pid_t pid;      /* last stage, whose status is reported */
+    pid_t *pids;    /* all stages; reaped entries are set to 0 */
+    int npids, nalive;
+    int status;
+    const char *cmdline;  /* interned: jobs running one line share it */
+    int running;
+} job_t;
+
+/* A token of an input line. Operators are > >> < | &; everything else is
+   a word, kept as written (quotes and $ included) until it is expanded at
+   run time. col is the 1-based column where the token starts. */
+typedef struct {
+    char *text;
+    int op;
+    int col;
+} token_t;
+
+/* Growable buffer used while building a word */
+typedef struct {
+    char *s;
+    size_t len, cap;
+} strbuf_t;
+
+typedef struct builtin_def builtin_def_t;
+typedef struct msh_array msh_array_t;
+
+#define MAX_REDIRS 8
+#define SHELL_FDS  10 /* a script can name fds 0-9 */
+
+/* A redirection other than a command's plain < file and > file */
+enum { REDIR_IN, REDIR_OUT, REDIR_APPEND, REDIR_DUP };
+typedef struct {
+    int fd;        /* the fd being redirected */
+    int op;        /* REDIR_* */
+    char *target;  /* file, or for REDIR_DUP an fd number or - */
+} redir_t;
+
+/* Structure describing a single command in a pipeline */
+typedef struct {
+    char **argv;  /* NULL-terminated, sized to fit */
+    char *infile;
+    char *outfile;
+    int append; /* for >> */
+    int col;    /* column of the first token, for diagnostics */
+    const builtin_def_t *builtin; /* resolved by expand_cmds; NULL if external */
+    int assign; /* every word is NAME=value */
+    int defpath; /* command -p: search the default PATH */
+    redir_t redirs[MAX_REDIRS]; /* applied in order after infile and outfile */
+    int nredirs;
+} cmd_t;
+
+/* One parsed line of a script */
+typedef struct {
+    int lineno;
+    char *text;       /* source, for job bookkeeping */
+    token_t *tokens;
+    int ntok;
+    cmd_t *cmds;      /* words point into tokens */
+    int ncmds;
+    int background;
+    int bad;          /* syntax error: skipped when run */
+} msh_line_t;
+
+struct msh_script {
+    char *name;
+    msh_line_t *lines;
+    int nlines;
+    int nerrors;
+};
+
+/* Builtin I/O. Builtins read and write through these streams so the same
+   code can talk to an fd, to the embedder's output callback, or to an
+   in-memory pipe shared with a neighbouring builtin stage. */
+#define MEMPIPE_SIZE 65536
+
+typedef struct {
+    char buf[MEMPIPE_SIZE];
+    size_t head, len;
+    int closed;  /* writer finished: reads drain then see EOF */
+    int broken;  /* reader finished: writes fail */
+} mempipe_t;
+
+typedef struct {
+    int fd;          /* used when mp is NULL and cb is 0 */
+    mempipe_t *mp;
+    int cb;          /* deliver to the context's on_output callback */
+    char obuf[4096]; /* output buffer for fd and callback streams */
+    size_t olen;
+} bstream_t;
+
+typedef struct costage costage_t;
+
+/* A builtin: its handler returns the exit status */
+struct builtin_def {
+    const char *name;
+    int (*fn)(msh_t *sh, cmd_t *c);
+    int flags;
+};
+
+#define BI_INPROC  1 /* may run inside the shell as a pipeline stage */
+#define BI_SPECIAL 2 /* POSIX special builtin */
+#define BI_LOADED  4 /* added by enable -f or msh_add_builtin() */
+#define BI_REDIRS  8 /* handles its own redirections */
+
+/* A builtin added by enable -f or msh_add_builtin(). def comes first so a
+   cmd_t's builtin pointer leads back to the entry. */
+typedef struct {
+    builtin_def_t def;
+    msh_builtin_fn fn;
+    void *handle; /* dlopen handle; NULL when registered by the embedder */
+} dyn_builtin_t;
+
+/* Profiling (set -o profile) aggregates */
+typedef struct {
+    char *key;
+    char *label; /* commands of the line, for folded stacks */
+    long calls;
+    double wall, cpu;
+} prof_entry_t;
+
+typedef struct {
+    prof_entry_t *slots;
+    size_t cap, used;
+} prof_table_t;
+
+typedef struct {
+    int active;
+    struct timespec wall;
+    double cpu;
+} prof_sample_t;
+
+struct msh {
+    job_t *jobs;              /* job n is jobs[n-1]; grows as needed */
+    int jobcap;
+    struct str_pool *cmdlines;
+    int opts[OPT_COUNT];
+    int last_status;          /* $? */
+    int exiting, exit_status; /* set by exit, errexit and nounset */
+    int interactive;
+    int in_child;             /* forked child running builtins */
+
+    /* variables, as NAME=value strings passed to children as environ */
+    char **env;
+    size_t nenv, envcap;
+
+    /* indexed and associative arrays */
+    msh_array_t **arrays;
+    size_t narrays, arraycap;
+
+    char *cwd;                /* NULL: the process working directory */
+    char *pwd;                /* its logical name, when cwd is NULL */
+    char **dirs;              /* pushd's stack, top last */
+    size_t ndirs, dircap;
+    int in_fd, out_fd, err_fd;
+    int fds[SHELL_FDS];       /* 3-9 opened by exec; -1 if closed */
+    unsigned fd_owned;        /* bit n: the shell opened its fd n */
+    msh_output_fn on_output;
+    void *userdata;
+
+    /* diagnostics */
+    const char *script_name;
+    int lineno;
+
+    /* loaded builtins */
+    dyn_builtin_t **dyn;
+    size_t ndyn, dyncap;
+
+    /* builtin streams and the running coroutine stage */
+    bstream_t std_in, std_out;
+    bstream_t *bi_in, *bi_out;
+    costage_t *co_cur;
+
+    /* set -x */
+    char xtrace_buf[8192];
+    size_t xtrace_len;
+    long xtrace_bad;          /* MYSHELL_XTRACEFD value reported bad, or -1 */
+
+    /* set -o profile */
+    prof_table_t prof_lines, prof_cmds;
+
+    /* compiled [[ =~ ]] patterns and the file test stat cache */
+    struct re_cache *re_cache;
+    struct stat_cache *stat_cache;
+    int njobs;                /* running background jobs */
+
+    /* scripts parsed by source, commands found in PATH */
+    struct source_cache *source_cache;
+    struct path_hash *path_hash;
+    struct z_db *z;           /* directories for z, opened on first use */
+    struct recorder *rec;     /* set while record runs */
+    struct zio **zio;         /* compressed redirections: running pipelines, background jobs */
+    size_t nzio;
+
+    /* counters shown by debug stats */
+    struct {
+        long stat_hits, stat_misses, stat_flushes;
+        long re_hits, re_misses;
+        long source_hits, source_misses;
+        long path_hits, path_misses;
+    } stats;
+};
+
+/* msh_ctx.c */
+void msh_error(msh_t *sh, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void msh_perror(msh_t *sh, const char *what);
+const char *msh_path(msh_t *sh, const char *path, char *buf, size_t size);
+int msh_open(msh_t *sh, const char *path, int flags, mode_t mode);
+void shell_exit(msh_t *sh, int status);
+int run_script(msh_t *sh, const msh_script_t *script);
+void add_job(msh_t *sh, pid_t pids[], int npids, const char *cmdline);
+size_t jobs_mem(msh_t *sh, size_t *lines);
+void jobs_free(msh_t *sh);
+void sb_putn(strbuf_t *b, const char *s, size_t n);
+size_t str_hash(const char *s);
+size_t env_mem(msh_t *sh);
+
+/* msh_parse.c */
+msh_script_t *parse_text(msh_t *sh, const char *src, size_t len, const char *name, int first_line);
+int expand_cmds(msh_t *sh, const msh_line_t *ln, cmd_t *out);
+void free_expanded(cmd_t *cmds, int ncmds);
+size_t script_mem(const msh_script_t *script);
+
+/* msh_exec.c */
+int bi_write(msh_t *sh, const char *s, size_t n);
+int bi_printf(msh_t *sh, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+ssize_t bi_read(msh_t *sh, char *buf, size_t n);
+int bi_flush(msh_t *sh, bstream_t *st);
+int pipeline_forks(cmd_t cmds[], int ncmds, int background);
+int exec_replace(msh_t *sh, cmd_t *c);
+int execute_pipeline(msh_t *sh, cmd_t cmds[], int ncmds, int background, const char *cmdline, int *failed);
+int co_stack_low(msh_t *sh);
+
+/* msh_builtins.c */
+extern const builtin_def_t assign_builtin; /* runs a line of NAME=value words */
+const builtin_def_t *builtin_lookup(msh_t *sh, const char *name);
+int dispatch_builtin(msh_t *sh, cmd_t *c);
+void dyn_free(msh_t *sh);
+
+/* msh_dirs.c */
+int change_dir(msh_t *sh, const char *dir, int physical);
+int cd_command(msh_t *sh, char **argv);
+int pwd_command(msh_t *sh, char **argv);
+int dirs_command(msh_t *sh, char **argv);
+int pushd_command(msh_t *sh, char **argv);
+int popd_command(msh_t *sh, char **argv);
+void dirs_free(msh_t *sh);
+size_t dirs_mem(msh_t *sh);
+
+/* msh_cond.c */
+int cond_eval(msh_t *sh, char **argv);
+void cond_free(msh_t *sh);
+size_t cond_mem(msh_t *sh);
+
+/* msh_array.c */
+#define ARR_INDEXED 1
+#define ARR_ASSOC   2
+msh_array_t *array_find(msh_t *sh, const char *name);
+msh_array_t *array_declare(msh_t *sh, const char *name, int kind);
+int array_unset(msh_t *sh, const char *name);
+void arrays_free(msh_t *sh);
+int array_kind(const msh_array_t *a);
+const char *array_name(const msh_array_t *a);
+size_t array_count(const msh_array_t *a);
+size_t array_bytes(const msh_array_t *a);
+const char *array_get(const msh_array_t *a, const char *key);
+int array_set(msh_array_t *a, const char *key, const char *val, int append);
+int array_unset_elem(msh_array_t *a, const char *key);
+int array_next(const msh_array_t *a, size_t *pos, const char **key, char keybuf[24], const char **val);
+void quote_into(strbuf_t *b, const char *s);
+int assign_word(msh_t *sh, const char *word, int kind);
+size_t arrays_mem(msh_t *sh);
+
+/* msh_hash.c */
+int path_search(msh_t *sh, const char *path, const char *name, char *buf, size_t size);
+int path_lookup(msh_t *sh, const char *name, char *buf, size_t size);
+const char *path_hashed(msh_t *sh, const char *name);
+void path_hash_print(msh_t *sh);
+void path_hash_clear(msh_t *sh);
+void path_hash_free(msh_t *sh);
+size_t path_hash_mem(msh_t *sh);
+
+/* msh_record.c */
+void rec_line(msh_t *sh, const char *line);
+void rec_status(msh_t *sh, int status);
+int rec_stop(msh_t *sh);
+int record_command(msh_t *sh, char **argv);
+int replay_command(msh_t *sh, char **argv);
+size_t rec_mem(msh_t *sh);
+
+/* msh_redir.c */
+int shell_fd(msh_t *sh, int n);
+void shell_fd_set(msh_t *sh, int n, int fd);
+void shell_fds_close(msh_t *sh);
+int redir_open(msh_t *sh, const redir_t *r);
+int redir_dup_src(msh_t *sh, const redir_t *r, int *src);
+void redir_install_fds(msh_t *sh);
+int redir_apply(msh_t *sh, const cmd_t *c);
+int redir_shell(msh_t *sh, const cmd_t *c);
+
+/* msh_source.c */
+int source_file(msh_t *sh, const char *name);
+void source_cache_free(msh_t *sh);
+size_t source_cache_mem(msh_t *sh);
+
+/* msh_stat.c */
+int msh_stat(msh_t *sh, const char *path, struct stat *st, int follow);
+int msh_access(msh_t *sh, const char *path, int mode);
+void stat_cache_clear(msh_t *sh);
+void stat_cache_free(msh_t *sh);
+size_t stat_cache_mem(msh_t *sh);
+
+/* msh_text.c */
+int wc_command(msh_t *sh, char **argv);
+int head_command(msh_t *sh, char **argv);
+int tail_command(msh_t *sh, char **argv);
+
+/* msh_zio.c */
+int zio_prepare(msh_t *sh, cmd_t cmds[], int ncmds);
+void zio_finish(msh_t *sh, size_t mark, int background);
+void zio_reap(msh_t *sh);
+void zio_free(msh_t *sh);
+void zio_child(msh_t *sh, cmd_t cmds[], int ncmds);
+
+/* msh_utils.c */
+int seq_command(msh_t *sh, char **argv);
+int basename_command(msh_t *sh, char **argv);
+int dirname_command(msh_t *sh, char **argv);
+int printf_command(msh_t *sh, char **argv);
+
+/* msh_z.c */
+void z_visit(msh_t *sh, const char *dir);
+int z_command(msh_t *sh, char **argv, char **dir);
+void z_free(msh_t *sh);
+size_t z_mem(msh_t *sh, size_t *mapped);
+
+/* msh_trace.c */
+void xtrace_flush(msh_t *sh);
+int xtrace_pipeline(msh_t *sh, cmd_t cmds[], int ncmds, int background, struct timespec *start);
+void xtrace_done(msh_t *sh, const struct timespec *start);
+void prof_begin(msh_t *sh, prof_sample_t *ps);
+void prof_end(msh_t *sh, prof_sample_t *ps, int lineno, cmd_t cmds[], int ncmds);
+void prof_dump(msh_t *sh);
+void prof_free(msh_t *sh);
+size_t prof_mem(msh_t *sh);
+
+#endif
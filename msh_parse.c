@@ -0,0 +1,704 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "msh_internal.h"
+
+static int is_name_char(char c, int first) {
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (!first && c >= '0' && c <= '9');
+}
+
+/* Length of the NAME=, NAME+= or NAME[sub]= prefix of an assignment
+   word, or 0 if w is not one */
+static size_t assign_len(const char *w) {
+    const char *p = w;
+    if (!is_name_char(*p, 1)) return 0;
+    while (is_name_char(*p, 0)) p++;
+    if (*p == '[') {
+        char q = 0;
+        for (p++; *p && (q || *p != ']'); p++) {
+            if (!q && (*p == '\'' || *p == '"')) q = *p;
+            else if (q && *p == q) q = 0;
+        }
+        if (*p++ != ']') return 0;
+    }
+    if (*p == '+') p++;
+    return *p == '=' ? (size_t)(p + 1 - w) : 0;
+}
+
+/* Free tokens */
+static void free_tokens(token_t tokens[], int n) {
+    for (int i = 0; i < n; ++i) free(tokens[i].text);
+}
+
+/* Tokenizer: splits input into tokens separated by whitespace, but treats
+   > >> < >& <& | & && || as separate tokens even when adjacent, with any
+   fd number written before a redirection. Words are kept as
+   written; a word starting with # begins a comment. Between [[ and ]] only
+   whitespace separates words, so < > && || and the | and parentheses of a
+   regex reach the conditional as written. An array assignment
+   name=( ... ) is a single word. Stores a NULL-terminated array of the
+   tokens in *tokensp and returns their number, or -1 if out of memory. */
+static int tokenize(const char *line, token_t **tokensp) {
+    int n = 0, cap = 16, cond = 0;
+    const char *p = line;
+    token_t *tokens = malloc(cap * sizeof(token_t));
+    if (!tokens) return -1;
+    while (*p) {
+        while (*p && (*p == ' ' || *p == '\t' || *p == '\n')) p++;
+        if (!*p || *p == '#') break;
+        if (n + 1 == cap) {
+            token_t *nt = realloc(tokens, 2 * cap * sizeof(token_t));
+            if (!nt) { free_tokens(tokens, n); free(tokens); return -1; }
+            tokens = nt;
+            cap *= 2;
+        }
+        int col = (int)(p - line) + 1;
+        /* digits right before < or > name the fd: 2>file, 3<&0 */
+        const char *d = p;
+        while (!cond && *d >= '0' && *d <= '9') d++;
+        if (!cond && ((*d == '>' || *d == '<') || (d == p && (*p == '|' || *p == '&')))) {
+            const char *q = d + 1;
+            if ((*d == '>' || *d == '&' || *d == '|') && *q == *d) q++;
+            else if ((*d == '>' || *d == '<') && *q == '&') q++;
+            tokens[n].text = strndup(p, q - p);
+            p = q;
+            tokens[n].op = 1;
+            tokens[n++].col = col;
+            continue;
+        }
+        /* regular word */
+        const char *start = p;
+        char quotechar = 0;
+        while (*p) {
+            if (!quotechar && (*p == ' ' || *p == '\t' || *p == '\n')) break;
+            if (!quotechar && !cond && (*p == '>' || *p == '<' || *p == '|' || *p == '&')) break;
+            if (!quotechar && !cond && *p == '(' && p > start && p[-1] == '=' &&
+                assign_len(start) == (size_t)(p - start)) {
+                /* name=( ... ) is one word, blanks included */
+                for (p++; *p && (quotechar || *p != ')'); p++) {
+                    if (!quotechar && (*p == '\'' || *p == '"')) quotechar = *p;
+                    else if (quotechar && *p == quotechar) quotechar = 0;
+                }
+                if (*p) p++;
+                continue;
+            }
+            if (quotechar != '\'' && p[0] == '$' && p[1] == '{' && strchr(p, '}')) {
+                /* ${m[a b]} is part of the word */
+                p = strchr(p, '}') + 1;
+                continue;
+            }
+            if (!quotechar && (*p == '\'' || *p == '"')) quotechar = *p;
+            else if (quotechar && *p == quotechar) quotechar = 0;
+            p++;
+        }
+        tokens[n].text = strndup(start, p - start);
+        tokens[n].op = 0;
+        /* [[ in command position opens a conditional, ]] closes it */
+        if (!cond && strcmp(tokens[n].text, "[[") == 0 &&
+            (n == 0 || (tokens[n-1].op && strcmp(tokens[n-1].text, "|") == 0))) cond = 1;
+        else if (cond && strcmp(tokens[n].text, "]]") == 0) cond = 0;
+        tokens[n++].col = col;
+    }
+    tokens[n].text = NULL;
+    *tokensp = tokens;
+    return n;
+}
+
+/* Free a parsed pipeline: the argv arrays are its own, the words are not */
+static void free_parsed(cmd_t *cmds, int n) {
+    for (int i = 0; cmds && i < n; ++i) free(cmds[i].argv);
+    free(cmds);
+}
+
+/* Words of the command starting at token i, so its argv is sized to fit */
+static int count_args(token_t tokens[], int ntok, int i) {
+    int n = 0;
+    for (; i < ntok; ++i) {
+        if (!tokens[i].op) { n++; continue; }
+        if (strcmp(tokens[i].text, "|") == 0) break;
+        char c = tokens[i].text[strspn(tokens[i].text, "0123456789")];
+        if (c == '<' || c == '>') i++;  /* a redirection's target */
+    }
+    return n;
+}
+
+/* Parse tokens into a cmd_t array (pipeline), and detect background flag */
+static int parse_commands(msh_t *sh, token_t tokens[], int ntok, cmd_t **cmdsp, int *ncmds, int *background) {
+    int n = 1;
+    for (int i = 0; i < ntok; ++i)
+        if (tokens[i].op && strcmp(tokens[i].text, "|") == 0) n++;
+    if (n > MAX_STAGES) {
+        msh_error(sh, "syntax error: more than %d commands in a pipeline", MAX_STAGES);
+        return -1;
+    }
+    cmd_t *cmds = calloc(n, sizeof(cmd_t));
+    if (!cmds) { msh_perror(sh, "parse"); return -1; }
+
+    int ci = 0;
+    int ai = 0;
+    cmds[ci].col = ntok ? tokens[0].col : 1;
+    if (!(cmds[ci].argv = calloc(count_args(tokens, ntok, 0) + 1, sizeof(char *)))) goto nomem;
+
+    *background = 0;
+    *ncmds = 0;
+
+    for (int i = 0; i < ntok; ++i) {
+        char *t = tokens[i].text;
+        if (!tokens[i].op) {
+            cmds[ci].argv[ai++] = t;
+        } else if (strcmp(t, "&") == 0) {
+            *background = 1;
+            continue;
+        } else if (strcmp(t, "&&") == 0 || strcmp(t, "||") == 0) {
+            msh_error(sh, "syntax error: %s lists are not supported", t);
+            goto fail;
+        } else if (strcmp(t, "|") == 0) {
+            cmds[ci].argv[ai] = NULL;
+            ci++;
+            ai = 0;
+            cmds[ci].col = i + 1 < ntok ? tokens[i+1].col : tokens[i].col;
+            if (!(cmds[ci].argv = calloc(count_args(tokens, ntok, i + 1) + 1, sizeof(char *)))) goto nomem;
+            continue;
+        } else {
+            /* [n]< [n]> [n]>> [n]<& [n]>& */
+            char *op = t;
+            int fd = -1;
+            if (*op >= '0' && *op <= '9') fd = (int)strtol(op, &op, 10);
+            int kind = strcmp(op, ">>") == 0 ? REDIR_APPEND : op[1] == '&' ? REDIR_DUP :
+                       *op == '<' ? REDIR_IN : REDIR_OUT;
+            if (fd < 0) fd = *op == '<' ? 0 : 1;
+            if (i+1 >= ntok || tokens[i+1].op) {
+                msh_error(sh, "syntax error: %s needs %s", t, kind == REDIR_DUP ? "fd" : "file");
+                goto fail;
+            }
+            char *target = tokens[++i].text;
+            cmd_t *c = &cmds[ci];
+            /* plain < and > keep their own fields unless an earlier
+               redirection must be applied first */
+            if (!c->nredirs && kind == REDIR_IN && fd == 0) {
+                c->infile = target;
+            } else if (!c->nredirs && kind != REDIR_IN && kind != REDIR_DUP && fd == 1) {
+                c->outfile = target;
+                c->append = kind == REDIR_APPEND;
+            } else if (c->nredirs == MAX_REDIRS) {
+                msh_error(sh, "syntax error: too many redirections");
+                goto fail;
+            } else {
+                c->redirs[c->nredirs++] = (redir_t){ fd, kind, target };
+            }
+            continue;
+        }
+    }
+    cmds[ci].argv[ai] = NULL;
+    *ncmds = ci + 1;
+    for (int k = 0; k < *ncmds; ++k) {
+        cmds[k].assign = cmds[k].argv[0] != NULL;
+        for (int j = 0; cmds[k].argv[j]; ++j)
+            if (!assign_len(cmds[k].argv[j])) cmds[k].assign = 0;
+    }
+    *cmdsp = cmds;
+    return 0;
+nomem:
+    msh_perror(sh, "parse");
+fail:
+    free_parsed(cmds, n);
+    return -1;
+}
+
+/* Column of a word of ln, for diagnostics */
+static int word_col(const msh_line_t *ln, const char *word) {
+    for (int i = 0; i < ln->ntok; ++i)
+        if (ln->tokens[i].text == word) return ln->tokens[i].col;
+    return 1;
+}
+
+/* Append n bytes to b, putting a backslash before any of special */
+static void sb_put_escaped(strbuf_t *b, const char *s, size_t n, const char *special) {
+    for (size_t i = 0; i < n; ++i) {
+        if (special && strchr(special, s[i])) sb_putn(b, "\\", 1);
+        sb_putn(b, s + i, 1);
+    }
+}
+
+/* Words produced by expanding one source word: ${a[@]} gives one per
+   element. v stays NULL-terminated as it grows. */
+typedef struct {
+    char **v;
+    int n, cap;
+} fields_t;
+
+typedef struct {
+    msh_t *sh;
+    const msh_line_t *ln;
+    fields_t *f;      /* NULL: join ${a[@]} with spaces */
+    strbuf_t b;       /* the word being built */
+    int at_empty;     /* some ${a[@]} gave no elements */
+    int at_elems;     /* some ${a[@]} gave elements */
+} expand_t;
+
+static int fields_push(msh_t *sh, fields_t *f, char *w) {
+    if (f->n + 1 >= f->cap) {
+        int cap = f->cap ? f->cap * 2 : 8;
+        char **nv = realloc(f->v, cap * sizeof(*nv));
+        if (!nv) {
+            msh_perror(sh, sh->script_name);
+            free(w);
+            return -1;
+        }
+        f->v = nv;
+        f->cap = cap;
+    }
+    f->v[f->n++] = w;
+    f->v[f->n] = NULL;
+    return 0;
+}
+
+static int start_word(strbuf_t *b) {
+    b->s = NULL;
+    b->len = b->cap = 0;
+    sb_putn(b, "", 0);
+    return b->s ? 0 : -1;
+}
+
+static char *expand_join(msh_t *sh, const msh_line_t *ln, const char *word, const char *special);
+
+/* Expand the parameter starting at p (just after '$') into x->b. Quoted
+   values escape the characters in special. Returns the number of
+   characters consumed, or -1 if expansion failed. */
+static int expand_param(expand_t *x, const char *p, const char *special, int col) {
+    msh_t *sh = x->sh;
+    strbuf_t *b = &x->b;
+    char name[256], tmp[32];
+    int braced = (*p == '{');
+    const char *q = p + braced;
+    if (*q == '?') {
+        sb_putn(b, tmp, snprintf(tmp, sizeof(tmp), "%d", sh->last_status));
+        int used = (int)(q + 1 - p);
+        if (braced && *(q + 1) == '}') used++;
+        return used;
+    }
+    /* ${!a[@]} lists subscripts, ${#...} measures */
+    char mode = 0;
+    if (braced && (*q == '!' || *q == '#') && is_name_char(q[1], 1)) mode = *q++;
+    int n = 0;
+    while (is_name_char(q[n], n == 0) && n < (int)sizeof(name) - 1) { name[n] = q[n]; n++; }
+    name[n] = 0;
+    const char *sub = NULL, *end = q + n;
+    size_t sublen = 0;
+    if (braced && n && *end == '[') {
+        char qc = 0;
+        const char *s = end + 1, *e = s;
+        for (; *e && (qc || *e != ']'); e++) {
+            if (!qc && (*e == '\'' || *e == '"')) qc = *e;
+            else if (qc && *e == qc) qc = 0;
+        }
+        if (*e == ']') { sub = s; sublen = e - s; end = e + 1; }
+    }
+    if (n == 0 || (braced && *end != '}') || (mode == '!' && !sub)) {
+        /* not a parameter: keep the '$' literally */
+        sb_putn(b, "$", 1);
+        return 0;
+    }
+    int used = (int)(end + braced - p);
+
+    msh_array_t *a = array_find(sh, name);
+    const char *scalar = a ? NULL : msh_getvar(sh, name);
+    if (sub && sublen == 1 && (*sub == '@' || *sub == '*')) {
+        if (mode == '#') {
+            sb_putn(b, tmp, snprintf(tmp, sizeof(tmp), "%zu", a ? array_count(a) : scalar ? 1 : 0));
+            return used;
+        }
+        /* ${a[*]} is always one word */
+        int split = *sub == '@' && x->f;
+        size_t pos = 0, k = 0;
+        const char *key, *val;
+        char keybuf[24];
+        for (;;) {
+            if (a) {
+                if (!array_next(a, &pos, &key, keybuf, &val)) break;
+            } else {
+                if (!scalar || k) break;
+                key = "0";
+                val = scalar;
+            }
+            if (k++) {
+                if (!split) {
+                    sb_putn(b, " ", 1);
+                } else if (fields_push(sh, x->f, b->s) < 0 || start_word(b) < 0) {
+                    b->s = NULL;
+                    return -1;
+                }
+            }
+            if (mode == '!') val = key;
+            sb_put_escaped(b, val, strlen(val), special);
+        }
+        if (k) x->at_elems = 1;
+        else x->at_empty = 1;
+        return used;
+    }
+
+    const char *val;
+    if (sub) {
+        char *raw = strndup(sub, sublen);
+        char *key = raw ? expand_join(sh, x->ln, raw, NULL) : NULL;
+        free(raw);
+        if (!key) return -1;
+        /* a scalar is element 0 of itself */
+        if (a) val = array_get(a, key);
+        else val = *key && strtol(key, NULL, 10) == 0 ? scalar : NULL;
+        free(key);
+    } else {
+        val = a ? array_get(a, "0") : scalar;
+    }
+    if (!val) {
+        if (sh->opts[OPT_NOUNSET]) {
+            msh_error(sh, "%s:%d:%d: %s: unbound variable", sh->script_name, x->ln->lineno, col, name);
+            return -1;
+        }
+        val = "";
+    }
+    if (mode == '#') sb_putn(b, tmp, snprintf(tmp, sizeof(tmp), "%zu", strlen(val)));
+    else sb_put_escaped(b, val, strlen(val), special);
+    return used;
+}
+
+/* Expand one word: remove quotes and substitute parameters outside single
+   quotes. Quoted characters listed in special get a backslash, so a quoted
+   pattern matches literally. The result is left in x->b, or with x->f set
+   pushed there; a word that was only an empty ${a[@]} then disappears.
+   Returns -1 under set -u or with too many words. */
+static int expand_word(expand_t *x, const char *word, const char *special) {
+    int col0 = word_col(x->ln, word);
+    if (start_word(&x->b) < 0) return -1;
+    x->at_empty = x->at_elems = 0;
+    char quotechar = 0;
+    for (const char *p = word; *p; ) {
+        if (!quotechar && (*p == '\'' || *p == '"')) { quotechar = *p++; continue; }
+        if (quotechar && *p == quotechar) { quotechar = 0; p++; continue; }
+        if (*p == '$' && quotechar != '\'') {
+            int used = expand_param(x, p + 1, quotechar ? special : NULL, col0 + (int)(p - word));
+            if (used < 0) { free(x->b.s); x->b.s = NULL; return -1; }
+            p += 1 + used;
+            continue;
+        }
+        sb_put_escaped(&x->b, p++, 1, quotechar ? special : NULL);
+    }
+    if (!x->f) return 0;
+    char *w = x->b.s;
+    x->b.s = NULL;
+    if (x->at_empty && !x->at_elems && !*w) { free(w); return 0; }
+    return fields_push(x->sh, x->f, w);
+}
+
+/* Expand word into one new string, or NULL */
+static char *expand_join(msh_t *sh, const msh_line_t *ln, const char *word, const char *special) {
+    expand_t x = { sh, ln, NULL, { NULL, 0, 0 }, 0, 0 };
+    return expand_word(&x, word, special) < 0 ? NULL : x.b.s;
+}
+
+/* End of the [key]= prefix of a compound array element, or NULL */
+static char *element_key_end(char *e) {
+    if (*e != '[') return NULL;
+    char q = 0;
+    for (e++; *e && (q || *e != ']'); e++) {
+        if (!q && (*e == '\'' || *e == '"')) q = *e;
+        else if (q && *e == q) q = 0;
+    }
+    return e[0] == ']' && e[1] == '=' ? e : NULL;
+}
+
+/* Append the quoted elements of one word of a compound value to out */
+static int expand_element(msh_t *sh, const msh_line_t *ln, char *e, strbuf_t *out) {
+    char *kend = element_key_end(e);
+    if (kend) {
+        *kend = 0;
+        char *key = expand_join(sh, ln, e + 1, NULL);
+        char *val = key ? expand_join(sh, ln, kend + 2, NULL) : NULL;
+        if (val) {
+            sb_putn(out, " [", 2);
+            quote_into(out, key);
+            sb_putn(out, "]=", 2);
+            quote_into(out, val);
+        }
+        free(key);
+        free(val);
+        return val ? 0 : -1;
+    }
+    /* (${a[@]}) copies every element */
+    fields_t f = { NULL, 0, 0 };
+    expand_t x = { sh, ln, &f, { NULL, 0, 0 }, 0, 0 };
+    int r = expand_word(&x, e, NULL);
+    for (int k = 0; k < f.n; ++k) {
+        sb_putn(out, " ", 1);
+        quote_into(out, f.v[k]);
+        free(f.v[k]);
+    }
+    free(f.v);
+    return r;
+}
+
+/* Expand an assignment word into the quoted form assign_word() reads:
+   name['sub']+='value' or name=( 'v' ['k']='v' ...) */
+static char *expand_assign(msh_t *sh, const msh_line_t *ln, const char *word) {
+    size_t plen = assign_len(word);
+    const char *eq = word + plen - 1;
+    int append = eq[-1] == '+';
+    const char *lhs_end = eq - append;
+    const char *br = memchr(word, '[', lhs_end - word);
+    strbuf_t out = { NULL, 0, 0 };
+    sb_putn(&out, word, (br ? br : lhs_end) - word);
+    if (br) {
+        char *raw = strndup(br + 1, lhs_end - br - 2);
+        char *key = raw ? expand_join(sh, ln, raw, NULL) : NULL;
+        free(raw);
+        if (!key) goto fail;
+        sb_putn(&out, "[", 1);
+        quote_into(&out, key);
+        sb_putn(&out, "]", 1);
+        free(key);
+    }
+    sb_putn(&out, append ? "+=" : "=", append + 1);
+
+    const char *v = eq + 1;
+    size_t vlen = strlen(v);
+    if (!br && v[0] == '(' && vlen >= 2 && v[vlen-1] == ')') {
+        /* compound value: elements split on blanks outside quotes */
+        sb_putn(&out, "(", 1);
+        const char *e = v + 1, *stop = v + vlen - 1;
+        for (;;) {
+            while (e < stop && (*e == ' ' || *e == '\t' || *e == '\n')) e++;
+            if (e >= stop) break;
+            const char *start = e;
+            char q = 0;
+            for (; e < stop && (q || (*e != ' ' && *e != '\t' && *e != '\n')); e++) {
+                if (!q && (*e == '\'' || *e == '"')) q = *e;
+                else if (q && *e == q) q = 0;
+            }
+            char *elem = strndup(start, e - start);
+            int r = elem ? expand_element(sh, ln, elem, &out) : -1;
+            free(elem);
+            if (r < 0) goto fail;
+        }
+        sb_putn(&out, " )", 2);
+        return out.s;
+    }
+    char *val = expand_join(sh, ln, v, NULL);
+    if (!val) goto fail;
+    quote_into(&out, val);
+    free(val);
+    return out.s;
+fail:
+    free(out.s);
+    return NULL;
+}
+
+/* Characters to escape in a quoted right-hand side of a [[ ]] operator:
+   glob characters for == and !=, regex ones for =~ */
+static const char *cond_special(const char *op) {
+    if (strcmp(op, "==") == 0 || strcmp(op, "=") == 0 || strcmp(op, "!=") == 0) return "\\*?[]";
+    if (strcmp(op, "=~") == 0) return "\\.[]()*+?{}|^$";
+    return NULL;
+}
+
+void free_expanded(cmd_t *cmds, int ncmds) {
+    for (int i = 0; i < ncmds; ++i) {
+        for (int j = 0; cmds[i].argv && cmds[i].argv[j]; ++j) free(cmds[i].argv[j]);
+        free(cmds[i].argv);
+        free(cmds[i].infile);
+        free(cmds[i].outfile);
+        for (int k = 0; k < cmds[i].nredirs; ++k) free(cmds[i].redirs[k].target);
+    }
+}
+
+/* command [-p] name args runs name itself: drop the command words so the
+   lookup below sees name. command -v and -V stay the builtin. */
+static void strip_command(cmd_t *c) {
+    int k = 0;
+    while (c->argv[k] && strcmp(c->argv[k], "command") == 0) {
+        int j = k + 1, defpath = 0;
+        while (c->argv[j] && strcmp(c->argv[j], "-p") == 0) { defpath = 1; j++; }
+        if (c->argv[j] && strcmp(c->argv[j], "--") == 0) j++;
+        if (!c->argv[j] || c->argv[j][0] == '-') break;
+        c->defpath |= defpath;
+        k = j;
+    }
+    if (!k) return;
+    for (int j = 0; j < k; ++j) free(c->argv[j]);
+    int n = k;
+    while (c->argv[n]) n++;
+    memmove(c->argv, c->argv + k, (n - k + 1) * sizeof(c->argv[0]));
+}
+
+/* Fill out[] with the line's pipeline, every word expanded. Assignments,
+   alone or as arguments of declare, are passed on quoted for
+   assign_word(). Returns -1 if expansion failed; out[] then holds nothing
+   to free. */
+int expand_cmds(msh_t *sh, const msh_line_t *ln, cmd_t *out) {
+    for (int i = 0; i < ln->ncmds; ++i) {
+        const cmd_t *c = &ln->cmds[i];
+        int cond = c->argv[0] && strcmp(c->argv[0], "[[") == 0;
+        int decl = c->argv[0] && strcmp(c->argv[0], "declare") == 0;
+        out[i] = *c;
+        /* nothing in out[i] may point into the script: on failure it is freed */
+        out[i].infile = out[i].outfile = NULL;
+        out[i].argv = NULL;
+        for (int k = 0; k < c->nredirs; ++k) out[i].redirs[k].target = NULL;
+        fields_t f = { NULL, 0, 0 };
+        expand_t x = { sh, ln, &f, { NULL, 0, 0 }, 0, 0 };
+        for (int j = 0; c->argv[j]; ++j) {
+            char *w;
+            if ((c->assign || (decl && j > 0)) && assign_len(c->argv[j])) {
+                if (!(w = expand_assign(sh, ln, c->argv[j])) || fields_push(sh, &f, w) < 0) goto fail;
+            } else if (cond) {
+                /* [[ ]] operands stay single words */
+                const char *special = j > 1 ? cond_special(c->argv[j-1]) : NULL;
+                if (!(w = expand_join(sh, ln, c->argv[j], special)) || fields_push(sh, &f, w) < 0) goto fail;
+            } else if (expand_word(&x, c->argv[j], NULL) < 0) {
+                goto fail;
+            }
+        }
+        /* argv holds what the words expanded to, and no more */
+        if (!f.v && !(f.v = calloc(1, sizeof(char *)))) { msh_perror(sh, sh->script_name); goto fail; }
+        out[i].argv = f.cap > f.n + 1 ? realloc(f.v, (f.n + 1) * sizeof(char *)) : f.v;
+        if (!out[i].argv) out[i].argv = f.v;
+        if (c->infile && !(out[i].infile = expand_join(sh, ln, c->infile, NULL))) goto fail;
+        if (c->outfile && !(out[i].outfile = expand_join(sh, ln, c->outfile, NULL))) goto fail;
+        for (int k = 0; k < c->nredirs; ++k)
+            if (!(out[i].redirs[k].target = expand_join(sh, ln, c->redirs[k].target, NULL))) goto fail;
+        strip_command(&out[i]);
+        /* the only builtin lookup for this command */
+        if (c->assign) out[i].builtin = &assign_builtin;
+        else out[i].builtin = out[i].argv[0] ? builtin_lookup(sh, out[i].argv[0]) : NULL;
+        continue;
+    fail:
+        if (!out[i].argv) out[i].argv = f.v;
+        free_expanded(out, i + 1);
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_line(msh_t *sh, msh_script_t *sc, const char *text, size_t len, int lineno) {
+    char *line = strndup(text, len);
+    if (!line) return -1;
+    char *trim = line;
+    while (*trim == ' ' || *trim == '\t') trim++;
+
+    token_t *tokens;
+    int ntok = tokenize(trim, &tokens);
+    if (ntok <= 0) {
+        free(line);
+        if (ntok == 0) free(tokens);
+        return ntok;
+    }
+
+    msh_line_t ln = { 0 };
+    ln.lineno = lineno;
+    ln.text = strdup(trim);
+    free(line);
+    ln.ntok = ntok;
+    ln.tokens = tokens;
+    if (!ln.text) { free_tokens(tokens, ntok); free(tokens); return -1; }
+
+    const char *saved = sh->script_name;
+    sh->script_name = sc->name;
+    if (parse_commands(sh, ln.tokens, ntok, &ln.cmds, &ln.ncmds, &ln.background) < 0) {
+        msh_error(sh, "%s:%d: syntax error", sc->name, lineno);
+        ln.bad = 1;
+        sc->nerrors++;
+    }
+    sh->script_name = saved;
+
+    if (sc->nlines % 64 == 0) {
+        msh_line_t *nl = realloc(sc->lines, (sc->nlines + 64) * sizeof(*nl));
+        if (!nl) { free(ln.text); free_tokens(ln.tokens, ntok); free(ln.tokens); free_parsed(ln.cmds, ln.ncmds); return -1; }
+        sc->lines = nl;
+    }
+    sc->lines[sc->nlines++] = ln;
+    return 0;
+}
+
+/* Parse src as lines numbered from first_line */
+msh_script_t *parse_text(msh_t *sh, const char *src, size_t len, const char *name, int first_line) {
+    msh_script_t *sc = calloc(1, sizeof(*sc));
+    if (!sc || !(sc->name = strdup(name ? name : "myshell"))) { free(sc); return NULL; }
+    int lineno = first_line - 1;
+    size_t off = 0;
+    while (off < len) {
+        const char *nl = memchr(src + off, '\n', len - off);
+        size_t end = nl ? (size_t)(nl - src) : len;
+        if (parse_line(sh, sc, src + off, end - off, ++lineno) < 0) {
+            msh_perror(sh, "parse");
+            msh_script_free(sc);
+            return NULL;
+        }
+        off = end + 1;
+    }
+    return sc;
+}
+
+msh_script_t *msh_parse(msh_t *sh, const char *src, size_t len, const char *name) {
+    return parse_text(sh, src, len, name, 1);
+}
+
+msh_script_t *msh_parse_file(msh_t *sh, const char *path) {
+    int fd = msh_open(sh, path, O_RDONLY, 0);
+    if (fd < 0) { msh_perror(sh, path); return NULL; }
+    struct stat st;
+    char *buf = NULL;
+    size_t len = 0, cap = 0;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) cap = st.st_size + 1;
+    for (;;) {
+        if (len + 4096 > cap) cap = cap ? cap * 2 : 8192;
+        char *nb = realloc(buf, cap);
+        if (!nb) { free(buf); close(fd); msh_perror(sh, path); return NULL; }
+        buf = nb;
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) { msh_perror(sh, path); free(buf); close(fd); return NULL; }
+        if (n == 0) break;
+        len += n;
+    }
+    close(fd);
+    msh_script_t *sc = msh_parse(sh, buf, len, path);
+    free(buf);
+    return sc;
+}
+
+int msh_script_errors(const msh_script_t *script) {
+    return script->nerrors;
+}
+
+void msh_script_free(msh_script_t *script) {
+    if (!script) return;
+    for (int i = 0; i < script->nlines; ++i) {
+        msh_line_t *ln = &script->lines[i];
+        free_tokens(ln->tokens, ln->ntok);
+        free(ln->tokens);
+        free_parsed(ln->cmds, ln->ncmds);
+        free(ln->text);
+    }
+    free(script->lines);
+    free(script->name);
+    free(script);
+}
+
+/* Bytes held by a parsed script: lines, their tokens and pipelines */
+size_t script_mem(const msh_script_t *script) {
+    if (!script) return 0;
+    size_t n = sizeof(*script) + strlen(script->name) + 1 +
+               (script->nlines + 63) / 64 * 64 * sizeof(msh_line_t);
+    for (int i = 0; i < script->nlines; ++i) {
+        const msh_line_t *ln = &script->lines[i];
+        n += strlen(ln->text) + 1 + (ln->ntok + 1) * sizeof(token_t) + ln->ncmds * sizeof(cmd_t);
+        for (int k = 0; k < ln->ntok; ++k) n += strlen(ln->tokens[k].text) + 1;
+        for (int k = 0; k < ln->ncmds; ++k) {
+            int argc = 0;
+            while (ln->cmds[k].argv[argc]) argc++;
+            n += (argc + 1) * sizeof(char *);
+        }
+    }
+    return n;
+}
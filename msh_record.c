@@ -0,0 +1,362 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "msh_internal.h"
+
+/* record file: log the lines the user runs, what they print and how long
+   they take; replay file shows the session again or reruns it.
+
+   Recording costs the shell a copy into a buffer: a thread writes the
+   buffer out once it holds REC_FLUSH bytes or every REC_PERIOD_MS. Output
+   is taken from the foreground capture pipes (on_output), so while
+   recording, commands write to a pipe that the shell copies on to out_fd.
+
+   The file is a header then events, each a type byte and the microseconds
+   since the previous event as a varint, then:
+     'L' input line      varint length, bytes
+     'O' output          varint length, bytes
+     'S' line finished   varint status, varint microseconds it took */
+#define REC_MAGIC     "MSHREC\0\1"
+#define REC_FLUSH     65536
+#define REC_PERIOD_MS 100
+
+struct recorder {
+    char *file;
+    int fd;
+    pid_t owner;               /* children never record */
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    strbuf_t buf;              /* events not written yet */
+    int stop;
+    int failed;                /* a write failed; errno in err */
+    int err;
+    uint64_t written;
+    uint64_t last;             /* time of the previous event, us */
+    uint64_t line_start;       /* 0: no line running */
+    msh_output_fn prev_out;
+    void *prev_ud;
+};
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void put_varint(strbuf_t *b, uint64_t v) {
+    char tmp[10];
+    size_t n = 0;
+    do {
+        tmp[n++] = (v & 0x7f) | (v > 0x7f ? 0x80 : 0);
+        v >>= 7;
+    } while (v);
+    sb_putn(b, tmp, n);
+}
+
+static void *rec_thread(void *arg) {
+    struct recorder *r = arg;
+    strbuf_t out = { 0 };
+    pthread_mutex_lock(&r->lock);
+    for (;;) {
+        if (r->buf.len < REC_FLUSH && !r->stop) {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += REC_PERIOD_MS * 1000000L;
+            if (until.tv_nsec >= 1000000000L) { until.tv_sec++; until.tv_nsec -= 1000000000L; }
+            pthread_cond_timedwait(&r->wake, &r->lock, &until);
+        }
+        int stop = r->stop;
+        /* take the buffer and write it without holding the lock */
+        strbuf_t full = r->buf;
+        r->buf = out;
+        r->buf.len = 0;
+        pthread_mutex_unlock(&r->lock);
+        size_t off = 0;
+        while (off < full.len) {
+            ssize_t n = write(r->fd, full.s + off, full.len - off);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) { r->failed = 1; r->err = errno; break; }
+            off += n;
+        }
+        out = full;
+        pthread_mutex_lock(&r->lock);
+        r->written += off;
+        if (stop) break;
+    }
+    pthread_mutex_unlock(&r->lock);
+    free(out.s);
+    return NULL;
+}
+
+/* Append an event: its type, then the time since the last one */
+static int rec_begin(struct recorder *r, int type) {
+    if (r->owner != getpid()) return -1;
+    pthread_mutex_lock(&r->lock);
+    uint64_t t = now_us();
+    char c = type;
+    sb_putn(&r->buf, &c, 1);
+    put_varint(&r->buf, t - r->last);
+    r->last = t;
+    return 0;
+}
+
+static void rec_end(struct recorder *r) {
+    if (r->buf.len >= REC_FLUSH) pthread_cond_signal(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static void rec_bytes(struct recorder *r, int type, const char *s, size_t n) {
+    if (rec_begin(r, type) < 0) return;
+    put_varint(&r->buf, n);
+    sb_putn(&r->buf, s, n);
+    rec_end(r);
+}
+
+/* on_output while recording: pass it on, and keep a copy */
+static void rec_output(void *ud, const char *data, size_t len) {
+    msh_t *sh = ud;
+    struct recorder *r = sh->rec;
+    if (r->prev_out) {
+        r->prev_out(r->prev_ud, data, len);
+    } else {
+        size_t off = 0;
+        while (off < len) {
+            ssize_t n = write(sh->out_fd, data + off, len - off);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            off += n;
+        }
+    }
+    rec_bytes(r, 'O', data, len);
+}
+
+void rec_line(msh_t *sh, const char *line) {
+    struct recorder *r = sh->rec;
+    if (!r) return;
+    rec_bytes(r, 'L', line, strlen(line));
+    r->line_start = now_us();
+}
+
+void rec_status(msh_t *sh, int status) {
+    struct recorder *r = sh->rec;
+    if (!r || !r->line_start || rec_begin(r, 'S') < 0) return;
+    put_varint(&r->buf, (unsigned)status);
+    put_varint(&r->buf, now_us() - r->line_start);
+    r->line_start = 0;
+    rec_end(r);
+}
+
+static int rec_start(msh_t *sh, const char *file) {
+    struct recorder *r = calloc(1, sizeof(*r));
+    if (!r || !(r->file = strdup(file))) { free(r); msh_perror(sh, "record"); return 1; }
+    r->fd = msh_open(sh, file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (r->fd < 0) {
+        msh_perror(sh, file);
+        free(r->file);
+        free(r);
+        return 1;
+    }
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    uint64_t start = (uint64_t)wall.tv_sec * 1000000 + wall.tv_nsec / 1000;
+    sb_putn(&r->buf, REC_MAGIC, 8);
+    sb_putn(&r->buf, (const char *)&start, sizeof(start));
+    r->owner = getpid();
+    r->last = now_us();
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->wake, NULL);
+    /* signals stay with the shell's thread: SIGCHLD must not reap there */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int failed = pthread_create(&r->thread, NULL, rec_thread, r);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (failed) {
+        msh_error(sh, "record: cannot start the writer thread");
+        pthread_mutex_destroy(&r->lock);
+        pthread_cond_destroy(&r->wake);
+        close(r->fd);
+        free(r->buf.s);
+        free(r->file);
+        free(r);
+        return 1;
+    }
+    r->prev_out = sh->on_output;
+    r->prev_ud = sh->userdata;
+    sh->on_output = rec_output;
+    sh->userdata = sh;
+    sh->rec = r;
+    return 0;
+}
+
+/* Stop recording and write out what is left */
+int rec_stop(msh_t *sh) {
+    struct recorder *r = sh->rec;
+    if (!r) return 0;
+    if (r->owner != getpid()) { sh->rec = NULL; return 0; }
+    pthread_mutex_lock(&r->lock);
+    r->stop = 1;
+    pthread_cond_signal(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->thread, NULL);
+    if (sh->on_output == rec_output) {
+        sh->on_output = r->prev_out;
+        sh->userdata = r->prev_ud;
+    }
+    int status = 0;
+    if (r->failed) {
+        errno = r->err;
+        msh_perror(sh, r->file);
+        status = 1;
+    }
+    if (close(r->fd) < 0 && !status) { msh_perror(sh, r->file); status = 1; }
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->wake);
+    free(r->buf.s);
+    free(r->file);
+    free(r);
+    sh->rec = NULL;
+    return status;
+}
+
+size_t rec_mem(msh_t *sh) {
+    struct recorder *r = sh->rec;
+    if (!r) return 0;
+    pthread_mutex_lock(&r->lock);
+    size_t n = sizeof(*r) + strlen(r->file) + 1 + r->buf.cap;
+    pthread_mutex_unlock(&r->lock);
+    return n;
+}
+
+/* record file | record -s | record */
+int record_command(msh_t *sh, char **argv) {
+    if (!argv[1]) {
+        struct recorder *r = sh->rec;
+        if (!r) { bi_printf(sh, "not recording\n"); return 1; }
+        pthread_mutex_lock(&r->lock);
+        uint64_t bytes = r->written + r->buf.len;
+        pthread_mutex_unlock(&r->lock);
+        bi_printf(sh, "recording to %s, %llu bytes\n", r->file, (unsigned long long)bytes);
+        return 0;
+    }
+    if (strcmp(argv[1], "-s") == 0 && !argv[2]) return rec_stop(sh);
+    if (argv[2] || argv[1][0] == '-') {
+        msh_error(sh, "record: usage: record [-s | file]");
+        return 2;
+    }
+    if (sh->rec) { msh_error(sh, "record: already recording to %s", sh->rec->file); return 1; }
+    return rec_start(sh, argv[1]);
+}
+
+/* Reading a recording */
+
+typedef struct {
+    const unsigned char *p, *end;
+} rec_reader_t;
+
+static int get_varint(rec_reader_t *rd, uint64_t *v) {
+    *v = 0;
+    for (int shift = 0; rd->p < rd->end && shift < 64; shift += 7) {
+        unsigned char c = *rd->p++;
+        *v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return 0;
+    }
+    return -1;
+}
+
+static void sleep_us(uint64_t us) {
+    struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) ;
+}
+
+/* replay [-x] [-n] file: show the session as it happened, or with -x run
+   its lines again and compare their times. -n skips the pauses. */
+int replay_command(msh_t *sh, char **argv) {
+    int rerun = 0, nodelay = 0, i = 1;
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; ++i) {
+        for (const char *f = argv[i] + 1; *f; ++f) {
+            if (*f == 'x') rerun = 1;
+            else if (*f == 'n') nodelay = 1;
+            else { msh_error(sh, "replay: usage: replay [-xn] file"); return 2; }
+        }
+    }
+    if (!argv[i] || argv[i + 1]) { msh_error(sh, "replay: usage: replay [-xn] file"); return 2; }
+    const char *file = argv[i];
+    int fd = msh_open(sh, file, O_RDONLY | O_CLOEXEC, 0);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        msh_perror(sh, file);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    if ((size_t)st.st_size < 16) {
+        close(fd);
+        msh_error(sh, "replay: %s: not a recording", file);
+        return 1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { msh_perror(sh, file); return 1; }
+    rec_reader_t rd = { (const unsigned char *)map + 16, (const unsigned char *)map + st.st_size };
+    if (memcmp(map, REC_MAGIC, 8) != 0) {
+        munmap(map, st.st_size);
+        msh_error(sh, "replay: %s: not a recording", file);
+        return 1;
+    }
+    int status = 0, lineno = 0, ran = 0;
+    uint64_t started = 0;
+    char *line = NULL;
+    while (rd.p < rd.end && !sh->exiting) {
+        int type = *rd.p++;
+        uint64_t dt, a, b;
+        if (get_varint(&rd, &dt) < 0 || get_varint(&rd, &a) < 0) break;
+        if (type == 'S') {
+            if (get_varint(&rd, &b) < 0) break;
+            if (rerun && line && ran) {
+                double now = (now_us() - started) / 1000.0;
+                msh_flush(sh);
+                msh_error(sh, "replay: line %d: %.1fms, recorded %.1fms%s", lineno, now, b / 1000.0,
+                          (unsigned)msh_status(sh) != a ? ", status differs" : "");
+            }
+            free(line);
+            line = NULL;
+            continue;
+        }
+        if (a > (uint64_t)(rd.end - rd.p)) break;
+        const char *s = (const char *)rd.p;
+        rd.p += a;
+        if (!rerun && !nodelay) sleep_us(dt);
+        if (type == 'L') {
+            free(line);
+            line = strndup(s, a);
+            lineno++;
+            ran = 0;
+            if (!rerun) {
+                bi_printf(sh, "$ %s\n", line);
+            } else if (line && strncmp(line, "record", 6) != 0 && strncmp(line, "replay", 6) != 0) {
+                /* recording commands are not run again */
+                started = now_us();
+                ran = 1;
+                msh_run_line(sh, line);
+                status = msh_status(sh);
+            }
+        } else if (type == 'O' && !rerun) {
+            if (bi_write(sh, s, a) < 0) break;
+        }
+    }
+    if (rd.p < rd.end && !sh->exiting) {
+        msh_error(sh, "replay: %s: truncated recording", file);
+        status = 1;
+    }
+    free(line);
+    munmap(map, st.st_size);
+    return status;
+}
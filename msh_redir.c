@@ -0,0 +1,132 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+
+#include "msh_internal.h"
+
+/* Redirections beyond a command's plain < and >: [n]< [n]> [n]>> and the
+   [n]<& [n]>& duplications, and the shell's own fds set by exec. The
+   shell's 0, 1 and 2 are in_fd, out_fd and err_fd; fds 3-9 opened by exec
+   are kept at 10 and above, close-on-exec, and placed at their numbers
+   only in children. An embedding process's fds are never disturbed. */
+
+/* The fd a script's n stands for in the shell, or -1 if it is not open */
+int shell_fd(msh_t *sh, int n) {
+    if (n == 0) return sh->in_fd;
+    if (n == 1) return sh->out_fd;
+    if (n == 2) return sh->err_fd;
+    return n < SHELL_FDS ? sh->fds[n] : -1;
+}
+
+/* Make the shell's n refer to fd, which the shell now owns (-1: closed).
+   Whatever n referred to before is closed if the shell opened it. */
+void shell_fd_set(msh_t *sh, int n, int fd) {
+    int *slot = n == 0 ? &sh->in_fd : n == 1 ? &sh->out_fd : n == 2 ? &sh->err_fd : &sh->fds[n];
+    /* trace already buffered belongs to the fd it was written for */
+    if (sh->xtrace_len) xtrace_flush(sh);
+    if ((sh->fd_owned & (1u << n)) && *slot >= 0 && *slot != fd) close(*slot);
+    *slot = fd;
+    if (fd >= 0) sh->fd_owned |= 1u << n;
+    else sh->fd_owned &= ~(1u << n);
+}
+
+/* The standalone shell's 3-9 are whatever its parent left open there, as
+   in any POSIX shell: `myshell s.sh 3>log` lets s.sh write to 3. They are
+   moved up like the ones exec opens. Library contexts never call this. */
+void msh_adopt_fds(msh_t *sh) {
+    for (int n = 3; n < SHELL_FDS; ++n) {
+        if (sh->fds[n] >= 0 || fcntl(n, F_GETFD) < 0) continue;
+        int fd = fcntl(n, F_DUPFD_CLOEXEC, SHELL_FDS);
+        if (fd < 0) continue;
+        close(n);
+        shell_fd_set(sh, n, fd);
+    }
+}
+
+void shell_fds_close(msh_t *sh) {
+    for (int n = 0; n < SHELL_FDS; ++n)
+        if (sh->fd_owned & (1u << n)) shell_fd_set(sh, n, -1);
+}
+
+/* Open the file of an [n]< [n]> or [n]>> redirection */
+int redir_open(msh_t *sh, const redir_t *r) {
+    int flags = r->op == REDIR_IN ? O_RDONLY : O_CREAT | O_WRONLY | (r->op == REDIR_APPEND ? O_APPEND : O_TRUNC);
+    if (r->op != REDIR_IN) stat_cache_clear(sh);
+    int fd = msh_open(sh, r->target, flags | O_CLOEXEC, 0644);
+    if (fd < 0) msh_perror(sh, r->target);
+    return fd;
+}
+
+/* The fd number an [n]>& duplicates into *src, or -1 for >&- */
+int redir_dup_src(msh_t *sh, const redir_t *r, int *src) {
+    const char *t = r->target;
+    if (strcmp(t, "-") == 0) { *src = -1; return 0; }
+    if (t[0] < '0' || t[0] > '9' || t[1] || (t[0] >= '3' && shell_fd(sh, t[0] - '0') < 0)) {
+        msh_error(sh, "%s: bad file descriptor", t);
+        return -1;
+    }
+    *src = t[0] - '0';
+    return 0;
+}
+
+static int check_fd(msh_t *sh, const redir_t *r) {
+    if (r->fd < SHELL_FDS) return 0;
+    msh_error(sh, "%d: bad file descriptor", r->fd);
+    return -1;
+}
+
+/* In a child: put the shell's fds 3-9 at their numbers */
+void redir_install_fds(msh_t *sh) {
+    for (int n = 3; n < SHELL_FDS; ++n)
+        if (sh->fds[n] >= 0) dup2(sh->fds[n], n);
+}
+
+/* Apply c's redirections to this process's own fds, for an external
+   command about to exec. Returns -1 after reporting a failure. */
+int redir_apply(msh_t *sh, const cmd_t *c) {
+    for (int k = 0; k < c->nredirs; ++k) {
+        const redir_t *r = &c->redirs[k];
+        int src;
+        if (check_fd(sh, r) < 0) return -1;
+        if (r->op == REDIR_DUP) {
+            if (redir_dup_src(sh, r, &src) < 0) return -1;
+            if (src < 0) close(r->fd);
+            else if (src != r->fd && dup2(src, r->fd) < 0) { msh_perror(sh, r->target); return -1; }
+            continue;
+        }
+        int fd = redir_open(sh, r);
+        if (fd < 0) return -1;
+        if (dup2(fd, r->fd) < 0) { msh_perror(sh, r->target); close(fd); return -1; }
+        close(fd);
+    }
+    return 0;
+}
+
+/* exec with no command: make c's redirections the shell's own, for every
+   command that follows */
+int redir_shell(msh_t *sh, const cmd_t *c) {
+    redir_t plain[2];
+    int n = 0;
+    if (c->infile) plain[n++] = (redir_t){ 0, REDIR_IN, c->infile };
+    if (c->outfile) plain[n++] = (redir_t){ 1, c->append ? REDIR_APPEND : REDIR_OUT, c->outfile };
+    for (int k = 0; k < n + c->nredirs; ++k) {
+        const redir_t *r = k < n ? &plain[k] : &c->redirs[k - n];
+        int fd;
+        if (check_fd(sh, r) < 0) return 1;
+        if (r->op == REDIR_DUP) {
+            int src;
+            if (redir_dup_src(sh, r, &src) < 0) return 1;
+            if (src < 0) { shell_fd_set(sh, r->fd, -1); continue; }
+            if (src == r->fd) continue;
+            fd = fcntl(shell_fd(sh, src), F_DUPFD_CLOEXEC, SHELL_FDS);
+        } else {
+            int opened = redir_open(sh, r);
+            if (opened < 0) return 1;
+            /* keep it clear of the numbers children use */
+            fd = fcntl(opened, F_DUPFD_CLOEXEC, SHELL_FDS);
+            close(opened);
+        }
+        if (fd < 0) { msh_perror(sh, r->target); return 1; }
+        shell_fd_set(sh, r->fd, fd);
+    }
+    return 0;
+}
@@ -0,0 +1,189 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "msh_internal.h"
+
+/* Scripts read by source and . stay parsed for the whole session, keyed by
+   path and inode and checked against the file's size and mtime, so a
+   library sourced in a loop is read and parsed once. An entry whose file
+   changed is reparsed; one still running (a file that sources itself) is
+   kept until it finishes. */
+#define SOURCE_CACHE_MAX 32
+#define SOURCE_DEPTH_MAX 100
+
+typedef struct source_entry {
+    struct source_entry *next;
+    char *path;           /* joined with the shell cwd */
+    size_t hash;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    msh_script_t *script;
+    int running;          /* nested runs of script */
+    int stale;            /* file changed while running: free when done */
+} source_entry_t;
+
+struct source_cache {
+    source_entry_t *head; /* most recently used first */
+    int n;
+    int depth;
+};
+
+static void entry_free(source_entry_t *e) {
+    msh_script_free(e->script);
+    free(e->path);
+    free(e);
+}
+
+static void entry_unlink(struct source_cache *c, source_entry_t *e) {
+    for (source_entry_t **p = &c->head; *p; p = &(*p)->next) {
+        if (*p == e) { *p = e->next; c->n--; return; }
+    }
+}
+
+/* Drop the least recently used idle entry once the cache is full */
+static void source_evict(struct source_cache *c) {
+    if (c->n < SOURCE_CACHE_MAX) return;
+    source_entry_t *victim = NULL;
+    for (source_entry_t *e = c->head; e; e = e->next)
+        if (!e->running) victim = e;
+    if (victim) {
+        entry_unlink(c, victim);
+        entry_free(victim);
+    }
+}
+
+void source_cache_free(msh_t *sh) {
+    struct source_cache *c = sh->source_cache;
+    if (!c) return;
+    while (c->head) {
+        source_entry_t *e = c->head;
+        c->head = e->next;
+        entry_free(e);
+    }
+    free(c);
+    sh->source_cache = NULL;
+}
+
+size_t source_cache_mem(msh_t *sh) {
+    struct source_cache *c = sh->source_cache;
+    if (!c) return 0;
+    size_t n = sizeof(*c);
+    for (source_entry_t *e = c->head; e; e = e->next)
+        n += sizeof(*e) + strlen(e->path) + 1 + script_mem(e->script);
+    return n;
+}
+
+/* A name without a slash is looked for in PATH, then in the current
+   directory; unlike commands it need not be executable */
+static const char *source_path(msh_t *sh, const char *name, char *buf, size_t size) {
+    if (strchr(name, '/')) return name;
+    const char *path = msh_getvar(sh, "PATH");
+    struct stat st;
+    while (path && *path) {
+        const char *end = strchr(path, ':');
+        size_t dlen = end ? (size_t)(end - path) : strlen(path);
+        if (dlen) {
+            char full[4096], tmp[4096];
+            snprintf(full, sizeof(full), "%.*s/%s", (int)dlen, path, name);
+            const char *p = msh_path(sh, full, tmp, sizeof(tmp));
+            if (p && stat(p, &st) == 0 && S_ISREG(st.st_mode)) {
+                snprintf(buf, size, "%s", full);
+                return buf;
+            }
+        }
+        if (!end) break;
+        path = end + 1;
+    }
+    return name;
+}
+
+static int same_file(const source_entry_t *e, const struct stat *st) {
+    return e->dev == st->st_dev && e->ino == st->st_ino && e->size == st->st_size &&
+           e->mtime.tv_sec == st->st_mtim.tv_sec && e->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/* The cached script for path, parsed again if the file changed */
+static source_entry_t *source_lookup(msh_t *sh, struct source_cache *c, const char *path) {
+    char buf[4096];
+    const char *full = msh_path(sh, path, buf, sizeof(buf));
+    struct stat st;
+    if (!full || stat(full, &st) < 0) { msh_perror(sh, path); return NULL; }
+    if (!S_ISREG(st.st_mode)) {
+        msh_error(sh, "%s: not a regular file", path);
+        return NULL;
+    }
+    /* the same file under another name is the same entry; a name whose
+       file was replaced is dropped */
+    size_t h = str_hash(full);
+    for (source_entry_t *e = c->head; e; e = e->next) {
+        if (e->stale) continue;
+        int same_inode = e->dev == st.st_dev && e->ino == st.st_ino;
+        if (!same_inode && (e->hash != h || strcmp(e->path, full) != 0)) continue;
+        if (same_inode && same_file(e, &st)) {
+            sh->stats.source_hits++;
+            /* move to front */
+            entry_unlink(c, e);
+            e->next = c->head;
+            c->head = e;
+            c->n++;
+            return e;
+        }
+        entry_unlink(c, e);
+        if (e->running) e->stale = 1;
+        else entry_free(e);
+        break;
+    }
+
+    sh->stats.source_misses++;
+    source_evict(c);
+    source_entry_t *e = calloc(1, sizeof(*e));
+    if (!e || !(e->path = strdup(full))) {
+        free(e);
+        msh_perror(sh, "source");
+        return NULL;
+    }
+    if (!(e->script = msh_parse_file(sh, path))) {
+        free(e->path);
+        free(e);
+        return NULL;
+    }
+    e->hash = h;
+    e->dev = st.st_dev;
+    e->ino = st.st_ino;
+    e->size = st.st_size;
+    e->mtime = st.st_mtim;
+    e->next = c->head;
+    c->head = e;
+    c->n++;
+    return e;
+}
+
+/* Run the script at name in the current shell. Returns its status. */
+int source_file(msh_t *sh, const char *name) {
+    struct source_cache *c = sh->source_cache;
+    if (!c && !(c = sh->source_cache = calloc(1, sizeof(*c)))) {
+        msh_perror(sh, "source");
+        return 1;
+    }
+    /* a pipeline stage has a smaller stack than the shell */
+    if (c->depth >= SOURCE_DEPTH_MAX || co_stack_low(sh)) {
+        msh_error(sh, "source: %s: maximum nesting depth exceeded", name);
+        return 1;
+    }
+    char buf[4096];
+    source_entry_t *e = source_lookup(sh, c, source_path(sh, name, buf, sizeof(buf)));
+    if (!e) return 1;
+    int saved_lineno = sh->lineno;
+    sh->last_status = 0;
+    e->running++;
+    c->depth++;
+    int status = run_script(sh, e->script);
+    c->depth--;
+    e->running--;
+    sh->lineno = saved_lineno;
+    if (e->stale && !e->running) entry_free(e);
+    return status;
+}
@@ -0,0 +1,116 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "msh_internal.h"
+
+/* Short-lived cache of stat, lstat and access results for the file tests.
+   `[ -e f ]`, `[ -f f ]` and `[ -r f ]` on the same file cost one stat.
+   It is scoped to one line, and within a line anything that may change
+   the file system empties it: starting an external command, opening a
+   file for writing, cd or a loaded builtin. While background jobs are
+   running, nothing is cached. */
+#define STAT_CACHE_SIZE 256 /* slots; emptied when half full */
+
+typedef struct {
+    char *path;            /* NULL: empty slot */
+    size_t hash;
+    int st_err, lst_err;   /* 0 or errno once known; -1 unknown */
+    struct stat st, lst;
+    unsigned char acc_known, acc_ok; /* R_OK, W_OK, X_OK bits */
+} stat_entry_t;
+
+struct stat_cache {
+    stat_entry_t slots[STAT_CACHE_SIZE];
+    size_t used;
+};
+
+void stat_cache_clear(msh_t *sh) {
+    struct stat_cache *c = sh->stat_cache;
+    if (!c || !c->used) return;
+    for (size_t i = 0; i < STAT_CACHE_SIZE; ++i) {
+        free(c->slots[i].path);
+        c->slots[i].path = NULL;
+    }
+    c->used = 0;
+    sh->stats.stat_flushes++;
+}
+
+void stat_cache_free(msh_t *sh) {
+    stat_cache_clear(sh);
+    free(sh->stat_cache);
+    sh->stat_cache = NULL;
+}
+
+size_t stat_cache_mem(msh_t *sh) {
+    struct stat_cache *c = sh->stat_cache;
+    if (!c) return 0;
+    size_t n = sizeof(*c);
+    for (size_t i = 0; i < STAT_CACHE_SIZE; ++i)
+        if (c->slots[i].path) n += strlen(c->slots[i].path) + 1;
+    return n;
+}
+
+/* The entry for an absolute or cwd-joined path, added if missing; NULL
+   when caching is off or memory is short */
+static stat_entry_t *stat_entry(msh_t *sh, const char *path) {
+    if (sh->njobs) return NULL;
+    struct stat_cache *c = sh->stat_cache;
+    if (!c && !(c = sh->stat_cache = calloc(1, sizeof(*c)))) return NULL;
+    size_t h = str_hash(path);
+    size_t i = h & (STAT_CACHE_SIZE - 1);
+    while (c->slots[i].path) {
+        if (c->slots[i].hash == h && strcmp(c->slots[i].path, path) == 0) return &c->slots[i];
+        i = (i + 1) & (STAT_CACHE_SIZE - 1);
+    }
+    if (c->used >= STAT_CACHE_SIZE / 2) {
+        stat_cache_clear(sh);
+        i = h & (STAT_CACHE_SIZE - 1);
+    }
+    stat_entry_t *e = &c->slots[i];
+    if (!(e->path = strdup(path))) return NULL;
+    e->hash = h;
+    e->st_err = e->lst_err = -1;
+    e->acc_known = e->acc_ok = 0;
+    c->used++;
+    return e;
+}
+
+int msh_stat(msh_t *sh, const char *path, struct stat *st, int follow) {
+    char buf[4096];
+    if (!(path = msh_path(sh, path, buf, sizeof(buf)))) return -1;
+    stat_entry_t *e = stat_entry(sh, path);
+    if (!e) return follow ? stat(path, st) : lstat(path, st);
+    int *err = follow ? &e->st_err : &e->lst_err;
+    struct stat *cached = follow ? &e->st : &e->lst;
+    if (*err < 0) {
+        sh->stats.stat_misses++;
+        *err = (follow ? stat(path, cached) : lstat(path, cached)) == 0 ? 0 : errno;
+    } else {
+        sh->stats.stat_hits++;
+    }
+    if (*err) { errno = *err; return -1; }
+    *st = *cached;
+    return 0;
+}
+
+int msh_access(msh_t *sh, const char *path, int mode) {
+    char buf[4096];
+    if (!(path = msh_path(sh, path, buf, sizeof(buf)))) return -1;
+    stat_entry_t *e = stat_entry(sh, path);
+    if (!e) return access(path, mode);
+    if ((e->acc_known & mode) == mode) {
+        sh->stats.stat_hits++;
+    } else {
+        sh->stats.stat_misses++;
+        static const int bits[] = { R_OK, W_OK, X_OK };
+        for (int k = 0; k < 3; ++k) {
+            int bit = bits[k];
+            if (!(mode & bit) || (e->acc_known & bit)) continue;
+            e->acc_known |= bit;
+            if (access(path, bit) == 0) e->acc_ok |= bit;
+        }
+    }
+    if ((e->acc_ok & mode) != mode) { errno = EACCES; return -1; }
+    return 0;
+}
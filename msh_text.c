@@ -0,0 +1,482 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "msh_internal.h"
+
+/* wc, head and tail: the first stage of many log pipelines. A regular
+   file (or standard input redirected from one) is mapped and scanned for
+   newlines a vector at a time; when the output is a plain fd the chosen
+   range is spliced across without passing through user space, or else
+   copied out with pread. Other input is read in large blocks. */
+
+#define TEXT_BLOCK (1 << 20)
+
+/* One input: mapped when it is a regular file, else read from fd or,
+   for standard input, through bi_read */
+typedef struct {
+    const char *name;
+    int fd;           /* -1 for a memory pipe */
+    int own;          /* fd was opened here */
+    int is_stdin;
+    const char *map;  /* the file from off on, when mapped */
+    size_t len;
+    off_t off;        /* file offset where map starts */
+    void *base;       /* the mapping, page aligned */
+    size_t maplen;
+} text_src_t;
+
+static int src_open(msh_t *sh, const char *cmd, const char *name, text_src_t *s) {
+    memset(s, 0, sizeof(*s));
+    s->name = name;
+    if (!name || strcmp(name, "-") == 0) {
+        s->is_stdin = 1;
+        s->fd = sh->bi_in->mp ? -1 : sh->bi_in->fd;
+    } else {
+        s->fd = msh_open(sh, name, O_RDONLY | O_CLOEXEC, 0);
+        if (s->fd < 0) {
+            msh_error(sh, "%s: %s: %s", cmd, name, strerror(errno));
+            return -1;
+        }
+        s->own = 1;
+    }
+    struct stat st;
+    if (s->fd < 0 || fstat(s->fd, &st) < 0 || !S_ISREG(st.st_mode)) return 0;
+    off_t off = s->is_stdin ? lseek(s->fd, 0, SEEK_CUR) : 0;
+    if (off < 0 || off >= st.st_size) {
+        /* empty: an empty mapping */
+        s->map = "";
+        s->off = off < 0 ? 0 : off;
+        return 0;
+    }
+    off_t start = off & ~(off_t)(sysconf(_SC_PAGESIZE) - 1);
+    s->maplen = st.st_size - start;
+    s->base = mmap(NULL, s->maplen, PROT_READ, MAP_PRIVATE, s->fd, start);
+    if (s->base == MAP_FAILED) { s->base = NULL; return 0; }
+    madvise(s->base, s->maplen, MADV_SEQUENTIAL);
+    s->map = (const char *)s->base + (off - start);
+    s->len = st.st_size - off;
+    s->off = off;
+    return 0;
+}
+
+/* A mapped file truncated while it is scanned, e.g. by log rotation,
+   raises SIGBUS. Scans of a mapping run under a guard that turns this into
+   an error of the command instead of killing the shell. They never yield
+   to another stage, so one guard per thread is enough. */
+typedef struct {
+    sigjmp_buf env;
+    struct sigaction old;
+} map_guard_t;
+
+static __thread map_guard_t *map_guard;
+
+static void map_bus(int sig) {
+    if (map_guard) siglongjmp(map_guard->env, 1);
+    /* not a scan of ours: die as we would have */
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void guard_begin(map_guard_t *g) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = map_bus;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGBUS, &sa, &g->old);
+    map_guard = g;
+}
+
+static void guard_end(map_guard_t *g) {
+    map_guard = NULL;
+    sigaction(SIGBUS, &g->old, NULL);
+}
+
+/* After SIGBUS in a guarded scan */
+static int map_lost(msh_t *sh, const char *cmd, text_src_t *s, map_guard_t *g) {
+    guard_end(g);
+    msh_error(sh, "%s: %s: file truncated while reading", cmd, s->name && !s->is_stdin ? s->name : "-");
+    return -1;
+}
+
+static void src_close(text_src_t *s) {
+    if (s->base) munmap(s->base, s->maplen);
+    if (s->own) close(s->fd);
+}
+
+static ssize_t src_read(msh_t *sh, text_src_t *s, char *buf, size_t n) {
+    if (s->is_stdin) return bi_read(sh, buf, n);
+    ssize_t r;
+    while ((r = read(s->fd, buf, n)) < 0 && errno == EINTR) ;
+    return r;
+}
+
+/* Standard input consumed up to off, so the next reader starts there */
+static void src_consumed(text_src_t *s, size_t used) {
+    if (s->is_stdin && s->map) lseek(s->fd, s->off + used, SEEK_SET);
+}
+
+/* Newlines in p[0, n) */
+static size_t count_nl(const char *p, size_t n) {
+    size_t count = 0, i = 0;
+#if defined(__AVX2__)
+    const __m256i nl = _mm256_set1_epi8('\n');
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        count += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)));
+    }
+#elif defined(__SSE2__)
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; i + 64 <= n; i += 64) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), nl);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 16)), nl);
+        __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 32)), nl);
+        __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 48)), nl);
+        unsigned long long m = (unsigned)_mm_movemask_epi8(a) | (unsigned)_mm_movemask_epi8(b) << 16 |
+                               (unsigned long long)_mm_movemask_epi8(c) << 32 |
+                               (unsigned long long)_mm_movemask_epi8(d) << 48;
+        count += __builtin_popcountll(m);
+    }
+#endif
+    for (; i < n; ++i) count += p[i] == '\n';
+    return count;
+}
+
+/* The offset just past the k-th newline in p[0, n), or n if there are
+   fewer; *found counts those seen */
+static size_t skip_lines(const char *p, size_t n, size_t k, size_t *found) {
+    size_t i = 0;
+    *found = 0;
+    while (*found < k && i < n) {
+        const char *q = memchr(p + i, '\n', n - i);
+        if (!q) return n;
+        i = q - p + 1;
+        (*found)++;
+    }
+    return i;
+}
+
+/* Where the last k lines of p[0, n) begin; a final line without a
+   newline counts as a line */
+static size_t last_lines(const char *p, size_t n, size_t k) {
+    if (!k) return n;
+    size_t end = n && p[n - 1] == '\n' ? n - 1 : n;
+    while (end > 0) {
+        const char *q = memrchr(p, '\n', end);
+        if (!q) return 0;
+        if (--k == 0) return q - p + 1;
+        end = q - p;
+    }
+    return 0;
+}
+
+/* Send len bytes of s at map offset at: spliced or sent straight from the
+   file when the output is a plain fd, else copied out with pread, which
+   unlike the mapping just comes up short if the file shrinks meanwhile */
+static int emit(msh_t *sh, text_src_t *s, size_t at, size_t len) {
+    bstream_t *out = sh->bi_out;
+    if (!len) return 0;
+    if (!out->mp && !out->cb && len >= sizeof(out->obuf)) {
+        if (bi_flush(sh, out) < 0) return -1;
+        loff_t off = s->off + at;
+        int use_splice = 1;
+        while (len > 0) {
+            ssize_t n = use_splice ? splice(s->fd, &off, out->fd, NULL, len, SPLICE_F_MORE)
+                                   : sendfile(out->fd, s->fd, &off, len);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && errno == EINVAL && use_splice) { use_splice = 0; continue; }
+            if (n < 0 && errno == EPIPE) return -1;
+            if (n <= 0) break;  /* not supported here: copy the rest */
+            len -= n;
+            at += n;
+        }
+        if (!len) return 0;
+    }
+    char *buf = malloc(len < TEXT_BLOCK ? len : TEXT_BLOCK);
+    if (!buf) { msh_error(sh, "out of memory"); return -1; }
+    int r = 0;
+    while (len > 0) {
+        ssize_t n = pread(s->fd, buf, len < TEXT_BLOCK ? len : TEXT_BLOCK, s->off + at);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        if (bi_write(sh, buf, n) < 0) { r = -1; break; }
+        len -= n;
+        at += n;
+    }
+    free(buf);
+    return r;
+}
+
+/* A count argument: digits, optionally led by + */
+static int parse_count(msh_t *sh, const char *cmd, const char *a, long long *n, int *plus) {
+    char *end;
+    if (plus) *plus = *a == '+';
+    errno = 0;
+    *n = strtoll(a, &end, 10);
+    if (!*a || *end || errno || *n < 0 || (*a == '+' && !plus)) {
+        msh_error(sh, "%s: %s: invalid number", cmd, a);
+        return -1;
+    }
+    return 0;
+}
+
+/* wc [-lwc] [file...] */
+
+typedef struct { long long lines, words, bytes; } wc_counts_t;
+
+/* Words are runs of non-space; in_word carries across blocks */
+static long long count_words(const char *p, size_t n, int *in_word) {
+    long long words = 0;
+    int in = *in_word;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char c = p[i];
+        int space = c == ' ' || (c >= '\t' && c <= '\r');
+        words += !space && !in;
+        in = !space;
+    }
+    *in_word = in;
+    return words;
+}
+
+static int wc_map(msh_t *sh, text_src_t *s, int want_words, int want_lines, wc_counts_t *c) {
+    map_guard_t g;
+    guard_begin(&g);
+    if (sigsetjmp(g.env, 1)) {
+        memset(c, 0, sizeof(*c));
+        return map_lost(sh, "wc", s, &g);
+    }
+    c->bytes = s->len;
+    if (want_lines) c->lines = count_nl(s->map, s->len);
+    if (want_words) {
+        int in_word = 0;
+        c->words = count_words(s->map, s->len, &in_word);
+    }
+    guard_end(&g);
+    src_consumed(s, s->len);
+    return 0;
+}
+
+static int wc_one(msh_t *sh, text_src_t *s, int want_words, int want_lines, wc_counts_t *c) {
+    int in_word = 0;
+    memset(c, 0, sizeof(*c));
+    if (s->map) return wc_map(sh, s, want_words, want_lines, c);
+    char *buf = malloc(TEXT_BLOCK);
+    if (!buf) { msh_error(sh, "wc: out of memory"); return -1; }
+    ssize_t n;
+    while ((n = src_read(sh, s, buf, TEXT_BLOCK)) > 0) {
+        c->bytes += n;
+        if (want_lines) c->lines += count_nl(buf, n);
+        if (want_words) c->words += count_words(buf, n, &in_word);
+    }
+    free(buf);
+    if (n < 0) { msh_error(sh, "wc: %s: %s", s->name ? s->name : "-", strerror(errno)); return -1; }
+    return 0;
+}
+
+static int wc_print(msh_t *sh, const wc_counts_t *c, int flags, int width, const char *name) {
+    char line[128];
+    size_t len = 0;
+    long long v[3] = { c->lines, c->words, c->bytes };
+    for (int k = 0; k < 3; ++k) {
+        if (!(flags & (1 << k))) continue;
+        len += snprintf(line + len, sizeof(line) - len, "%s%*lld", len ? " " : "", width, v[k]);
+    }
+    if (name) return bi_printf(sh, "%s %s\n", line, name);
+    return bi_printf(sh, "%s\n", line);
+}
+
+int wc_command(msh_t *sh, char **argv) {
+    int flags = 0, i = 1;
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "--") == 0) { i++; break; }
+        for (const char *f = argv[i] + 1; *f; ++f) {
+            if (*f == 'l') flags |= 1;
+            else if (*f == 'w') flags |= 2;
+            else if (*f == 'c') flags |= 4;
+            else { msh_error(sh, "wc: usage: wc [-lwc] [file...]"); return 2; }
+        }
+    }
+    if (!flags) flags = 7;
+    int nfiles = 0;
+    while (argv[i + nfiles]) nfiles++;
+    wc_counts_t *counts = calloc(nfiles + 1, sizeof(*counts)), total = { 0, 0, 0 };
+    if (!counts) { msh_error(sh, "wc: out of memory"); return 1; }
+    int status = 0, *ok = calloc(nfiles + 1, sizeof(*ok));
+    if (!ok) { free(counts); msh_error(sh, "wc: out of memory"); return 1; }
+    for (int k = 0; k < (nfiles ? nfiles : 1); ++k) {
+        text_src_t s;
+        if (src_open(sh, "wc", nfiles ? argv[i + k] : NULL, &s) < 0) { status = 1; continue; }
+        if (wc_one(sh, &s, flags & 2, flags & 1, &counts[k]) == 0) ok[k] = 1;
+        else status = 1;
+        src_close(&s);
+        total.lines += counts[k].lines;
+        total.words += counts[k].words;
+        total.bytes += counts[k].bytes;
+    }
+    /* one count alone is printed bare; otherwise columns fit the totals */
+    int width = 0;
+    if ((flags & (flags - 1)) || nfiles > 1) {
+        char tmp[32];
+        long long max = total.lines > total.words ? total.lines : total.words;
+        if (total.bytes > max) max = total.bytes;
+        width = snprintf(tmp, sizeof(tmp), "%lld", max);
+    }
+    for (int k = 0; k < (nfiles ? nfiles : 1); ++k)
+        if (ok[k] && wc_print(sh, &counts[k], flags, width, nfiles ? argv[i + k] : NULL) < 0) { status = 1; break; }
+    if (nfiles > 1 && wc_print(sh, &total, flags, width, "total") < 0) status = 1;
+    free(counts);
+    free(ok);
+    return status;
+}
+
+/* head [-n lines | -c bytes] [file...] */
+
+static int head_stream(msh_t *sh, text_src_t *s, long long count, int bytes) {
+    char *buf = malloc(TEXT_BLOCK);
+    if (!buf) { msh_error(sh, "head: out of memory"); return -1; }
+    ssize_t n;
+    int r = 0;
+    while (count > 0 && (n = src_read(sh, s, buf, TEXT_BLOCK)) > 0) {
+        size_t use = n, found;
+        if (bytes) {
+            if ((long long)use > count) use = count;
+            count -= use;
+        } else {
+            use = skip_lines(buf, n, count, &found);
+            count -= found;
+        }
+        if (bi_write(sh, buf, use) < 0) { r = -1; break; }
+    }
+    free(buf);
+    return r;
+}
+
+static int head_one(msh_t *sh, text_src_t *s, long long count, int bytes) {
+    if (!s->map) return head_stream(sh, s, count, bytes);
+    size_t end, found;
+    map_guard_t g;
+    guard_begin(&g);
+    if (sigsetjmp(g.env, 1)) return map_lost(sh, "head", s, &g);
+    if (bytes) end = (unsigned long long)count < s->len ? (size_t)count : s->len;
+    else end = skip_lines(s->map, s->len, count, &found);
+    guard_end(&g);
+    src_consumed(s, end);
+    return emit(sh, s, 0, end);
+}
+
+/* tail [-n [+]lines | -c [+]bytes] [file] */
+
+/* Keep only what may end up in the last count lines or bytes */
+static void tail_trim(strbuf_t *b, long long count, int bytes) {
+    size_t start = bytes ? ((unsigned long long)count < b->len ? b->len - count : 0)
+                         : last_lines(b->s, b->len, count);
+    if (start > b->len / 2) {
+        memmove(b->s, b->s + start, b->len - start);
+        b->len -= start;
+    }
+}
+
+static int tail_stream(msh_t *sh, text_src_t *s, long long count, int bytes, int plus) {
+    char *buf = malloc(TEXT_BLOCK);
+    if (!buf) { msh_error(sh, "tail: out of memory"); return -1; }
+    strbuf_t b = { NULL, 0, 0 };
+    ssize_t n;
+    int r = 0;
+    long long skip = plus && count > 0 ? count - 1 : 0;
+    while ((n = src_read(sh, s, buf, TEXT_BLOCK)) > 0) {
+        if (plus) {
+            /* +N: drop what comes before, then pass the rest on */
+            size_t from = 0, found;
+            if (bytes) {
+                from = (long long)n < skip ? (size_t)n : (size_t)skip;
+                skip -= from;
+            } else if (skip) {
+                from = skip_lines(buf, n, skip, &found);
+                skip -= found;
+            }
+            if (bi_write(sh, buf + from, n - from) < 0) { r = -1; break; }
+            continue;
+        }
+        sb_putn(&b, buf, n);
+        if (b.len > TEXT_BLOCK * 4) tail_trim(&b, count, bytes);
+    }
+    if (!plus && r == 0 && b.len) {
+        size_t start = bytes ? ((unsigned long long)count < b.len ? b.len - count : 0)
+                             : last_lines(b.s, b.len, count);
+        r = bi_write(sh, b.s + start, b.len - start);
+    }
+    free(b.s);
+    free(buf);
+    return r;
+}
+
+static int tail_one(msh_t *sh, text_src_t *s, long long count, int bytes, int plus) {
+    if (!s->map) return tail_stream(sh, s, count, bytes, plus);
+    size_t start, found;
+    map_guard_t g;
+    guard_begin(&g);
+    if (sigsetjmp(g.env, 1)) return map_lost(sh, "tail", s, &g);
+    if (plus) {
+        size_t skip = count > 0 ? (size_t)count - 1 : 0;
+        start = bytes ? (skip < s->len ? skip : s->len) : skip_lines(s->map, s->len, skip, &found);
+    } else {
+        start = bytes ? ((unsigned long long)count < s->len ? s->len - count : 0)
+                      : last_lines(s->map, s->len, count);
+    }
+    guard_end(&g);
+    src_consumed(s, s->len);
+    return emit(sh, s, start, s->len - start);
+}
+
+/* Options shared by head and tail: -n N, -c N, -N */
+static int head_tail_command(msh_t *sh, char **argv, int tail) {
+    const char *cmd = tail ? "tail" : "head";
+    long long count = 10;
+    int bytes = 0, plus = 0, i = 1;
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; ++i) {
+        const char *a = argv[i];
+        if (strcmp(a, "--") == 0) { i++; break; }
+        if ((a[1] == 'n' || a[1] == 'c') && (a[2] || argv[i + 1])) {
+            bytes = a[1] == 'c';
+            if (parse_count(sh, cmd, a[2] ? a + 2 : argv[++i], &count, tail ? &plus : NULL) < 0) return 2;
+        } else if (a[1] >= '0' && a[1] <= '9') {
+            if (parse_count(sh, cmd, a + 1, &count, NULL) < 0) return 2;
+        } else {
+            msh_error(sh, "%s: usage: %s [-n lines | -c bytes] [file...]", cmd, cmd);
+            return 2;
+        }
+    }
+    int nfiles = 0, status = 0;
+    while (argv[i + nfiles]) nfiles++;
+    for (int k = 0; k < (nfiles ? nfiles : 1); ++k) {
+        text_src_t s;
+        const char *name = nfiles ? argv[i + k] : NULL;
+        if (src_open(sh, cmd, name, &s) < 0) { status = 1; continue; }
+        if (nfiles > 1 && bi_printf(sh, "%s==> %s <==\n", k ? "\n" : "", name) < 0) {
+            src_close(&s);
+            return 1;
+        }
+        int r = tail ? tail_one(sh, &s, count, bytes, plus) : head_one(sh, &s, count, bytes);
+        src_close(&s);
+        if (r < 0) return 1;
+    }
+    return status;
+}
+
+int head_command(msh_t *sh, char **argv) {
+    return head_tail_command(sh, argv, 0);
+}
+
+int tail_command(msh_t *sh, char **argv) {
+    return head_tail_command(sh, argv, 1);
+}
@@ -0,0 +1,267 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "msh_internal.h"
+
+/* xtrace output is collected in the context and written to the trace fd in
+   large chunks: when full, before an interactive prompt, and at exit. */
+
+/* MYSHELL_XTRACEFD names one of the script's fds, e.g. one opened by
+   exec 3>file, not a raw fd of the process. If it is not open, the trace
+   goes to the error fd, which says so once per value. */
+static int xtrace_fd(msh_t *sh) {
+    const char *s = msh_getvar(sh, "MYSHELL_XTRACEFD");
+    if (!s || !*s) return sh->err_fd;
+    char *end;
+    long n = strtol(s, &end, 10);
+    if (!*end && n >= 0 && n < SHELL_FDS) {
+        int fd = shell_fd(sh, (int)n);
+        if (fd >= 0) { sh->xtrace_bad = -1; return fd; }
+    }
+    if (sh->xtrace_bad != n) {
+        sh->xtrace_bad = n;
+        msh_error(sh, "MYSHELL_XTRACEFD: %s: bad file descriptor", s);
+    }
+    return sh->err_fd;
+}
+
+void xtrace_flush(msh_t *sh) {
+    if (!sh->xtrace_len) return;
+    int fd = xtrace_fd(sh);
+    size_t off = 0;
+    while (off < sh->xtrace_len) {
+        ssize_t n = write(fd, sh->xtrace_buf + off, sh->xtrace_len - off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        off += n;
+    }
+    sh->xtrace_len = 0;
+}
+
+static void xtrace_put(msh_t *sh, const char *s, size_t n) {
+    if (sh->xtrace_len + n > sizeof(sh->xtrace_buf)) xtrace_flush(sh);
+    while (n > sizeof(sh->xtrace_buf)) {
+        /* too big to buffer: write through in buffer-sized pieces */
+        memcpy(sh->xtrace_buf, s, sizeof(sh->xtrace_buf));
+        sh->xtrace_len = sizeof(sh->xtrace_buf);
+        xtrace_flush(sh);
+        s += sizeof(sh->xtrace_buf);
+        n -= sizeof(sh->xtrace_buf);
+    }
+    memcpy(sh->xtrace_buf + sh->xtrace_len, s, n);
+    sh->xtrace_len += n;
+}
+
+static void xtrace_str(msh_t *sh, const char *s) { xtrace_put(sh, s, strlen(s)); }
+
+/* Print a word so it reads back as one word */
+static void xtrace_word(msh_t *sh, const char *w) {
+    if (*w && !strpbrk(w, " \t\n'\"|&<>$#")) { xtrace_str(sh, w); return; }
+    xtrace_put(sh, "'", 1);
+    for (; *w; ++w) {
+        if (*w == '\'') xtrace_str(sh, "'\"'\"'");
+        else xtrace_put(sh, w, 1);
+    }
+    xtrace_put(sh, "'", 1);
+}
+
+static void xtrace_stamp(msh_t *sh, const struct timespec *ts) {
+    char tmp[48];
+    int n = snprintf(tmp, sizeof(tmp), "[%lld.%06ld] ", (long long)ts->tv_sec, ts->tv_nsec / 1000);
+    xtrace_put(sh, tmp, n);
+}
+
+/* Trace a pipeline before it runs. With xtracetime, *start receives the
+   start time and 1 is returned; xtrace_done needs it. */
+int xtrace_pipeline(msh_t *sh, cmd_t cmds[], int ncmds, int background, struct timespec *start) {
+    int timed = sh->opts[OPT_XTRACETIME];
+    xtrace_put(sh, "+ ", 2);
+    if (timed) {
+        clock_gettime(CLOCK_REALTIME, start);
+        xtrace_stamp(sh, start);
+    }
+    for (int i = 0; i < ncmds; ++i) {
+        if (i) xtrace_put(sh, " | ", 3);
+        for (int j = 0; cmds[i].argv[j]; ++j) {
+            if (j) xtrace_put(sh, " ", 1);
+            /* assignments are already quoted */
+            if (cmds[i].assign) xtrace_str(sh, cmds[i].argv[j]);
+            else xtrace_word(sh, cmds[i].argv[j]);
+        }
+        if (cmds[i].infile) { xtrace_put(sh, " <", 2); xtrace_word(sh, cmds[i].infile); }
+        if (cmds[i].outfile) {
+            xtrace_str(sh, cmds[i].append ? " >>" : " >");
+            xtrace_word(sh, cmds[i].outfile);
+        }
+        for (int k = 0; k < cmds[i].nredirs; ++k) {
+            static const char *const ops[] = { "<", ">", ">>", ">&" };
+            const redir_t *r = &cmds[i].redirs[k];
+            char tmp[16];
+            xtrace_put(sh, tmp, snprintf(tmp, sizeof(tmp), " %d%s", r->fd, ops[r->op]));
+            xtrace_word(sh, r->target);
+        }
+    }
+    if (background) xtrace_put(sh, " &", 2);
+    xtrace_put(sh, "\n", 1);
+    return timed;
+}
+
+/* With xtracetime, trace how long the pipeline started at *start took */
+void xtrace_done(msh_t *sh, const struct timespec *start) {
+    if (!sh->opts[OPT_XTRACETIME]) return;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    long long us = (now.tv_sec - start->tv_sec) * 1000000LL + (now.tv_nsec - start->tv_nsec) / 1000;
+    char tmp[48];
+    int n = snprintf(tmp, sizeof(tmp), "done %lldus\n", us);
+    xtrace_put(sh, "+ ", 2);
+    xtrace_stamp(sh, &now);
+    xtrace_put(sh, tmp, n);
+}
+
+/* Profiling (set -o profile): wall and CPU time, including reaped children,
+   aggregated per source line and per command name. */
+
+static prof_entry_t *prof_slot(prof_table_t *t, const char *key) {
+    if (t->used * 2 >= t->cap) {
+        size_t ncap = t->cap ? t->cap * 2 : 64;
+        prof_entry_t *ns = calloc(ncap, sizeof(*ns));
+        if (!ns) return NULL;
+        for (size_t i = 0; i < t->cap; ++i) {
+            if (!t->slots[i].key) continue;
+            size_t j = str_hash(t->slots[i].key) & (ncap - 1);
+            while (ns[j].key) j = (j + 1) & (ncap - 1);
+            ns[j] = t->slots[i];
+        }
+        free(t->slots);
+        t->slots = ns;
+        t->cap = ncap;
+    }
+    size_t j = str_hash(key) & (t->cap - 1);
+    while (t->slots[j].key && strcmp(t->slots[j].key, key) != 0) j = (j + 1) & (t->cap - 1);
+    if (!t->slots[j].key) {
+        if (!(t->slots[j].key = strdup(key))) return NULL;
+        t->used++;
+    }
+    return &t->slots[j];
+}
+
+static double cpu_seconds(void) {
+    struct rusage self, kids;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &kids);
+    return self.ru_utime.tv_sec + self.ru_stime.tv_sec + kids.ru_utime.tv_sec + kids.ru_stime.tv_sec +
+           (self.ru_utime.tv_usec + self.ru_stime.tv_usec + kids.ru_utime.tv_usec + kids.ru_stime.tv_usec) / 1e6;
+}
+
+void prof_begin(msh_t *sh, prof_sample_t *ps) {
+    ps->active = sh->opts[OPT_PROFILE];
+    if (!ps->active) return;
+    clock_gettime(CLOCK_MONOTONIC, &ps->wall);
+    ps->cpu = cpu_seconds();
+}
+
+void prof_end(msh_t *sh, prof_sample_t *ps, int lineno, cmd_t cmds[], int ncmds) {
+    if (!ps->active) return;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double wall = (now.tv_sec - ps->wall.tv_sec) + (now.tv_nsec - ps->wall.tv_nsec) / 1e9;
+    double cpu = cpu_seconds() - ps->cpu;
+
+    char key[512];
+    snprintf(key, sizeof(key), "%s:%d", sh->script_name, lineno);
+    prof_entry_t *e = prof_slot(&sh->prof_lines, key);
+    if (!e) return;
+    if (!e->label) {
+        /* label the line with its commands, e.g. "sort|uniq" */
+        char label[256] = "";
+        size_t off = 0;
+        for (int i = 0; i < ncmds && off < sizeof(label); ++i)
+            off += snprintf(label + off, sizeof(label) - off, "%s%s", i ? "|" : "",
+                            cmds[i].argv[0] ? cmds[i].argv[0] : "");
+        e->label = strdup(label);
+    }
+    e->calls++; e->wall += wall; e->cpu += cpu;
+
+    /* per command: the whole line's time is attributed to each stage name */
+    for (int i = 0; i < ncmds; ++i) {
+        if (!cmds[i].argv[0]) continue;
+        e = prof_slot(&sh->prof_cmds, cmds[i].argv[0]);
+        if (!e) return;
+        e->calls++; e->wall += wall; e->cpu += cpu;
+    }
+}
+
+static int prof_cmp(const void *a, const void *b) {
+    const prof_entry_t *x = *(prof_entry_t * const *)a, *y = *(prof_entry_t * const *)b;
+    return (x->wall < y->wall) - (x->wall > y->wall);
+}
+
+static void prof_print(msh_t *sh, prof_table_t *t, const char *title) {
+    prof_entry_t **v = malloc((t->used + 1) * sizeof(*v));
+    if (!v) return;
+    size_t n = 0;
+    for (size_t i = 0; i < t->cap; ++i)
+        if (t->slots[i].key) v[n++] = &t->slots[i];
+    qsort(v, n, sizeof(*v), prof_cmp);
+    dprintf(sh->err_fd, "%12s %12s %8s  %s\n", "wall(s)", "cpu(s)", "calls", title);
+    for (size_t i = 0; i < n; ++i)
+        dprintf(sh->err_fd, "%12.6f %12.6f %8ld  %s%s%s\n", v[i]->wall, v[i]->cpu, v[i]->calls, v[i]->key,
+                v[i]->label ? "  " : "", v[i]->label ? v[i]->label : "");
+    free(v);
+}
+
+/* Write the sorted report to the error fd and, if MYSHELL_PROFILE_FOLDED
+   names a file, one "myshell;line;commands microseconds" stack per line to it. */
+void prof_dump(msh_t *sh) {
+    if (!sh->prof_lines.used) return;
+    dprintf(sh->err_fd, "\n--- profile ---\n");
+    prof_print(sh, &sh->prof_lines, "line");
+    dprintf(sh->err_fd, "\n");
+    prof_print(sh, &sh->prof_cmds, "command");
+
+    const char *path = msh_getvar(sh, "MYSHELL_PROFILE_FOLDED");
+    if (!path || !*path) return;
+    int fd = msh_open(sh, path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    FILE *f = fd < 0 ? NULL : fdopen(fd, "w");
+    if (!f) { msh_perror(sh, path); if (fd >= 0) close(fd); return; }
+    for (size_t i = 0; i < sh->prof_lines.cap; ++i) {
+        prof_entry_t *e = &sh->prof_lines.slots[i];
+        if (e->key)
+            fprintf(f, "myshell;%s;%s %.0f\n", e->key, e->label ? e->label : "", e->wall * 1e6);
+    }
+    fclose(f);
+}
+
+static void prof_table_free(prof_table_t *t) {
+    for (size_t i = 0; i < t->cap; ++i) {
+        free(t->slots[i].key);
+        free(t->slots[i].label);
+    }
+    free(t->slots);
+    t->slots = NULL;
+    t->cap = t->used = 0;
+}
+
+void prof_free(msh_t *sh) {
+    prof_table_free(&sh->prof_lines);
+    prof_table_free(&sh->prof_cmds);
+}
+
+static size_t prof_table_mem(const prof_table_t *t) {
+    size_t n = t->cap * sizeof(*t->slots);
+    for (size_t i = 0; i < t->cap; ++i) {
+        if (t->slots[i].key) n += strlen(t->slots[i].key) + 1;
+        if (t->slots[i].label) n += strlen(t->slots[i].label) + 1;
+    }
+    return n;
+}
+
+size_t prof_mem(msh_t *sh) {
+    return prof_table_mem(&sh->prof_lines) + prof_table_mem(&sh->prof_cmds);
+}
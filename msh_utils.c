@@ -0,0 +1,444 @@
+#define _POSIX_C_SOURCE 200809L
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+
+#include "msh_internal.h"
+
+/* seq, basename, dirname and printf: small utilities scripts run in
+   loops, here so they cost no fork. They behave like the coreutils and
+   bash versions for the options they take. */
+
+#define SEQ_BATCH 65536
+
+/* seq [-w] [-s sep] [first [incr]] last */
+
+/* Parse s into *v if it is an integer that fits a long long; larger ones
+   take the floating point path like decimals do */
+static int to_integer(const char *s, long long *v) {
+    const char *p = s;
+    if (*p == '-' || *p == '+') p++;
+    if (!*p) return 0;
+    for (; *p; ++p)
+        if (*p < '0' || *p > '9') return 0;
+    errno = 0;
+    *v = strtoll(s, NULL, 10);
+    return errno != ERANGE;
+}
+
+/* Digits after the point, as seq uses for the output precision */
+static int decimals(const char *s) {
+    const char *dot = strchr(s, '.');
+    if (!dot) return 0;
+    size_t n = strspn(dot + 1, "0123456789");
+    return n > 64 ? 64 : (int)n;
+}
+
+/* Write v into the end of buf, zero-padded to width; returns the start */
+static char *put_int(char *end, long long v, int width) {
+    unsigned long long u = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+    char *p = end;
+    do { *--p = '0' + u % 10; u /= 10; } while (u);
+    while (end - p < width - (v < 0)) *--p = '0';
+    if (v < 0) *--p = '-';
+    return p;
+}
+
+static int seq_flush(msh_t *sh, strbuf_t *b) {
+    int r = bi_write(sh, b->s, b->len);
+    b->len = 0;
+    return r;
+}
+
+int seq_command(msh_t *sh, char **argv) {
+    const char *sep = "\n";
+    int equal = 0, i = 1;
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1] && !(argv[i][1] >= '0' && argv[i][1] <= '9') &&
+           argv[i][1] != '.'; ++i) {
+        if (strcmp(argv[i], "-w") == 0) equal = 1;
+        else if (strcmp(argv[i], "-s") == 0 && argv[i + 1]) sep = argv[++i];
+        else if (strncmp(argv[i], "-s", 2) == 0) sep = argv[i] + 2;
+        else if (strcmp(argv[i], "--") == 0) { i++; break; }
+        else { msh_error(sh, "seq: usage: seq [-w] [-s sep] [first [incr]] last"); return 2; }
+    }
+    int n = 0;
+    while (argv[i + n]) n++;
+    if (n < 1 || n > 3) { msh_error(sh, "seq: usage: seq [-w] [-s sep] [first [incr]] last"); return 2; }
+    const char *sfirst = n > 1 ? argv[i] : "1", *sincr = n > 2 ? argv[i + 1] : "1", *slast = argv[i + n - 1];
+    const char *args[3] = { sfirst, sincr, slast };
+    long double d[3];
+    for (int k = 0; k < 3; ++k) {
+        char *end;
+        errno = 0;
+        d[k] = strtold(args[k], &end);
+        if (!*args[k] || *end || errno) {
+            msh_error(sh, "seq: invalid floating point argument: '%s'", args[k]);
+            return 1;
+        }
+    }
+    if (d[1] == 0) { msh_error(sh, "seq: invalid Zero increment value: '%s'", sincr); return 1; }
+    size_t seplen = strlen(sep);
+    strbuf_t b = { NULL, 0, 0 };
+    int status = 0;
+
+    long long first, incr, last;
+    if (to_integer(sfirst, &first) && to_integer(sincr, &incr) && to_integer(slast, &last)) {
+        /* integers: formatted by hand into batches */
+        int width = 0;
+        if (equal) {
+            char tmp[32];
+            width = (int)(tmp + sizeof(tmp) - put_int(tmp + sizeof(tmp), first, 0));
+            int wl = (int)(tmp + sizeof(tmp) - put_int(tmp + sizeof(tmp), last, 0));
+            if (wl > width) width = wl;
+        }
+        if (incr == 1 && first >= 0 && seplen < 16) {
+            /* counting up by one: bump the decimal digits in place */
+            char num[32], *end = num + sizeof(num), *s = put_int(end, first, width);
+            char *out = malloc(SEQ_BATCH + 64);
+            size_t used = 0;
+            if (!out) { msh_error(sh, "seq: out of memory"); return 1; }
+            for (long long v = first; v <= last; ++v) {
+                if (v != first) { memcpy(out + used, sep, seplen); used += seplen; }
+                memcpy(out + used, s, end - s);
+                used += end - s;
+                if (used >= SEQ_BATCH) {
+                    if (bi_write(sh, out, used) < 0) { status = 1; break; }
+                    used = 0;
+                }
+                char *digit = end - 1;
+                while (digit >= s && *digit == '9') *digit-- = '0';
+                if (digit >= s) (*digit)++;
+                else *--s = '1';
+                if (v == LLONG_MAX) break;
+            }
+            if (!status && first <= last) out[used++] = '\n';
+            if (!status && bi_write(sh, out, used) < 0) status = 1;
+            free(out);
+            return status;
+        }
+        for (long long v = first; incr > 0 ? v <= last : v >= last; ) {
+            char tmp[32];
+            char *s = put_int(tmp + sizeof(tmp), v, width);
+            if (v != first) sb_putn(&b, sep, seplen);
+            sb_putn(&b, s, tmp + sizeof(tmp) - s);
+            if (b.len >= SEQ_BATCH && seq_flush(sh, &b) < 0) { status = 1; break; }
+            if ((incr > 0 && v > LLONG_MAX - incr) || (incr < 0 && v < LLONG_MIN - incr)) break;
+            v += incr;
+        }
+        if (!status && (incr > 0 ? first <= last : first >= last)) sb_putn(&b, "\n", 1);
+    } else {
+        int prec = decimals(sfirst) > decimals(sincr) ? decimals(sfirst) : decimals(sincr);
+        int width = 0;
+        if (equal) {
+            char tmp[64];
+            width = snprintf(tmp, sizeof(tmp), "%.*Lf", prec, d[0]);
+            int wl = snprintf(tmp, sizeof(tmp), "%.*Lf", prec, d[2]);
+            if (wl > width) width = wl;
+        }
+        /* step by multiplying, so errors do not add up; the slack on last
+           is a fraction of the step, so large values do not run past it */
+        long double slack = (d[1] < 0 ? -d[1] : d[1]) * 1e-9L, prev = 0;
+        int stuck = 0;
+        for (long long k = 0; ; ++k) {
+            long double v = d[0] + k * d[1];
+            if (d[1] > 0 ? v > d[2] + slack : v < d[2] - slack) break;
+            if (k && v == prev) { stuck = 1; break; } /* the step is below the precision */
+            prev = v;
+            char tmp[400];
+            int len = snprintf(tmp, sizeof(tmp), "%0*.*Lf", width, prec, v);
+            if (k) sb_putn(&b, sep, seplen);
+            sb_putn(&b, tmp, len);
+            if (b.len >= SEQ_BATCH && seq_flush(sh, &b) < 0) { status = 1; break; }
+        }
+        if (!status && b.len) sb_putn(&b, "\n", 1);
+        if (stuck) {
+            if (b.len && seq_flush(sh, &b) < 0) status = 1;
+            msh_error(sh, "seq: increment too small for '%s'", slast);
+            status = 1;
+        }
+    }
+    if (!status && b.len && seq_flush(sh, &b) < 0) status = 1;
+    free(b.s);
+    return status;
+}
+
+/* basename name [suffix], basename -a [-s suffix] name... */
+
+static void put_basename(strbuf_t *b, const char *name, const char *suffix) {
+    size_t len = strlen(name);
+    while (len > 1 && name[len - 1] == '/') len--;
+    if (len == 1 && name[0] == '/') { sb_putn(b, "/\n", 2); return; }
+    size_t start = len;
+    while (start > 0 && name[start - 1] != '/') start--;
+    size_t n = len - start, sl = suffix ? strlen(suffix) : 0;
+    if (sl && sl < n && strncmp(name + len - sl, suffix, sl) == 0) n -= sl;
+    sb_putn(b, name + start, n);
+    sb_putn(b, "\n", 1);
+}
+
+int basename_command(msh_t *sh, char **argv) {
+    const char *suffix = NULL;
+    int multi = 0, i = 1;
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "-a") == 0) multi = 1;
+        else if (strcmp(argv[i], "-s") == 0 && argv[i + 1]) { suffix = argv[++i]; multi = 1; }
+        else if (strcmp(argv[i], "--") == 0) { i++; break; }
+        else { msh_error(sh, "basename: usage: basename name [suffix] | basename -a [-s suffix] name..."); return 2; }
+    }
+    if (!argv[i] || (!multi && argv[i + 1] && argv[i + 2])) {
+        msh_error(sh, "basename: usage: basename name [suffix] | basename -a [-s suffix] name...");
+        return 2;
+    }
+    strbuf_t b = { NULL, 0, 0 };
+    if (!multi) put_basename(&b, argv[i], argv[i + 1]);
+    else for (; argv[i]; ++i) put_basename(&b, argv[i], suffix);
+    int status = bi_write(sh, b.s, b.len) < 0;
+    free(b.s);
+    return status;
+}
+
+/* dirname name... */
+
+static void put_dirname(strbuf_t *b, const char *name) {
+    size_t len = strlen(name);
+    while (len > 1 && name[len - 1] == '/') len--;
+    while (len > 0 && name[len - 1] != '/') len--;
+    while (len > 1 && name[len - 1] == '/') len--;
+    if (len == 0) sb_putn(b, ".", 1);
+    else sb_putn(b, name, len);
+    sb_putn(b, "\n", 1);
+}
+
+int dirname_command(msh_t *sh, char **argv) {
+    int i = 1;
+    if (argv[i] && strcmp(argv[i], "--") == 0) i++;
+    if (!argv[i]) { msh_error(sh, "dirname: usage: dirname name..."); return 2; }
+    strbuf_t b = { NULL, 0, 0 };
+    for (; argv[i]; ++i) put_dirname(&b, argv[i]);
+    int status = bi_write(sh, b.s, b.len) < 0;
+    free(b.s);
+    return status;
+}
+
+/* printf [-v var] format [arg...] */
+
+static void put_fmt(strbuf_t *b, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void put_fmt(strbuf_t *b, const char *fmt, ...) {
+    char tmp[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n < sizeof(tmp)) { sb_putn(b, tmp, n); return; }
+    char *big = malloc(n + 1);
+    if (!big) return;
+    va_start(ap, fmt);
+    vsnprintf(big, n + 1, fmt, ap);
+    va_end(ap);
+    sb_putn(b, big, n);
+    free(big);
+}
+
+/* One backslash escape at *p (after the backslash); %b also takes \0NNN.
+   Returns 1 for \c, which ends the output. */
+static int put_escape(strbuf_t *b, const char **p, int in_b) {
+    const char *s = *p;
+    char c = *s++;
+    int v = 0, k;
+    switch (c) {
+    case 'a': sb_putn(b, "\a", 1); break;
+    case 'b': sb_putn(b, "\b", 1); break;
+    case 'e': sb_putn(b, "\033", 1); break;
+    case 'f': sb_putn(b, "\f", 1); break;
+    case 'n': sb_putn(b, "\n", 1); break;
+    case 'r': sb_putn(b, "\r", 1); break;
+    case 't': sb_putn(b, "\t", 1); break;
+    case 'v': sb_putn(b, "\v", 1); break;
+    case '\\': sb_putn(b, "\\", 1); break;
+    case 'c': if (in_b) { *p = s; return 1; } sb_putn(b, "\\c", 2); break;
+    case 'x':
+        for (k = 0; k < 2 && isxdigit((unsigned char)*s); ++k, ++s)
+            v = v * 16 + (*s <= '9' ? *s - '0' : (*s | 0x20) - 'a' + 10);
+        if (!k) { sb_putn(b, "\\x", 2); break; }
+        sb_putn(b, (char *)&(char){ (char)v }, 1);
+        break;
+    case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7':
+        /* \NNN, or \0NNN in %b */
+        s--;
+        if (in_b && *s == '0') s++;
+        for (k = 0; k < 3 && *s >= '0' && *s <= '7'; ++k, ++s) v = v * 8 + (*s - '0');
+        sb_putn(b, (char *)&(char){ (char)v }, 1);
+        break;
+    case 0: sb_putn(b, "\\", 1); s--; break;
+    default: sb_putn(b, (char[]){ '\\', c }, 2); break;
+    }
+    *p = s;
+    return 0;
+}
+
+/* %q: as a word this shell reads back as s */
+static void put_quoted(strbuf_t *b, const char *s) {
+    if (!*s) { sb_putn(b, "''", 2); return; }
+    if (strspn(s, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789,._+:@%/-=") == strlen(s)) {
+        sb_putn(b, s, strlen(s));
+        return;
+    }
+    quote_into(b, s);
+}
+
+/* A numeric argument: 'c or "c is the character's code */
+static int num_arg(msh_t *sh, const char *a, int fp, long long *ll, unsigned long long *ull, double *d) {
+    char *end = NULL;
+    *ll = 0; *ull = 0; *d = 0;
+    if (!a || !*a) return 0;
+    if (*a == '\'' || *a == '"') {
+        *ll = *ull = (unsigned char)a[1];
+        *d = *ll;
+        return 0;
+    }
+    errno = 0;
+    if (fp) {
+        *d = strtod(a, &end);
+    } else if (*a == '-') {
+        *ll = strtoll(a, &end, 0);
+        *ull = (unsigned long long)*ll;
+    } else {
+        *ull = strtoull(a, &end, 0);
+        *ll = (long long)*ull;
+    }
+    if (*end || errno) {
+        msh_error(sh, "printf: %s: invalid number", a);
+        return -1;
+    }
+    return 0;
+}
+
+/* One pass over the format; *ai moves past the arguments used. Returns
+   1 after \c, -1 after an invalid number, -2 for a bad format, else 0. */
+static int printf_pass(msh_t *sh, strbuf_t *b, const char *fmt, char **args, int *ai) {
+    int status = 0;
+    for (const char *p = fmt; *p; ) {
+        if (*p == '\\') {
+            p++;
+            put_escape(b, &p, 0);
+            continue;
+        }
+        if (*p != '%') {
+            const char *q = p;
+            while (*q && *q != '%' && *q != '\\') q++;
+            sb_putn(b, p, q - p);
+            p = q;
+            continue;
+        }
+        if (p[1] == '%') { sb_putn(b, "%", 1); p += 2; continue; }
+        /* %[flags][width][.precision][length]conv */
+        char spec[64];
+        size_t sl = 0;
+        const char *q = p + 1;
+        spec[sl++] = '%';
+        while (*q && strchr("-+ #0", *q) && sl < 16) spec[sl++] = *q++;
+        int width = -1, prec = -1;
+        if (*q == '*') {
+            /* a negative width from an argument left-justifies */
+            width = args[*ai] ? atoi(args[(*ai)++]) : 0;
+            if (width < 0) {
+                if (sl < 16) spec[sl++] = '-';
+                width = width == INT_MIN ? INT_MAX : -width;
+            }
+            q++;
+        } else while (*q >= '0' && *q <= '9') width = (width < 0 ? 0 : width * 10) + (*q++ - '0');
+        if (*q == '.') {
+            q++;
+            prec = 0;
+            if (*q == '*') { prec = args[*ai] ? atoi(args[(*ai)++]) : 0; q++; }
+            else while (*q >= '0' && *q <= '9') prec = prec * 10 + (*q++ - '0');
+        }
+        while (*q && strchr("hlLjzt", *q)) q++;
+        char conv = *q;
+        if (!conv) { sb_putn(b, p, q - p); break; }
+        p = q + 1;
+        if (width >= 0) sl += snprintf(spec + sl, sizeof(spec) - sl, "%d", width);
+        if (prec >= 0) sl += snprintf(spec + sl, sizeof(spec) - sl, ".%d", prec);
+        const char *arg = args[*ai];
+        if (arg) (*ai)++;
+        long long ll;
+        unsigned long long ull;
+        double d;
+        switch (conv) {
+        case 'd': case 'i':
+            if (num_arg(sh, arg, 0, &ll, &ull, &d) < 0) status = -1;
+            snprintf(spec + sl, sizeof(spec) - sl, "lld");
+            put_fmt(b, spec, ll);
+            break;
+        case 'u': case 'o': case 'x': case 'X':
+            if (num_arg(sh, arg, 0, &ll, &ull, &d) < 0) status = -1;
+            snprintf(spec + sl, sizeof(spec) - sl, "ll%c", conv);
+            put_fmt(b, spec, ull);
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            if (num_arg(sh, arg, 1, &ll, &ull, &d) < 0) status = -1;
+            snprintf(spec + sl, sizeof(spec) - sl, "%c", conv);
+            put_fmt(b, spec, d);
+            break;
+        case 'c': case 's': case 'b': case 'q': {
+            strbuf_t t = { NULL, 0, 0 };
+            const char *s = arg ? arg : "";
+            int stop = 0;
+            if (conv == 'c') sb_putn(&t, s, *s ? 1 : 0);
+            else if (conv == 'q') put_quoted(&t, s);
+            else if (conv == 'b') {
+                while (*s && !stop) {
+                    const char *e = strchr(s, '\\');
+                    if (!e) { sb_putn(&t, s, strlen(s)); break; }
+                    sb_putn(&t, s, e - s);
+                    s = e + 1;
+                    stop = put_escape(&t, &s, 1);
+                }
+            } else sb_putn(&t, s, strlen(s));
+            /* strings may hold NULs from %b: pad by hand */
+            size_t len = t.len;
+            if (prec >= 0 && (size_t)prec < len && conv != 'c') len = prec;
+            size_t pad = width > 0 && (size_t)width > len ? width - len : 0;
+            int left = memchr(spec, '-', sl) != NULL;
+            for (size_t k = 0; !left && k < pad; ++k) sb_putn(b, " ", 1);
+            sb_putn(b, t.s ? t.s : "", len);
+            for (size_t k = 0; left && k < pad; ++k) sb_putn(b, " ", 1);
+            free(t.s);
+            if (stop) return 1;
+            break;
+        }
+        default:
+            msh_error(sh, "printf: %%%c: invalid format character", conv);
+            return -2;
+        }
+    }
+    return status;
+}
+
+int printf_command(msh_t *sh, char **argv) {
+    const char *var = NULL;
+    int i = 1;
+    if (argv[i] && strcmp(argv[i], "-v") == 0 && argv[i + 1]) { var = argv[i + 1]; i += 2; }
+    if (argv[i] && strcmp(argv[i], "--") == 0) i++;
+    if (!argv[i]) { msh_error(sh, "printf: usage: printf [-v var] format [arguments]"); return 2; }
+    const char *fmt = argv[i];
+    char **args = argv + i + 1;
+    strbuf_t b = { NULL, 0, 0 };
+    int ai = 0, status = 0;
+    /* the format is reused while arguments remain */
+    for (;;) {
+        int before = ai, r = printf_pass(sh, &b, fmt, args, &ai);
+        if (r < 0) status = 1;
+        if (r > 0 || r == -2 || !args[ai] || ai == before) break;
+    }
+    if (var) {
+        sb_putn(&b, "", 1);
+        if (msh_setvar(sh, var, b.s) < 0) status = 1;
+    } else if (b.len && bi_write(sh, b.s, b.len) < 0) {
+        status = 1;
+    }
+    free(b.s);
+    return status;
+}
@@ -0,0 +1,448 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include <limits.h>
+#include <stdint.h>
+#include <strings.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "msh_internal.h"
+
+/* The z database: directories cd has visited, ranked by frecency. It is
+   kept in $_Z_DATA (~/.myshell_z by default), mapped shared: a visit to a
+   known directory updates its record in the mapping, and new directories
+   are appended in batches of Z_BATCH and when the context is freed. Lookups
+   go through an in-memory hash of the records. When the ranks add up to
+   more than Z_MAX_RANK they are aged, and directories that fall below 1
+   are forgotten; their records are dropped when the file is rewritten.
+   Appends and rewrites hold flock(LOCK_EX) on the file, so shells sharing
+   it do not write over each other's new records. */
+#define Z_MAGIC    "MSHZ"
+#define Z_VERSION  1
+#define Z_BATCH    16
+#define Z_MAX_RANK 9000.0
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+} z_header_t;
+
+/* Followed by len bytes of path and at least one 0, padded to 8 */
+typedef struct {
+    double rank;           /* 0: forgotten */
+    int64_t time;
+    uint32_t len;
+    uint32_t pad;
+} z_record_t;
+
+typedef struct {
+    char *path;
+    double rank;
+    int64_t time;
+    off_t off;             /* its record, -1 if not written yet */
+} z_entry_t;
+
+struct z_db {
+    char *file;
+    int fd;
+    char *map;
+    size_t size;           /* bytes mapped */
+    z_entry_t *entries;
+    size_t n, cap;
+    uint32_t *index;       /* entry + 1 per slot, 0 empty */
+    size_t slots;
+    size_t pending;        /* entries with no record yet */
+    size_t dead;           /* forgotten records in the file */
+};
+
+static size_t rec_size(size_t len) {
+    return (sizeof(z_record_t) + len + 1 + 7) & ~(size_t)7;
+}
+
+static z_entry_t *z_find(struct z_db *z, const char *path) {
+    if (!z->slots) return NULL;
+    for (size_t i = str_hash(path) & (z->slots - 1); z->index[i]; i = (i + 1) & (z->slots - 1))
+        if (strcmp(z->entries[z->index[i] - 1].path, path) == 0) return &z->entries[z->index[i] - 1];
+    return NULL;
+}
+
+static int z_rehash(struct z_db *z, size_t slots) {
+    uint32_t *ni = calloc(slots, sizeof(*ni));
+    if (!ni) return -1;
+    for (size_t k = 0; k < z->n; ++k) {
+        size_t i = str_hash(z->entries[k].path) & (slots - 1);
+        while (ni[i]) i = (i + 1) & (slots - 1);
+        ni[i] = k + 1;
+    }
+    free(z->index);
+    z->index = ni;
+    z->slots = slots;
+    return 0;
+}
+
+static z_entry_t *z_add(struct z_db *z, const char *path, size_t len) {
+    if (z->n == z->cap) {
+        size_t cap = z->cap ? z->cap * 2 : 64;
+        z_entry_t *ne = realloc(z->entries, cap * sizeof(*ne));
+        if (!ne) return NULL;
+        z->entries = ne;
+        z->cap = cap;
+    }
+    if ((z->n + 1) * 2 > z->slots && z_rehash(z, z->slots ? z->slots * 2 : 128) < 0) return NULL;
+    z_entry_t *e = &z->entries[z->n];
+    if (!(e->path = strndup(path, len))) return NULL;
+    e->rank = 0;
+    e->time = 0;
+    e->off = -1;
+    size_t i = str_hash(e->path) & (z->slots - 1);
+    while (z->index[i]) i = (i + 1) & (z->slots - 1);
+    z->index[i] = ++z->n;
+    return e;
+}
+
+static z_record_t *z_record(struct z_db *z, off_t off) {
+    return (z_record_t *)(z->map + off);
+}
+
+/* Index the records in the mapping from off on */
+static void z_scan(struct z_db *z, size_t off) {
+    while (off + sizeof(z_record_t) <= z->size) {
+        z_record_t *r = z_record(z, off);
+        if (off + rec_size(r->len) > z->size) break;
+        const char *path = (const char *)(r + 1);
+        z_entry_t *e = r->rank > 0 ? z_find(z, path) : NULL;
+        if (r->rank <= 0) {
+            z->dead++;
+        } else if (e && e->off < 0) {
+            /* another shell wrote it first: ours goes into its record */
+            e->rank += r->rank;
+            e->off = off;
+            r->rank = e->rank;
+            r->time = e->time;
+            z->pending--;
+        } else if (!e && (e = z_add(z, path, r->len))) {
+            e->rank = r->rank;
+            e->time = r->time;
+            e->off = off;
+        }
+        off += rec_size(r->len);
+    }
+}
+
+static int z_map(struct z_db *z) {
+    struct stat st;
+    if (z->map) munmap(z->map, z->size);
+    z->map = NULL;
+    z->size = 0;
+    if (fstat(z->fd, &st) < 0 || (size_t)st.st_size < sizeof(z_header_t)) return -1;
+    void *m = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, z->fd, 0);
+    if (m == MAP_FAILED) return -1;
+    z->map = m;
+    z->size = st.st_size;
+    return 0;
+}
+
+static void z_close(struct z_db *z) {
+    if (z->map) munmap(z->map, z->size);
+    if (z->fd >= 0) close(z->fd);
+    z->map = NULL;
+    z->size = 0;
+    z->fd = -1;
+}
+
+/* Open (or create) the file and index its records */
+static void z_open(struct z_db *z) {
+    z_header_t hdr;
+    z->fd = open(z->file, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (z->fd < 0) return;
+    ssize_t got = pread(z->fd, &hdr, sizeof(hdr), 0);
+    if (got == 0) {
+        memcpy(hdr.magic, Z_MAGIC, 4);
+        hdr.version = Z_VERSION;
+        if (pwrite(z->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) { z_close(z); return; }
+    } else if (got != sizeof(hdr) || memcmp(hdr.magic, Z_MAGIC, 4) != 0 || hdr.version != Z_VERSION) {
+        z_close(z);
+        return;
+    }
+    if (z_map(z) < 0) { z_close(z); return; }
+    z->dead = 0;
+    z_scan(z, sizeof(z_header_t));
+}
+
+/* The database, opened on first use; NULL without a file name */
+static struct z_db *z_get(msh_t *sh) {
+    if (sh->z) return sh->z;
+    const char *file = msh_getvar(sh, "_Z_DATA"), *home = msh_getvar(sh, "HOME");
+    char buf[PATH_MAX];
+    if (!file || !*file) {
+        if (!home || !*home) return NULL;
+        snprintf(buf, sizeof(buf), "%s/.myshell_z", home);
+        file = buf;
+    }
+    struct z_db *z = calloc(1, sizeof(*z));
+    if (!z || !(z->file = strdup(file))) { free(z); return NULL; }
+    z->fd = -1;
+    z_open(z);
+    return sh->z = z;
+}
+
+/* Lock the file now at the path; -1 if there is none. A shell that
+   replaced it while we waited has unlocked the old one, so check the
+   path still names what we locked. */
+static int z_lock(struct z_db *z) {
+    for (;;) {
+        struct stat st, cur;
+        int fd = open(z->file, O_RDWR | O_CLOEXEC);
+        if (fd < 0) return -1;
+        if (flock(fd, LOCK_EX) < 0) { close(fd); return -1; }
+        if (fstat(fd, &st) == 0 && stat(z->file, &cur) == 0 &&
+            st.st_dev == cur.st_dev && st.st_ino == cur.st_ino) return fd;
+        close(fd);
+    }
+}
+
+/* Write the live entries to a new file that replaces the old one; the
+   caller holds the lock */
+static void z_rewrite(struct z_db *z) {
+    char tmp[PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.%ld", z->file, (long)getpid());
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    z_header_t hdr = { Z_MAGIC, Z_VERSION };
+    size_t off = sizeof(hdr);
+    char zero[8] = { 0 };
+    fwrite(&hdr, sizeof(hdr), 1, f);
+    for (size_t k = 0; k < z->n; ++k) {
+        z_entry_t *e = &z->entries[k];
+        if (e->rank <= 0) continue;
+        z_record_t r = { e->rank, e->time, strlen(e->path), 0 };
+        fwrite(&r, sizeof(r), 1, f);
+        fwrite(e->path, 1, r.len, f);
+        fwrite(zero, 1, rec_size(r.len) - sizeof(r) - r.len, f);
+        e->off = off;
+        off += rec_size(r.len);
+    }
+    if (fclose(f) != 0 || rename(tmp, z->file) < 0) {
+        unlink(tmp);
+        z->pending = 0;
+        for (size_t k = 0; k < z->n; ++k) {
+            z->entries[k].off = -1;
+            z->pending += z->entries[k].rank > 0;
+        }
+        z_close(z);
+        return;
+    }
+    z_close(z);
+    z->fd = open(z->file, O_RDWR | O_CLOEXEC);
+    z->pending = z->dead = 0;
+    if (z->fd < 0 || z_map(z) < 0) z_close(z);
+}
+
+/* Append the entries that have no record yet, under the lock on the
+   file lock names (-1: none) */
+static void z_append(struct z_db *z, int lock) {
+    struct stat st, cur;
+    if (lock < 0 || fstat(lock, &cur) < 0 || fstat(z->fd, &st) < 0 ||
+        cur.st_dev != st.st_dev || cur.st_ino != st.st_ino) {
+        /* another shell replaced the file: write ours over it */
+        z_rewrite(z);
+        return;
+    }
+    if ((size_t)st.st_size > z->size) {
+        size_t old = z->size;
+        if (z_map(z) < 0) return;
+        z_scan(z, old);
+    }
+    if (z->dead > z->n / 2) { z_rewrite(z); return; }
+    if (!z->pending) return;
+    strbuf_t b = { 0 };
+    char zero[8] = { 0 };
+    off_t end = z->size;
+    for (size_t k = 0; k < z->n; ++k) {
+        z_entry_t *e = &z->entries[k];
+        if (e->off >= 0 || e->rank <= 0) continue;
+        z_record_t r = { e->rank, e->time, strlen(e->path), 0 };
+        e->off = end + b.len;
+        sb_putn(&b, (const char *)&r, sizeof(r));
+        sb_putn(&b, e->path, r.len);
+        sb_putn(&b, zero, rec_size(r.len) - sizeof(r) - r.len);
+    }
+    if (b.len && pwrite(z->fd, b.s, b.len, end) == (ssize_t)b.len && z_map(z) == 0) {
+        z->pending = 0;
+    } else {
+        for (size_t k = 0; k < z->n; ++k)
+            if (z->entries[k].off >= end) z->entries[k].off = -1;
+    }
+    free(b.s);
+}
+
+static void z_flush(struct z_db *z) {
+    if (z->fd < 0) return;
+    int lock = z_lock(z);
+    z_append(z, lock);
+    if (lock >= 0) close(lock);
+}
+
+static void z_store(struct z_db *z, z_entry_t *e) {
+    if (e->off < 0 || !z->map) return;
+    z_record_t *r = z_record(z, e->off);
+    r->rank = e->rank;
+    r->time = e->time;
+}
+
+/* Age every rank once they add up to too much */
+static void z_age(struct z_db *z) {
+    double total = 0;
+    for (size_t k = 0; k < z->n; ++k) total += z->entries[k].rank;
+    if (total <= Z_MAX_RANK) return;
+    for (size_t k = 0; k < z->n; ++k) {
+        z_entry_t *e = &z->entries[k];
+        if (e->rank <= 0) continue;
+        e->rank *= 0.99;
+        if (e->rank < 1) {
+            e->rank = 0;
+            if (e->off >= 0) z->dead++;
+            else z->pending--;
+        }
+        z_store(z, e);
+    }
+}
+
+void z_visit(msh_t *sh, const char *dir) {
+    const char *home = msh_getvar(sh, "HOME");
+    if (home && strcmp(dir, home) == 0) return;
+    struct z_db *z = z_get(sh);
+    if (!z) return;
+    z_entry_t *e = z_find(z, dir);
+    if (!e && !(e = z_add(z, dir, strlen(dir)))) return;
+    if (e->rank <= 0) {
+        if (e->off >= 0) z->dead--;
+        else z->pending++;
+    }
+    e->rank += 1;
+    e->time = time(NULL);
+    z_store(z, e);
+    z_age(z);
+    if (z->pending >= Z_BATCH) z_flush(z);
+}
+
+void z_free(msh_t *sh) {
+    struct z_db *z = sh->z;
+    if (!z) return;
+    z_flush(z);
+    z_close(z);
+    for (size_t k = 0; k < z->n; ++k) free(z->entries[k].path);
+    free(z->entries);
+    free(z->index);
+    free(z->file);
+    free(z);
+    sh->z = NULL;
+}
+
+/* Heap bytes of the database; the file mapped besides goes to *mapped */
+size_t z_mem(msh_t *sh, size_t *mapped) {
+    struct z_db *z = sh->z;
+    *mapped = z ? z->size : 0;
+    if (!z) return 0;
+    size_t n = sizeof(*z) + strlen(z->file) + 1 + z->cap * sizeof(*z->entries) + z->slots * sizeof(*z->index);
+    for (size_t k = 0; k < z->n; ++k) n += strlen(z->entries[k].path) + 1;
+    return n;
+}
+
+static double frecency(const z_entry_t *e, int64_t now, int mode) {
+    if (mode == 'r') return e->rank;
+    int64_t dt = now - e->time;
+    if (mode == 't') return -(double)dt;
+    double mult = dt < 3600 ? 4 : dt < 86400 ? 2 : dt < 604800 ? 0.5 : 0.25;
+    return e->rank * mult;
+}
+
+/* The terms appear in path in order */
+static int z_match(const char *path, char **terms, int icase) {
+    for (; *terms; ++terms) {
+        size_t tl = strlen(*terms);
+        const char *p = path;
+        while (*p && (icase ? strncasecmp(p, *terms, tl) : strncmp(p, *terms, tl)) != 0) p++;
+        if (!*p && tl) return 0;
+        path = p + tl;
+    }
+    return 1;
+}
+
+typedef struct {
+    const z_entry_t *e;
+    double score;
+} z_hit_t;
+
+static int by_score(const void *a, const void *b) {
+    double x = ((const z_hit_t *)a)->score, y = ((const z_hit_t *)b)->score;
+    return x < y ? -1 : x > y;
+}
+
+/* z [-lrtcx] [term ...]: with no -l, *dir gets the best directory that
+   still exists, for the caller to cd to */
+int z_command(msh_t *sh, char **argv, char **dir) {
+    int list = 0, mode = 0, here = 0, i = 1;
+    char cwd[PATH_MAX];
+    *dir = NULL;
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "--") == 0) { i++; break; }
+        for (const char *f = argv[i] + 1; *f; ++f) {
+            if (*f == 'l') list = 1;
+            else if (*f == 'r' || *f == 't') mode = *f;
+            else if (*f == 'c') here = 1;
+            else if (*f == 'x') here = 'x';
+            else {
+                msh_error(sh, "z: usage: z [-lrtcx] [term ...]");
+                return 2;
+            }
+        }
+    }
+    struct z_db *z = z_get(sh);
+    if (!z) { msh_error(sh, "z: no database: set HOME or _Z_DATA"); return 1; }
+    if (here) snprintf(cwd, sizeof(cwd), "%s", msh_pwd(sh));
+    if (here == 'x') {
+        z_entry_t *e = z_find(z, cwd);
+        if (e && e->rank > 0) {
+            if (e->off >= 0) z->dead++;
+            else z->pending--;
+            e->rank = 0;
+            z_store(z, e);
+        }
+        return 0;
+    }
+    if (!argv[i]) list = 1;
+    int64_t now = time(NULL);
+    size_t cl = here ? strlen(cwd) : 0;
+    z_hit_t *hits = malloc((z->n + 1) * sizeof(*hits));
+    if (!hits) { msh_perror(sh, "z"); return 1; }
+    size_t nh = 0;
+    for (int icase = 0; icase < 2 && !nh; ++icase) {
+        for (size_t k = 0; k < z->n; ++k) {
+            const z_entry_t *e = &z->entries[k];
+            if (e->rank <= 0 || !z_match(e->path, argv + i, icase)) continue;
+            if (here && (strncmp(e->path, cwd, cl) != 0 || (e->path[cl] != '/' && e->path[cl]))) continue;
+            hits[nh].e = e;
+            hits[nh++].score = frecency(e, now, mode);
+        }
+    }
+    qsort(hits, nh, sizeof(*hits), by_score);
+    int status = nh ? 0 : 1;
+    if (list) {
+        for (size_t k = 0; k < nh; ++k) bi_printf(sh, "%-10.4g %s\n", hits[k].score, hits[k].e->path);
+    } else {
+        struct stat st;
+        status = 1;
+        for (size_t k = nh; k-- > 0; )
+            if (stat(hits[k].e->path, &st) == 0 && S_ISDIR(st.st_mode)) {
+                *dir = strdup(hits[k].e->path);
+                status = 0;
+                break;
+            }
+    }
+    free(hits);
+    return status;
+}
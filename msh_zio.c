@@ -0,0 +1,472 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <zlib.h>
+#ifdef MSH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "msh_internal.h"
+
+/* set -o compress: a redirection to or from name.gz (or name.zst, when
+   built with ZSTD=1) goes through a helper thread in the shell that
+   compresses or decompresses, so `cmd > out.gz` needs no gzip process
+   and no extra pipe copy through one. The command gets one end of a pipe,
+   named /dev/fd/N in its redirection so the fork and in-process paths
+   open it like any file; the helper owns the other end and the file.
+
+   gzip output is cut into ZIO_BLOCK blocks compressed on up to
+   ZIO_WORKERS threads, each block a complete gzip member: gunzip reads
+   the concatenation as one stream, and >> adds members the same way.
+   zstd compresses with its own worker threads.
+
+   Helpers never close their fds themselves: a number freed in the shell
+   could be reused before a child forked meanwhile closes it as a helper
+   fd. A helper done with its pipe puts /dev/null over the pipe end, and
+   the shell closes everything once it has joined the thread: after the
+   pipeline in the foreground, or for a background job when its helper
+   has finished or the context is freed. */
+#define ZIO_BLOCK   (1 << 20)
+#define ZIO_WORKERS 8
+#define ZIO_SLOTS   (2 * ZIO_WORKERS)
+#define ZIO_IO      (128 * 1024)
+
+enum { ZIO_GZIP = 1, ZIO_ZSTD };
+
+/* A compressed redirection and its helper, kept until joined */
+typedef struct zio {
+    pthread_t thread;
+    int fd;          /* the command's end of the pipe; -1 once closed */
+    const char *path; /* "/dev/fd/N", the command's redirection target */
+    int kind, compress;
+    int file, pipe;  /* the helper's ends */
+    int err;         /* a copy of the shell's error fd */
+    int null;        /* /dev/null, put over pipe when the helper is done */
+    int done;        /* set by the helper as it returns */
+    int background;  /* its job runs on; joined once done */
+    char *name;
+} zjob_t;
+
+static void zio_report(zjob_t *j, const char *what) {
+    if (j->err >= 0) dprintf(j->err, "%s: %s\n", j->name, what);
+}
+
+static ssize_t read_full(int fd, unsigned char *buf, size_t n) {
+    size_t got = 0;
+    while (got < n) {
+        ssize_t r = read(fd, buf + got, n - got);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) return -1;
+        if (r == 0) break;
+        got += r;
+    }
+    return got;
+}
+
+static int write_all(int fd, const unsigned char *buf, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, buf, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0) return -1;
+        buf += w;
+        n -= w;
+    }
+    return 0;
+}
+
+/* gzip compression: the helper reads blocks into slots in order, workers
+   deflate them, and the helper writes them out in the same order */
+enum { SLOT_FREE, SLOT_FULL, SLOT_DONE };
+
+typedef struct {
+    unsigned char *in, *out;
+    size_t inlen, outlen, outcap;
+    int state;
+} zslot_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    zslot_t slots[ZIO_SLOTS];
+    long queued, taken;  /* blocks read, blocks a worker has started */
+    int eof;
+} gzpool_t;
+
+static void *gz_worker(void *arg) {
+    gzpool_t *p = arg;
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    int ok = deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (p->taken == p->queued && !p->eof) pthread_cond_wait(&p->cond, &p->lock);
+        if (p->taken == p->queued) break;
+        zslot_t *s = &p->slots[p->taken++ % ZIO_SLOTS];
+        pthread_mutex_unlock(&p->lock);
+        /* a complete gzip member per block */
+        s->outlen = 0;
+        if (ok && deflateReset(&zs) == Z_OK) {
+            zs.next_in = s->in;
+            zs.avail_in = s->inlen;
+            zs.next_out = s->out;
+            zs.avail_out = s->outcap;
+            if (deflate(&zs, Z_FINISH) == Z_STREAM_END) s->outlen = s->outcap - zs.avail_out;
+        }
+        pthread_mutex_lock(&p->lock);
+        s->state = SLOT_DONE;
+        pthread_cond_broadcast(&p->cond);
+    }
+    pthread_mutex_unlock(&p->lock);
+    if (ok) deflateEnd(&zs);
+    return NULL;
+}
+
+/* Wait for slot s to be deflated and write it to the file */
+static int gz_put(zjob_t *j, gzpool_t *p, zslot_t *s) {
+    pthread_mutex_lock(&p->lock);
+    while (s->state != SLOT_DONE) pthread_cond_wait(&p->cond, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+    s->state = SLOT_FREE;
+    if (s->inlen && !s->outlen) { zio_report(j, "compression failed"); return -1; }
+    if (write_all(j->file, s->out, s->outlen) < 0) { zio_report(j, strerror(errno)); return -1; }
+    return 0;
+}
+
+static void gz_compress(zjob_t *j) {
+    gzpool_t p;
+    memset(&p, 0, sizeof(p));
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.cond, NULL);
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int nworkers = ncpu < 1 ? 1 : ncpu > ZIO_WORKERS ? ZIO_WORKERS : (int)ncpu, started = 0;
+    size_t bound = compressBound(ZIO_BLOCK) + 64;
+    pthread_t workers[ZIO_WORKERS];
+    int failed = 0;
+    for (int k = 0; k < ZIO_SLOTS && !failed; ++k) {
+        p.slots[k].in = malloc(ZIO_BLOCK);
+        p.slots[k].out = malloc(bound);
+        p.slots[k].outcap = bound;
+        if (!p.slots[k].in || !p.slots[k].out) failed = 1;
+    }
+    for (; !failed && started < nworkers; ++started)
+        if (pthread_create(&workers[started], NULL, gz_worker, &p) != 0) break;
+    if (failed || !started) { zio_report(j, "cannot start compression"); failed = 1; }
+    long seq = 0;
+    while (!failed) {
+        zslot_t *s = &p.slots[seq % ZIO_SLOTS];
+        /* the slot's previous block goes out first */
+        if (seq >= ZIO_SLOTS && gz_put(j, &p, s) < 0) { failed = 1; break; }
+        ssize_t n = read_full(j->pipe, s->in, ZIO_BLOCK);
+        /* no input at all still makes one (empty) member */
+        if (n < 0 || (n == 0 && seq)) break;
+        s->inlen = n;
+        pthread_mutex_lock(&p.lock);
+        s->state = SLOT_FULL;
+        p.queued = ++seq;
+        pthread_cond_broadcast(&p.cond);
+        pthread_mutex_unlock(&p.lock);
+        if (!n) break;
+    }
+    /* the blocks still in flight, oldest first */
+    for (long k = seq >= ZIO_SLOTS ? seq - ZIO_SLOTS + 1 : 0; k < seq && !failed; ++k)
+        if (gz_put(j, &p, &p.slots[k % ZIO_SLOTS]) < 0) failed = 1;
+    pthread_mutex_lock(&p.lock);
+    p.eof = 1;
+    /* after a failure the queued blocks are dropped, not deflated */
+    if (failed) p.taken = p.queued;
+    pthread_cond_broadcast(&p.cond);
+    pthread_mutex_unlock(&p.lock);
+    for (int k = 0; k < started; ++k) pthread_join(workers[k], NULL);
+    for (int k = 0; k < ZIO_SLOTS; ++k) {
+        free(p.slots[k].in);
+        free(p.slots[k].out);
+    }
+    pthread_mutex_destroy(&p.lock);
+    pthread_cond_destroy(&p.cond);
+}
+
+/* gzip (or zlib) input, any number of members */
+static void gz_decompress(zjob_t *j) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    unsigned char *in = malloc(ZIO_IO), *out = malloc(ZIO_IO);
+    if (!in || !out || inflateInit2(&zs, 15 + 32) != Z_OK) {
+        zio_report(j, "cannot start decompression");
+        free(in);
+        free(out);
+        return;
+    }
+    int ended = 1;
+    for (;;) {
+        if (!zs.avail_in) {
+            ssize_t n = read(j->file, in, ZIO_IO);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) { zio_report(j, strerror(errno)); break; }
+            if (n == 0) {
+                if (!ended) zio_report(j, "unexpected end of compressed data");
+                break;
+            }
+            zs.next_in = in;
+            zs.avail_in = n;
+        }
+        if (ended) inflateReset(&zs);
+        zs.next_out = out;
+        zs.avail_out = ZIO_IO;
+        int r = inflate(&zs, Z_NO_FLUSH);
+        if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR) {
+            zio_report(j, zs.msg ? zs.msg : "invalid compressed data");
+            break;
+        }
+        ended = r == Z_STREAM_END;
+        /* the reader may stop early: then so do we */
+        if (write_all(j->pipe, out, ZIO_IO - zs.avail_out) < 0) break;
+    }
+    inflateEnd(&zs);
+    free(in);
+    free(out);
+}
+
+#ifdef MSH_ZSTD
+static void zstd_compress(zjob_t *j) {
+    ZSTD_CCtx *c = ZSTD_createCCtx();
+    size_t isz = ZSTD_CStreamInSize(), osz = ZSTD_CStreamOutSize();
+    unsigned char *in = malloc(isz), *out = malloc(osz);
+    if (!c || !in || !out) { zio_report(j, "cannot start compression"); goto done; }
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    /* a library built without threads refuses workers: it then runs here */
+    if (ncpu > 1) ZSTD_CCtx_setParameter(c, ZSTD_c_nbWorkers, ncpu > ZIO_WORKERS ? ZIO_WORKERS : (int)ncpu);
+    for (;;) {
+        ssize_t n = read(j->pipe, in, isz);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) n = 0;
+        ZSTD_EndDirective mode = n ? ZSTD_e_continue : ZSTD_e_end;
+        ZSTD_inBuffer ib = { in, (size_t)n, 0 };
+        size_t left;
+        do {
+            ZSTD_outBuffer ob = { out, osz, 0 };
+            left = ZSTD_compressStream2(c, &ob, &ib, mode);
+            if (ZSTD_isError(left)) { zio_report(j, ZSTD_getErrorName(left)); goto done; }
+            if (write_all(j->file, out, ob.pos) < 0) { zio_report(j, strerror(errno)); goto done; }
+        } while (mode == ZSTD_e_end ? left != 0 : ib.pos < ib.size);
+        if (!n) break;
+    }
+done:
+    ZSTD_freeCCtx(c);
+    free(in);
+    free(out);
+}
+
+static void zstd_decompress(zjob_t *j) {
+    ZSTD_DCtx *d = ZSTD_createDCtx();
+    size_t isz = ZSTD_DStreamInSize(), osz = ZSTD_DStreamOutSize(), left = 0;
+    unsigned char *in = malloc(isz), *out = malloc(osz);
+    if (!d || !in || !out) { zio_report(j, "cannot start decompression"); goto done; }
+    for (;;) {
+        ssize_t n = read(j->file, in, isz);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) { zio_report(j, strerror(errno)); break; }
+        if (n == 0) {
+            if (left) zio_report(j, "unexpected end of compressed data");
+            break;
+        }
+        ZSTD_inBuffer ib = { in, (size_t)n, 0 };
+        ZSTD_outBuffer ob;
+        do {
+            ob = (ZSTD_outBuffer){ out, osz, 0 };
+            left = ZSTD_decompressStream(d, &ob, &ib);
+            if (ZSTD_isError(left)) { zio_report(j, ZSTD_getErrorName(left)); goto done; }
+            if (write_all(j->pipe, out, ob.pos) < 0) goto done;
+        } while (ib.pos < ib.size || ob.pos == ob.size);
+    }
+done:
+    ZSTD_freeDCtx(d);
+    free(in);
+    free(out);
+}
+#endif
+
+static void *zio_thread(void *arg) {
+    zjob_t *j = arg;
+#ifdef MSH_ZSTD
+    if (j->kind == ZIO_ZSTD) {
+        if (j->compress) zstd_compress(j);
+        else zstd_decompress(j);
+    } else
+#endif
+    if (j->compress) gz_compress(j);
+    else gz_decompress(j);
+    /* let the other end see EOF or EPIPE; the number stays taken */
+    dup3(j->null, j->pipe, O_CLOEXEC);
+    __atomic_store_n(&j->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Join a helper and close what it held */
+static void zio_release(struct zio *z) {
+    if (z->fd >= 0) close(z->fd);
+    pthread_join(z->thread, NULL);
+    if (close(z->file) < 0 && z->compress) zio_report(z, strerror(errno));
+    close(z->pipe);
+    close(z->null);
+    if (z->err >= 0) close(z->err);
+    free(z->name);
+    free(z);
+}
+
+static int zio_kind(const char *name) {
+    size_t n = strlen(name);
+    if (n > 3 && strcmp(name + n - 3, ".gz") == 0) return ZIO_GZIP;
+    if (n > 4 && strcmp(name + n - 4, ".zst") == 0) return ZIO_ZSTD;
+    return 0;
+}
+
+/* Start the helper for a redirection of op to *target, and point *target
+   at the command's end of its pipe */
+static int zio_start(msh_t *sh, char **target, int op) {
+    int kind = zio_kind(*target), compress = op != REDIR_IN;
+    if (!kind) return 0;
+#ifndef MSH_ZSTD
+    if (kind == ZIO_ZSTD) {
+        msh_error(sh, "%s: zstd support is not built in (make ZSTD=1)", *target);
+        return -1;
+    }
+#endif
+    struct zio *z = calloc(1, sizeof(*z));
+    struct zio **nl = realloc(sh->zio, (sh->nzio + 1) * sizeof(*nl));
+    char *path = malloc(24);
+    if (nl) sh->zio = nl;
+    if (!z || !nl || !path) {
+        msh_error(sh, "%s: out of memory", *target);
+        goto fail;
+    }
+    int flags = op == REDIR_IN ? O_RDONLY : O_CREAT | O_WRONLY | (op == REDIR_APPEND ? O_APPEND : O_TRUNC);
+    if (compress) stat_cache_clear(sh);
+    z->file = msh_open(sh, *target, flags | O_CLOEXEC, 0644);
+    if (z->file < 0) { msh_perror(sh, *target); goto fail; }
+    z->null = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (z->null < 0) { msh_perror(sh, "/dev/null"); close(z->file); goto fail; }
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < 0) { msh_perror(sh, "pipe"); close(z->file); close(z->null); goto fail; }
+    /* the command writes what the helper compresses, or reads what it
+       decompresses */
+    z->fd = compress ? p[1] : p[0];
+    z->pipe = compress ? p[0] : p[1];
+    z->kind = kind;
+    z->compress = compress;
+    z->err = sh->err_fd >= 0 ? fcntl(sh->err_fd, F_DUPFD_CLOEXEC, 3) : -1;
+    /* the helper takes the file's name; the command gets the pipe's */
+    z->name = *target;
+    snprintf(path, 24, "/dev/fd/%d", z->fd);
+    z->path = path;
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int failed = pthread_create(&z->thread, NULL, zio_thread, z);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (failed) {
+        msh_error(sh, "%s: cannot start helper thread", *target);
+        close(p[0]);
+        close(p[1]);
+        close(z->file);
+        close(z->null);
+        if (z->err >= 0) close(z->err);
+        goto fail;
+    }
+    *target = path;
+    sh->zio[sh->nzio++] = z;
+    return 0;
+fail:
+    free(path);
+    free(z);
+    return -1;
+}
+
+/* Before a pipeline runs: start helpers for its compressed files.
+   Commands that apply their own redirections (exec) are left alone. */
+int zio_prepare(msh_t *sh, cmd_t cmds[], int ncmds) {
+    if (!sh->opts[OPT_COMPRESS]) return 0;
+    for (int i = 0; i < ncmds; ++i) {
+        cmd_t *c = &cmds[i];
+        if (c->builtin && (c->builtin->flags & BI_REDIRS)) continue;
+        if (c->infile && zio_start(sh, &c->infile, REDIR_IN) < 0) return -1;
+        if (c->outfile && zio_start(sh, &c->outfile, c->append ? REDIR_APPEND : REDIR_OUT) < 0) return -1;
+        for (int k = 0; k < c->nredirs; ++k)
+            if (c->redirs[k].op != REDIR_DUP && zio_start(sh, &c->redirs[k].target, c->redirs[k].op) < 0)
+                return -1;
+    }
+    return 0;
+}
+
+/* Join the helpers in [mark, nzio) that pass keep == 0 and drop them from
+   the list */
+static void zio_sweep(msh_t *sh, size_t mark, int (*keep)(struct zio *)) {
+    size_t n = mark;
+    for (size_t k = mark; k < sh->nzio; ++k) {
+        struct zio *z = sh->zio[k];
+        if (keep && keep(z)) sh->zio[n++] = z;
+        else zio_release(z);
+    }
+    sh->nzio = n;
+    if (!n) {
+        free(sh->zio);
+        sh->zio = NULL;
+    }
+}
+
+static int zio_running(struct zio *z) {
+    return z->background && !__atomic_load_n(&z->done, __ATOMIC_ACQUIRE);
+}
+
+static int zio_in_background(struct zio *z) {
+    return z->background;
+}
+
+/* After the pipeline started at mark: drop the shell's ends so helpers see
+   the commands finish, then wait for them unless the job runs on in the
+   background. Background helpers of jobs started inside the pipeline
+   (through source) stay on the list. */
+void zio_finish(msh_t *sh, size_t mark, int background) {
+    for (size_t k = mark; k < sh->nzio; ++k) {
+        struct zio *z = sh->zio[k];
+        if (z->background) continue;
+        close(z->fd);
+        z->fd = -1;
+        z->background = background;
+    }
+    zio_sweep(sh, mark, zio_in_background);
+}
+
+/* Join background helpers that have finished */
+void zio_reap(msh_t *sh) {
+    if (sh->nzio) zio_sweep(sh, 0, zio_running);
+}
+
+/* Wait for every helper, so no compressed file is cut short at exit */
+void zio_free(msh_t *sh) {
+    zio_sweep(sh, 0, NULL);
+}
+
+/* In a child just forked for cmds: close the helpers' fds, which would
+   keep pipes open, and the command ends of pipes the child does not
+   redirect to. The child never joins the helpers. */
+void zio_child(msh_t *sh, cmd_t cmds[], int ncmds) {
+    for (size_t k = 0; k < sh->nzio; ++k) {
+        struct zio *z = sh->zio[k];
+        int used = 0;
+        for (int i = 0; i < ncmds && !used; ++i) {
+            used = cmds[i].infile == z->path || cmds[i].outfile == z->path;
+            for (int r = 0; r < cmds[i].nredirs && !used; ++r) used = cmds[i].redirs[r].target == z->path;
+        }
+        if (z->fd >= 0 && !used) close(z->fd);
+        close(z->file);
+        close(z->pipe);
+        close(z->null);
+        if (z->err >= 0) close(z->err);
+        free(z);
+    }
+    free(sh->zio);
+    sh->zio = NULL;
+    sh->nzio = 0;
+}
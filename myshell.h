@@ -0,0 +1,113 @@
+/* libmyshell: the myshell engine as an embeddable library.
+
+   A msh_t holds everything a shell session owns: variables, options, the job
+   table, trace and profile state. Contexts share nothing, so a program may
+   keep several. Parse a script once with msh_parse() and run it as often as
+   needed with msh_exec(), optionally with a different environment, working
+   directory, fds or an output callback for each run. */
+#ifndef MYSHELL_H
+#define MYSHELL_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct msh msh_t;
+typedef struct msh_script msh_script_t;
+
+/* Receives everything the run writes to standard output */
+typedef void (*msh_output_fn)(void *userdata, const char *data, size_t len);
+
+/* Per-run overrides for msh_exec(). Zero-initialise, then set fds to -1 and
+   fill in what should differ from the context. */
+typedef struct {
+    char *const *envp;      /* variables for this run; NULL keeps the context's */
+    const char *cwd;        /* working directory for this run; NULL keeps the context's */
+    int in_fd, out_fd, err_fd; /* -1 keeps the context's */
+    msh_output_fn on_output;   /* if set, foreground stdout goes here instead of out_fd */
+    void *userdata;
+} msh_exec_opts_t;
+
+/* New context with variables copied from environ, a working directory of
+   its own that starts as the process's, and fds 0, 1 and 2 */
+msh_t *msh_new(void);
+/* Make cd change the working directory of the whole process, as a shell
+   run from the command line does, instead of the context's own */
+void msh_use_process_cwd(msh_t *sh);
+/* Take the process's open fds 3-9 as the script's 3-9, as a shell run
+   from the command line does. An embedding program normally does not. */
+void msh_adopt_fds(msh_t *sh);
+/* Flush trace output, print the profile if one was recorded, and free */
+void msh_free(msh_t *sh);
+
+/* Behaviour of the context */
+int msh_set_option(msh_t *sh, const char *name, int on); /* -1 if unknown */
+void msh_set_interactive(msh_t *sh, int interactive);
+int msh_setvar(msh_t *sh, const char *name, const char *value);
+const char *msh_getvar(msh_t *sh, const char *name);
+int msh_unsetvar(msh_t *sh, const char *name);
+
+/* Parse a script. Lines with syntax errors are reported on the context's
+   error fd, counted, and skipped when the script runs. */
+msh_script_t *msh_parse(msh_t *sh, const char *src, size_t len, const char *name);
+msh_script_t *msh_parse_file(msh_t *sh, const char *path);
+int msh_script_errors(const msh_script_t *script);
+void msh_script_free(msh_script_t *script);
+
+/* Run a parsed script; returns its exit status. opts may be NULL. An exit
+   ends the run, not the context: the next msh_exec() runs normally. */
+int msh_exec(msh_t *sh, const msh_script_t *script, const msh_exec_opts_t *opts);
+/* Parse and run one line, as typed at a prompt */
+int msh_run_line(msh_t *sh, const char *line);
+
+/* Report, without running anything, how each line would execute
+   (returns the number of missing commands plus lines that fail to parse or
+   expand) or which lines fork more than needed (returns the number of
+   avoidable forks). */
+int msh_plan(msh_t *sh, const msh_script_t *script);
+int msh_lint_perf(msh_t *sh, const msh_script_t *script);
+
+/* The working directory as cd left it, symlinks included; kept by the
+   shell, so this costs no getcwd */
+const char *msh_pwd(msh_t *sh);
+
+/* True if name would run as a command: a builtin, a loaded builtin or an
+   executable in PATH. PATH results come from the command hash. */
+int msh_is_command(msh_t *sh, const char *name);
+
+/* True once exit, errexit or nounset in the last msh_run_line() asked the
+   shell to stop; msh_status() is then the status it exits with */
+int msh_exiting(const msh_t *sh);
+int msh_status(const msh_t *sh);
+
+/* Background jobs. msh_reap_jobs() polls the context's jobs without
+   blocking; msh_child_exited() records a status already collected by the
+   caller, e.g. from a SIGCHLD handler. */
+void msh_reap_jobs(msh_t *sh);
+void msh_child_exited(msh_t *sh, pid_t pid, int status);
+
+/* Write out buffered trace output */
+void msh_flush(msh_t *sh);
+
+/* Loadable builtins. A builtin runs inside the shell with argv[0] set to
+   its name and returns its exit status. It reads and writes its standard
+   input and output through msh_read() and msh_write() so that it works as
+   a pipeline stage; msh_write() returns -1 once the reader has gone.
+
+   `enable -f lib.so name` loads lib.so and looks up the symbol
+   msh_builtin_<name>; embedders can register functions directly with
+   msh_add_builtin(). Names of the shell's own builtins are refused. */
+typedef int (*msh_builtin_fn)(msh_t *sh, int argc, char **argv);
+
+int msh_add_builtin(msh_t *sh, const char *name, msh_builtin_fn fn);
+ssize_t msh_read(msh_t *sh, void *buf, size_t len);
+int msh_write(msh_t *sh, const void *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Time N calls of the sample helper run as an external program and as a
+# loaded builtin. Usage: plugins/bench.sh [N]   (run `make plugins` first)
+n=${1:-2000}
+dir=$(dirname "$0")
+shell=$dir/../myshell
+ext=$(mktemp) && inproc=$(mktemp) || exit 1
+trap 'rm -f "$ext" "$inproc"' EXIT
+
+echo "enable -f $dir/sum.so sum" > "$inproc"
+i=0
+while [ $i -lt "$n" ]; do
+    echo "$dir/sum 1 2 $i > /dev/null" >> "$ext"
+    echo "sum 1 2 $i > /dev/null" >> "$inproc"
+    i=$((i + 1))
+done
+
+now() { date +%s.%N; }
+t0=$(now); "$shell" "$ext"; t1=$(now)
+"$shell" "$inproc"; t2=$(now)
+awk -v n="$n" -v a="$t0" -v b="$t1" -v c="$t2" 'BEGIN {
+    printf "external: %d calls in %.3fs (%.1f us/call)\n", n, b - a, (b - a) * 1e6 / n
+    printf "builtin:  %d calls in %.3fs (%.1f us/call)\n", n, c - b, (c - b) * 1e6 / n
+}'
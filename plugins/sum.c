@@ -0,0 +1,41 @@
+/* sum: print the sum of its integer arguments.
+
+   A sample of the kind of tiny helper a script calls thousands of times.
+   Built twice: as an ordinary program (plugins/sum) and, with -DMSH_PLUGIN,
+   as a builtin loaded with `enable -f plugins/sum.so sum`. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static int sum(int argc, char **argv, char *out, size_t outlen, int *len) {
+    long long total = 0;
+    for (int i = 1; i < argc; ++i) {
+        char *end;
+        long long v = strtoll(argv[i], &end, 10);
+        if (*end || end == argv[i]) return 1;
+        total += v;
+    }
+    *len = snprintf(out, outlen, "%lld\n", total);
+    return 0;
+}
+
+#ifdef MSH_PLUGIN
+#include "myshell.h"
+
+int msh_builtin_sum(msh_t *sh, int argc, char **argv) {
+    char out[32];
+    int len;
+    if (sum(argc, argv, out, sizeof(out), &len)) return 2;
+    return msh_write(sh, out, len) < 0 ? 1 : 0;
+}
+#else
+int main(int argc, char **argv) {
+    char out[32];
+    int len;
+    if (sum(argc, argv, out, sizeof(out), &len)) {
+        fprintf(stderr, "sum: integer arguments expected\n");
+        return 2;
+    }
+    return write(STDOUT_FILENO, out, len) == len ? 0 : 1;
+}
+#endif
@@ -0,0 +1,338 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "prompt.h"
+
+#define MAX_SEGMENTS  8
+#define SEGMENT_DIRS  16   /* cached values per segment, one per directory */
+#define SEGMENT_MAX   256  /* bytes of a segment value */
+
+typedef struct {
+    char *cwd;
+    char *value;
+} seg_value_t;
+
+typedef struct {
+    char *cmd;                  /* NULL for \g */
+    seg_value_t vals[SEGMENT_DIRS];
+    int next;                   /* slot to reuse when all are taken */
+    pid_t pid;                  /* helper computing the value, 0 if none */
+    int fd;                     /* its output, -1 if none */
+    char out[SEGMENT_MAX];      /* first line of the output */
+    size_t len;
+    int eol;                    /* the first line is complete */
+    int lines;                  /* \g: status lines after the branch line */
+} segment_t;
+
+typedef struct {
+    char *s;
+    size_t len, cap;
+} buf_t;
+
+struct prompt {
+    msh_t *sh;
+    char *ps1;                  /* the PS1 the segments come from */
+    segment_t segs[MAX_SEGMENTS];
+    int nsegs;
+    char cwd[4096];
+    buf_t text;
+};
+
+static void put(buf_t *b, const char *s, size_t n) {
+    if (b->len + n + 1 > b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 256;
+        while (cap < b->len + n + 1) cap *= 2;
+        char *ns = realloc(b->s, cap);
+        if (!ns) return;
+        b->s = ns;
+        b->cap = cap;
+    }
+    memcpy(b->s + b->len, s, n);
+    b->len += n;
+    b->s[b->len] = 0;
+}
+
+static void puts_(buf_t *b, const char *s) { put(b, s, strlen(s)); }
+
+prompt_t *prompt_new(msh_t *sh) {
+    prompt_t *p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+    p->sh = sh;
+    return p;
+}
+
+static void seg_stop(segment_t *s) {
+    if (s->fd >= 0) close(s->fd);
+    if (s->pid > 0) kill(s->pid, SIGTERM);
+    s->fd = -1;
+    s->pid = 0;
+}
+
+static void segs_clear(prompt_t *p) {
+    for (int i = 0; i < p->nsegs; ++i) {
+        segment_t *s = &p->segs[i];
+        seg_stop(s);
+        free(s->cmd);
+        for (int k = 0; k < SEGMENT_DIRS; ++k) {
+            free(s->vals[k].cwd);
+            free(s->vals[k].value);
+        }
+        memset(s, 0, sizeof(*s));
+    }
+    p->nsegs = 0;
+}
+
+void prompt_free(prompt_t *p) {
+    if (!p) return;
+    segs_clear(p);
+    free(p->ps1);
+    free(p->text.s);
+    free(p);
+}
+
+static seg_value_t *seg_value(segment_t *s, const char *cwd) {
+    for (int k = 0; k < SEGMENT_DIRS; ++k)
+        if (s->vals[k].cwd && strcmp(s->vals[k].cwd, cwd) == 0) return &s->vals[k];
+    return NULL;
+}
+
+static void seg_store(segment_t *s, const char *cwd, const char *value) {
+    seg_value_t *v = seg_value(s, cwd);
+    if (!v) {
+        v = &s->vals[s->next];
+        s->next = (s->next + 1) % SEGMENT_DIRS;
+        free(v->cwd);
+        v->cwd = strdup(cwd);
+    }
+    free(v->value);
+    v->value = strdup(value);
+}
+
+/* Register segment k of the prompt being parsed; NULL cmd is \g */
+static segment_t *seg_get(prompt_t *p, int k, const char *cmd, size_t cmdlen) {
+    if (k >= MAX_SEGMENTS) return NULL;
+    if (k == p->nsegs) {
+        segment_t *s = &p->segs[p->nsegs++];
+        s->fd = -1;
+        s->cmd = cmd ? strndup(cmd, cmdlen) : NULL;
+    }
+    return &p->segs[k];
+}
+
+static void put_cwd(prompt_t *p, buf_t *b, int base) {
+    const char *home = msh_getvar(p->sh, "HOME");
+    size_t hl = home ? strlen(home) : 0;
+    const char *cwd = p->cwd;
+    if (hl > 1 && strncmp(cwd, home, hl) == 0 && (cwd[hl] == '/' || !cwd[hl])) {
+        if (!cwd[hl] || !base) {
+            puts_(b, "~");
+            if (!base) puts_(b, cwd + hl);
+            return;
+        }
+    }
+    if (base && strcmp(cwd, "/") != 0) {
+        const char *slash = strrchr(cwd, '/');
+        puts_(b, slash ? slash + 1 : cwd);
+    } else {
+        puts_(b, cwd);
+    }
+}
+
+static void put_user(prompt_t *p, buf_t *b) {
+    const char *user = msh_getvar(p->sh, "USER");
+    if (!user) {
+        struct passwd *pw = getpwuid(geteuid());
+        user = pw ? pw->pw_name : "?";
+    }
+    puts_(b, user);
+}
+
+/* Expand PS1 into p->text. Async segments show their cached value. */
+static void render(prompt_t *p, const char *ps1) {
+    buf_t *b = &p->text;
+    b->len = 0;
+    put(b, "", 0);
+    int k = 0;
+    for (const char *c = ps1; *c; ++c) {
+        if (*c == '$' && (c[1] == '?' || c[1] == '{' || c[1] == '_' ||
+                          (c[1] >= 'A' && c[1] <= 'Z') || (c[1] >= 'a' && c[1] <= 'z'))) {
+            char name[256], tmp[16];
+            size_t n = 0;
+            int braced = c[1] == '{';
+            const char *q = c + 1 + braced;
+            if (*q == '?') {
+                snprintf(tmp, sizeof(tmp), "%d", msh_status(p->sh));
+                puts_(b, tmp);
+                c = q + braced;
+                continue;
+            }
+            while (n < sizeof(name) - 1 && (q[n] == '_' || (q[n] >= 'A' && q[n] <= 'Z') ||
+                                           (q[n] >= 'a' && q[n] <= 'z') || (n && q[n] >= '0' && q[n] <= '9'))) {
+                name[n] = q[n];
+                n++;
+            }
+            name[n] = 0;
+            if (braced && q[n] != '}') { put(b, c, 1); continue; }
+            const char *v = msh_getvar(p->sh, name);
+            if (v) puts_(b, v);
+            c = q + n - 1 + braced;
+            continue;
+        }
+        if (*c != '\\' || !c[1]) { put(b, c, 1); continue; }
+        char host[256];
+        switch (*++c) {
+        case 'u': put_user(p, b); break;
+        case 'h':
+        case 'H':
+            if (gethostname(host, sizeof(host)) < 0) snprintf(host, sizeof(host), "?");
+            host[sizeof(host) - 1] = 0;
+            if (*c == 'h' && strchr(host, '.')) *strchr(host, '.') = 0;
+            puts_(b, host);
+            break;
+        case 'w': put_cwd(p, b, 0); break;
+        case 'W': put_cwd(p, b, 1); break;
+        case '$': puts_(b, geteuid() == 0 ? "#" : "$"); break;
+        case 'n': puts_(b, "\n"); break;
+        case 'e': puts_(b, "\033"); break;
+        case 'a': puts_(b, "\a"); break;
+        case '\\': puts_(b, "\\"); break;
+        case '[': case ']': break; /* the editor measures escapes itself */
+        case 'g':
+        case '(': {
+            const char *cmd = NULL;
+            size_t cmdlen = 0;
+            if (*c == '(') {
+                const char *end = strchr(c, ')');
+                if (!end) { puts_(b, "\\("); break; }
+                cmd = c + 1;
+                cmdlen = end - cmd;
+                c = end;
+            }
+            segment_t *s = seg_get(p, k++, cmd, cmdlen);
+            seg_value_t *v = s ? seg_value(s, p->cwd) : NULL;
+            if (v && v->value) puts_(b, v->value);
+            break;
+        }
+        default: put(b, c - 1, 2); break;
+        }
+    }
+}
+
+/* Fork a helper whose output on s->fd becomes the segment */
+static void seg_start(prompt_t *p, segment_t *s) {
+    int fds[2];
+    seg_stop(s);
+    s->len = 0;
+    s->eol = s->lines = 0;
+    if (pipe(fds) < 0) return;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) { close(fds[0]); close(fds[1]); return; }
+    if (pid == 0) {
+        int null = open("/dev/null", O_RDWR);
+        dup2(fds[1], STDOUT_FILENO);
+        if (null >= 0) { dup2(null, STDIN_FILENO); dup2(null, STDERR_FILENO); }
+        close(fds[0]);
+        close(fds[1]);
+        signal(SIGINT, SIG_DFL);
+        if (!s->cmd) {
+            char *argv[] = { "git", "status", "--porcelain", "--branch", "--untracked-files=no", NULL };
+            execvp("git", argv);
+            _exit(127);
+        }
+        /* the command runs in this shell's own language and state */
+        msh_run_line(p->sh, s->cmd);
+        msh_flush(p->sh);
+        _exit(msh_status(p->sh));
+    }
+    close(fds[1]);
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    s->pid = pid;
+    s->fd = fds[0];
+}
+
+const char *prompt_begin(prompt_t *p) {
+    const char *ps1 = msh_getvar(p->sh, "PS1");
+    if (!ps1) ps1 = PROMPT_DEFAULT;
+    if (!p->ps1 || strcmp(p->ps1, ps1) != 0) {
+        segs_clear(p);
+        free(p->ps1);
+        p->ps1 = strdup(ps1);
+    }
+    snprintf(p->cwd, sizeof(p->cwd), "%s", msh_pwd(p->sh));
+    render(p, ps1);
+    for (int i = 0; i < p->nsegs; ++i) seg_start(p, &p->segs[i]);
+    return p->text.s ? p->text.s : "";
+}
+
+int prompt_fds(void *ud, struct pollfd *fds, int max) {
+    prompt_t *p = ud;
+    int n = 0;
+    for (int i = 0; i < p->nsegs && n < max; ++i) {
+        if (p->segs[i].fd < 0) continue;
+        fds[n].fd = p->segs[i].fd;
+        fds[n].events = POLLIN;
+        fds[n++].revents = 0;
+    }
+    return n;
+}
+
+/* The value a finished helper's output stands for */
+static void seg_finish(prompt_t *p, segment_t *s) {
+    s->out[s->len] = 0;
+    char value[SEGMENT_MAX + 2];
+    if (!s->cmd) {
+        /* "## branch...upstream [ahead 1]" then one line per change */
+        char *branch = s->out;
+        if (strncmp(branch, "## No commits yet on ", 21) == 0) branch += 21;
+        else if (strncmp(branch, "## ", 3) == 0) branch += 3;
+        else branch = "";
+        branch[strcspn(branch, ". ")] = 0;
+        snprintf(value, sizeof(value), "%s%s", branch, *branch && s->lines ? "*" : "");
+    } else {
+        snprintf(value, sizeof(value), "%s", s->out);
+    }
+    seg_store(s, p->cwd, value);
+    seg_stop(s);
+}
+
+const char *prompt_poll(void *ud, const struct pollfd *fds, int n) {
+    prompt_t *p = ud;
+    int changed = 0;
+    for (int i = 0; i < n; ++i) {
+        if (!fds[i].revents) continue;
+        for (int k = 0; k < p->nsegs; ++k) {
+            segment_t *s = &p->segs[k];
+            if (s->fd != fds[i].fd) continue;
+            char chunk[4096];
+            ssize_t r = read(s->fd, chunk, sizeof(chunk));
+            if (r < 0 && errno == EINTR) break;
+            if (r <= 0) {
+                seg_value_t *old = seg_value(s, p->cwd);
+                char *before = strdup(old && old->value ? old->value : "");
+                seg_finish(p, s);
+                seg_value_t *now = seg_value(s, p->cwd);
+                if (!before || !now || !now->value || strcmp(before, now->value) != 0) changed = 1;
+                free(before);
+                break;
+            }
+            for (ssize_t j = 0; j < r; ++j) {
+                /* keep the first line; count the rest for \g */
+                if (s->eol) { s->lines += chunk[j] == '\n'; continue; }
+                if (chunk[j] == '\n') { s->eol = 1; continue; }
+                if (s->len < SEGMENT_MAX - 1) s->out[s->len++] = chunk[j];
+            }
+            break;
+        }
+    }
+    if (!changed) return NULL;
+    render(p, p->ps1);
+    return p->text.s;
+}
@@ -0,0 +1,33 @@
+/* PS1 prompts for the interactive front end.
+
+   Besides bash's \u \h \H \w \W \$ \n \e \a \\ and \[ \], and $NAME, a
+   prompt can hold segments that are slow to compute: \g (git branch, with
+   * when the tree is dirty) and \(cmd) (the first line cmd prints). Each
+   prompt starts a helper process per segment and shows the value last
+   computed in the same directory until the helper answers; the line
+   editor polls the helpers' fds and redraws the prompt when one does. */
+#ifndef PROMPT_H
+#define PROMPT_H
+
+#include <poll.h>
+
+#include "myshell.h"
+
+#define PROMPT_DEFAULT "myshell$ "
+
+typedef struct prompt prompt_t;
+
+prompt_t *prompt_new(msh_t *sh);
+void prompt_free(prompt_t *p);
+
+/* Render PS1 for a new command line and start its segment helpers */
+const char *prompt_begin(prompt_t *p);
+
+/* The helpers still running, at most max; returns how many */
+int prompt_fds(void *p, struct pollfd *fds, int max);
+
+/* Read what the helpers in fds[0..n) have written. Returns the prompt
+   rendered again if a segment changed, else NULL. */
+const char *prompt_poll(void *p, const struct pollfd *fds, int n);
+
+#endif
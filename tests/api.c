@@ -0,0 +1,200 @@
+/* Tests of the libmyshell API: several runs on one context, per-run
+   overrides, and contexts side by side.
+   Build and run with `make test`. */
+#include "myshell.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int failures;
+static int devnull = -1; /* error fd of the runs: errexit reports there */
+
+#define CHECK(cond) do { \
+    if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+} while (0)
+
+typedef struct { char buf[256]; size_t len; } capture_t;
+
+static void on_output(void *userdata, const char *data, size_t len) {
+    capture_t *c = userdata;
+    if (len > sizeof(c->buf) - 1 - c->len) len = sizeof(c->buf) - 1 - c->len;
+    memcpy(c->buf + c->len, data, len);
+    c->len += len;
+    c->buf[c->len] = '\0';
+}
+
+/* Run src on sh with opts, capturing its output in c */
+static int run_opts(msh_t *sh, const char *src, msh_exec_opts_t *opts, capture_t *c) {
+    msh_script_t *sc = msh_parse(sh, src, strlen(src), "test");
+    if (!sc) return -1;
+    opts->on_output = on_output;
+    opts->userdata = c;
+    c->len = 0;
+    c->buf[0] = '\0';
+    int status = msh_exec(sh, sc, opts);
+    msh_script_free(sc);
+    return status;
+}
+
+static int run(msh_t *sh, const char *src, capture_t *c) {
+    msh_exec_opts_t opts = { .in_fd = -1, .out_fd = -1, .err_fd = devnull };
+    return run_opts(sh, src, &opts, c);
+}
+
+/* Contents of path, in a static buffer */
+static const char *slurp(const char *path) {
+    static char buf[256];
+    int fd = open(path, O_RDONLY);
+    ssize_t n = fd < 0 ? -1 : read(fd, buf, sizeof buf - 1);
+    buf[n < 0 ? 0 : n] = '\0';
+    if (fd >= 0) close(fd);
+    return buf;
+}
+
+/* An exit ends its own script only */
+static void test_exit_then_run(void) {
+    msh_t *sh = msh_new();
+    capture_t c;
+    CHECK(run(sh, "echo first\nexit 3\necho unreached\n", &c) == 3);
+    CHECK(strcmp(c.buf, "first\n") == 0);
+    CHECK(!msh_exiting(sh));
+    CHECK(run(sh, "echo second\n", &c) == 0);
+    CHECK(strcmp(c.buf, "second\n") == 0);
+    msh_free(sh);
+}
+
+/* So does errexit, and variables set by one run are seen by the next */
+static void test_errexit_then_run(void) {
+    msh_t *sh = msh_new();
+    capture_t c;
+    CHECK(run(sh, "v=kept\nset -e\nfalse\necho unreached\n", &c) == 1);
+    CHECK(c.len == 0);
+    CHECK(run(sh, "set +e\necho $v\n", &c) == 0);
+    CHECK(strcmp(c.buf, "kept\n") == 0);
+    msh_free(sh);
+}
+
+/* One parsed script, executed repeatedly; without opts too */
+static void test_parse_once(void) {
+    msh_t *sh = msh_new();
+    const char *src = "exit 4\n";
+    msh_script_t *sc = msh_parse(sh, src, strlen(src), "test");
+    CHECK(sc != NULL);
+    for (int i = 0; sc && i < 3; ++i) CHECK(msh_exec(sh, sc, NULL) == 4);
+    msh_script_free(sc);
+    CHECK(msh_run_line(sh, "exit 5") == 5);
+    CHECK(msh_exiting(sh));
+    CHECK(msh_run_line(sh, "true") == 0);
+    CHECK(!msh_exiting(sh));
+    msh_free(sh);
+}
+
+/* cwd and envp apply to their run only */
+static void test_cwd_envp(const char *dir) {
+    msh_t *sh = msh_new();
+    capture_t c;
+    char *env[] = { "API_ONLY=set", NULL };
+    msh_exec_opts_t opts = { .cwd = dir, .envp = env, .in_fd = -1, .out_fd = -1, .err_fd = devnull };
+    CHECK(run_opts(sh, "pwd\necho $API_ONLY\n", &opts, &c) == 0);
+    char want[PATH_MAX + 16];
+    snprintf(want, sizeof want, "%s\nset\n", dir);
+    CHECK(strcmp(c.buf, want) == 0);
+    CHECK(run(sh, "echo x$API_ONLY\n", &c) == 0);
+    CHECK(strcmp(c.buf, "x\n") == 0);
+    CHECK(strcmp(msh_pwd(sh), dir) != 0);
+    msh_free(sh);
+}
+
+/* out_fd receives the run's output, also past an exec redirection of the
+   context's own, and stays the caller's: the run closes neither it nor
+   the context's fd */
+static void test_fds(const char *dir) {
+    char mine[PATH_MAX + 8], ctx[PATH_MAX + 8], cmd[PATH_MAX + 16];
+    snprintf(mine, sizeof mine, "%s/mine", dir);
+    snprintf(ctx, sizeof ctx, "%s/ctx", dir);
+    msh_t *sh = msh_new();
+    snprintf(cmd, sizeof cmd, "exec >%s", ctx);
+    CHECK(msh_run_line(sh, cmd) == 0);
+    int fd = open(mine, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    msh_script_t *sc = msh_parse(sh, "echo one\nexec >/dev/null\necho two\n", 34, "test");
+    CHECK(sc != NULL);
+    msh_exec_opts_t opts = { .in_fd = -1, .out_fd = fd, .err_fd = devnull };
+    CHECK(sc && msh_exec(sh, sc, &opts) == 0);
+    msh_script_free(sc);
+    CHECK(fcntl(fd, F_GETFD) != -1);
+    CHECK(write(fd, "caller\n", 7) == 7);
+    close(fd);
+    CHECK(strcmp(slurp(mine), "one\ncaller\n") == 0);
+    CHECK(msh_run_line(sh, "echo three") == 0);
+    CHECK(strcmp(slurp(ctx), "three\n") == 0);
+    msh_free(sh);
+}
+
+/* cd in one context moves neither another context nor the process */
+static void test_isolation(const char *dir) {
+    char start[PATH_MAX], here[PATH_MAX], cmd[PATH_MAX + 8];
+    CHECK(getcwd(start, sizeof start) != NULL);
+    msh_t *a = msh_new(), *b = msh_new();
+    snprintf(cmd, sizeof cmd, "cd %s", dir);
+    CHECK(msh_run_line(a, cmd) == 0);
+    CHECK(msh_run_line(a, "v=a") == 0);
+    CHECK(strcmp(msh_pwd(a), dir) == 0);
+    CHECK(strcmp(msh_pwd(b), start) == 0);
+    CHECK(msh_getvar(b, "v") == NULL);
+    CHECK(getcwd(here, sizeof here) != NULL && strcmp(here, start) == 0);
+    capture_t c;
+    CHECK(run(a, "pwd\n", &c) == 0);
+    snprintf(cmd, sizeof cmd, "%s\n", dir);
+    CHECK(strcmp(c.buf, cmd) == 0);
+    msh_free(a);
+    msh_free(b);
+}
+
+/* Commands named by a relative path, or found through a relative PATH
+   entry, are looked for in the context's directory */
+static void test_relative_commands(const char *dir) {
+    char tool[PATH_MAX + 16], cmd[PATH_MAX + 8];
+    snprintf(tool, sizeof tool, "%s/bin", dir);
+    CHECK(mkdir(tool, 0755) == 0);
+    strcat(tool, "/tool");
+    int fd = open(tool, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+    CHECK(fd >= 0 && write(fd, "#!/bin/sh\necho ran\n", 20) == 20);
+    if (fd >= 0) close(fd);
+    msh_t *sh = msh_new();
+    snprintf(cmd, sizeof cmd, "cd %s", dir);
+    CHECK(msh_run_line(sh, cmd) == 0);
+    capture_t c;
+    CHECK(run(sh, "command -v ./bin/tool\nPATH=bin:/bin:/usr/bin\ncommand -v tool\ntool\n", &c) == 0);
+    CHECK(strcmp(c.buf, "./bin/tool\nbin/tool\nran\n") == 0);
+    msh_free(sh);
+}
+
+int main(void) {
+    devnull = open("/dev/null", O_WRONLY);
+    char tmpl[] = "/tmp/msh-api.XXXXXX";
+    char *dir = mkdtemp(tmpl);
+    if (!dir) { perror("mkdtemp"); return 1; }
+    char real[PATH_MAX];
+    if (!realpath(dir, real)) { perror(dir); return 1; }
+    test_exit_then_run();
+    test_errexit_then_run();
+    test_parse_once();
+    test_cwd_envp(real);
+    test_fds(real);
+    test_isolation(real);
+    test_relative_commands(real);
+    char cmd[PATH_MAX + 16];
+    snprintf(cmd, sizeof cmd, "rm -rf %s", real);
+    if (system(cmd) != 0) fprintf(stderr, "api: could not remove %s\n", real);
+    if (failures) {
+        fprintf(stderr, "api: %d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("api: ok\n");
+    return 0;
+}
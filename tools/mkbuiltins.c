@@ -0,0 +1,122 @@
+/* mkbuiltins: turn builtins.def into a C header holding handler prototypes,
+   a perfect hash function and the table it indexes, so looking up a builtin
+   costs one hash and one strcmp however many builtins there are.
+
+   Usage: mkbuiltins builtins.def > builtins_table.h */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_BUILTINS 256
+
+typedef struct {
+    char name[64];
+    char handler[64];
+    char flags[128];
+} def_t;
+
+static def_t defs[MAX_BUILTINS];
+static int ndefs;
+
+/* Must match the hash emitted below */
+static unsigned hash(const char *s, unsigned seed) {
+    unsigned h = seed;
+    while (*s) { h ^= (unsigned char)*s++; h *= 16777619u; }
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    return h;
+}
+
+/* Smallest table and seed that give every name its own slot */
+static int find_hash(unsigned *size, unsigned *seed) {
+    unsigned start = 1;
+    while (start < (unsigned)ndefs) start <<= 1;
+    for (unsigned sz = start; sz <= start * 8; sz <<= 1) {
+        for (unsigned sd = 1; sd < (1u << 20); ++sd) {
+            unsigned char used[MAX_BUILTINS * 8] = {0};
+            int i = 0;
+            for (; i < ndefs; ++i) {
+                unsigned slot = hash(defs[i].name, sd) & (sz - 1);
+                if (used[slot]) break;
+                used[slot] = 1;
+            }
+            if (i == ndefs) { *size = sz; *seed = sd; return 0; }
+        }
+    }
+    return -1;
+}
+
+static int flag_bits(const char *file, int lineno, const char *flags, char *out, size_t outlen) {
+    out[0] = 0;
+    if (strcmp(flags, "-") == 0) { snprintf(out, outlen, "0"); return 0; }
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s", flags);
+    for (char *f = strtok(buf, ","); f; f = strtok(NULL, ",")) {
+        const char *bit;
+        if (strcmp(f, "inproc") == 0) bit = "BI_INPROC";
+        else if (strcmp(f, "special") == 0) bit = "BI_SPECIAL";
+        else if (strcmp(f, "redirs") == 0) bit = "BI_REDIRS";
+        else { fprintf(stderr, "%s:%d: unknown flag '%s'\n", file, lineno, f); return -1; }
+        size_t len = strlen(out);
+        snprintf(out + len, outlen - len, "%s%s", len ? " | " : "", bit);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) { fprintf(stderr, "usage: mkbuiltins builtins.def\n"); return 2; }
+    FILE *in = fopen(argv[1], "r");
+    if (!in) { perror(argv[1]); return 1; }
+    char line[512];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), in)) {
+        lineno++;
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || !*p) continue;
+        if (ndefs == MAX_BUILTINS) { fprintf(stderr, "%s: too many builtins\n", argv[1]); return 1; }
+        def_t *d = &defs[ndefs];
+        if (sscanf(p, "%63s %63s %127s", d->name, d->handler, d->flags) != 3) {
+            fprintf(stderr, "%s:%d: expected: name handler flags\n", argv[1], lineno);
+            return 1;
+        }
+        char bits[256];
+        if (flag_bits(argv[1], lineno, d->flags, bits, sizeof(bits)) < 0) return 1;
+        for (int i = 0; i < ndefs; ++i) {
+            if (strcmp(defs[i].name, d->name) == 0) {
+                fprintf(stderr, "%s:%d: duplicate builtin '%s'\n", argv[1], lineno, d->name);
+                return 1;
+            }
+        }
+        ndefs++;
+    }
+    fclose(in);
+
+    unsigned size, seed;
+    if (find_hash(&size, &seed) < 0) { fprintf(stderr, "%s: no perfect hash found\n", argv[1]); return 1; }
+
+    printf("/* Generated by tools/mkbuiltins from %s; do not edit. */\n\n", argv[1]);
+    for (int i = 0; i < ndefs; ++i) {
+        int dup = 0;
+        for (int j = 0; j < i; ++j) dup |= strcmp(defs[j].handler, defs[i].handler) == 0;
+        if (!dup) printf("static int %s(msh_t *sh, cmd_t *c);\n", defs[i].handler);
+    }
+    printf("\n#define BUILTIN_HASH_SIZE %u\n\n", size);
+    printf("static unsigned builtin_hash(const char *s) {\n"
+           "    unsigned h = %uu;\n"
+           "    while (*s) { h ^= (unsigned char)*s++; h *= 16777619u; }\n"
+           "    h ^= h >> 16;\n"
+           "    h *= 0x7feb352du;\n"
+           "    h ^= h >> 15;\n"
+           "    return h & (BUILTIN_HASH_SIZE - 1);\n"
+           "}\n\n", seed);
+    printf("static const builtin_def_t builtin_table[BUILTIN_HASH_SIZE] = {\n");
+    for (int i = 0; i < ndefs; ++i) {
+        char bits[256];
+        flag_bits(argv[1], 0, defs[i].flags, bits, sizeof(bits));
+        printf("    [%u] = { \"%s\", %s, %s },\n", hash(defs[i].name, seed) & (size - 1),
+               defs[i].name, defs[i].handler, bits);
+    }
+    printf("};\n");
+    return 0;
+}